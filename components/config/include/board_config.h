@@ -6,6 +6,8 @@
 #include "soc/soc_caps.h"
 #include "esp_log.h"
 
+#define BOARD_CONFIG_CONNECTORS_MAX 2
+
 typedef enum {
     BOARD_CONFIG_ENERGY_METER_NONE,
     BOARD_CONFIG_ENERGY_METER_CUR,
@@ -59,6 +61,11 @@ typedef struct
     uint16_t proximity_down_threshold_20;
     uint16_t proximity_down_threshold_32;
 
+    bool connector_2 : 1;
+    gpio_num_t connector_2_pilot_pwm_gpio;
+    adc_channel_t connector_2_pilot_adc_channel;
+    gpio_num_t connector_2_ac_relay_gpio;
+
     gpio_num_t ac_relay_gpio;
     bool aux_relay : 1;
     gpio_num_t aux_relay_gpio;
@@ -210,4 +217,11 @@ extern board_config_t board_config;
 
 void board_config_load();
 
+/**
+ * @brief Get number of connectors, each with own pilot and ac relay
+ *
+ * @return uint8_t
+ */
+uint8_t board_config_get_connector_count(void);
+
 #endif /* BOARD_CONFIG_H_ */
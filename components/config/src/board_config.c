@@ -117,6 +117,10 @@ void board_config_load()
                     SET_CONFIG_VALUE("PROXIMITY_DOWN_THRESHOLD_13", proximity_down_threshold_13, atoi);
                     SET_CONFIG_VALUE("PROXIMITY_DOWN_THRESHOLD_20", proximity_down_threshold_20, atoi);
                     SET_CONFIG_VALUE("PROXIMITY_DOWN_THRESHOLD_32", proximity_down_threshold_32, atoi);
+                    SET_CONFIG_VALUE("CONNECTOR_2", connector_2, atob);
+                    SET_CONFIG_VALUE("CONNECTOR_2_PILOT_PWM_GPIO", connector_2_pilot_pwm_gpio, atoi);
+                    SET_CONFIG_VALUE("CONNECTOR_2_PILOT_ADC_CHANNEL", connector_2_pilot_adc_channel, atoi);
+                    SET_CONFIG_VALUE("CONNECTOR_2_AC_RELAY_GPIO", connector_2_ac_relay_gpio, atoi);
                     SET_CONFIG_VALUE("AC_RELAY_GPIO", ac_relay_gpio, atoi);
                     SET_CONFIG_VALUE("AUX_RELAY", aux_relay, atob);
                     SET_CONFIG_VALUE("AUX_RELAY_GPIO", aux_relay_gpio, atoi);
@@ -255,3 +259,8 @@ void board_config_load()
 
     fclose(file);
 }
+
+uint8_t board_config_get_connector_count(void)
+{
+    return board_config.connector_2 ? 2 : 1;
+}
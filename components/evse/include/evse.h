@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "esp_err.h"
+#include "pilot.h"
 
 #define evse_state_is_session(state)        (state >= EVSE_STATE_B1 && state <= EVSE_STATE_D2)
 #define evse_state_is_charging(state)       (state == EVSE_STATE_C2 || state == EVSE_STATE_D2)
@@ -19,6 +20,16 @@
 
 #define EVSE_ERR_AUTO_CLEAR_BITS            (EVSE_ERR_PILOT_FAULT_BIT | EVSE_ERR_DIODE_SHORT_BIT | EVSE_ERR_RCM_TRIGGERED_BIT | EVSE_ERR_RCM_SELFTEST_FAULT_BIT)
 
+#define EVSE_EVENT_STATE_BIT                (1UL << 0)
+#define EVSE_EVENT_ERROR_BIT                (1UL << 1)
+#define EVSE_EVENT_ENABLED_BIT              (1UL << 2)
+#define EVSE_EVENT_AVAILABLE_BIT            (1UL << 3)
+#define EVSE_EVENT_AUTH_BIT                 (1UL << 4)
+#define EVSE_EVENT_LIMIT_BIT                (1UL << 5)
+#define EVSE_EVENT_CURRENT_BIT              (1UL << 6)
+
+#define EVSE_EVENT_ALL_BITS                 (EVSE_EVENT_STATE_BIT | EVSE_EVENT_ERROR_BIT | EVSE_EVENT_ENABLED_BIT | EVSE_EVENT_AVAILABLE_BIT | EVSE_EVENT_AUTH_BIT | EVSE_EVENT_LIMIT_BIT | EVSE_EVENT_CURRENT_BIT)
+
 /**
  * @brief States of evse controller
  *
@@ -36,6 +47,100 @@ typedef enum
     EVSE_STATE_F
 } evse_state_t;
 
+#define EVSE_LATENCY_BUCKETS                24  // bucket n counts latencies from 2^n us to 2^(n+1)-1 us
+
+#define EVSE_COMMAND_WAIT_MS                200 // timeout of protocol write paths waiting for their commands
+
+/**
+ * @brief Measured latencies of evse task
+ *
+ */
+typedef enum
+{
+    EVSE_LATENCY_COMMAND,           // setter called to command applied by evse task
+    EVSE_LATENCY_PILOT_RELAY,       // last pilot measurement of previous voltage to ac relay switched, upper bound of pilot change latency
+    EVSE_LATENCY_DISABLE_PILOT,     // disable or unavailable setter called to pilot left PWM
+    EVSE_LATENCY_COUNT
+} evse_latency_t;
+
+/**
+ * @brief Coherent snapshot of evse and energy meter state, published once per evse_process iteration
+ *
+ */
+typedef struct
+{
+    uint32_t version;
+    evse_state_t state;
+    uint32_t error;
+    bool enabled;
+    bool available;
+    bool pending_auth;
+    bool limit_reached;
+    uint16_t charging_current;      // A*10
+    uint32_t consumption_limit;     // Wh
+    uint32_t charging_time_limit;   // s, rounded up
+    uint16_t under_power_limit;     // W
+    uint16_t power;                 // W
+    uint32_t session_time;          // s
+    uint32_t charging_time;         // s
+    uint32_t consumption;           // Wh
+    uint64_t consumption_mwh;       // mWh
+    uint64_t total_consumption;     // mWh, lifetime
+    uint16_t apparent_power;        // VA
+    float power_factor;
+    float voltage[3];               // V
+    float current[3];               // A
+    float phase_power[3];           // W, active
+    float frequency;                // Hz
+} evse_snapshot_t;
+
+/**
+ * @brief Execution statistics of evse task loops
+ *
+ */
+typedef struct
+{
+    uint32_t iterations;
+    uint32_t iterations_per_sec;
+    uint32_t last_time;     // us
+    uint32_t max_time;      // us
+    int32_t last_jitter;    // us
+    uint32_t max_jitter;    // us
+} evse_loop_stats_t;
+
+/**
+ * @brief Counter of evse transition table entry
+ *
+ */
+typedef struct
+{
+    evse_state_t next_state;    // EVSE_STATE_E is pilot fault
+    uint32_t count;
+    uint32_t last_time;         // s since boot
+} evse_transition_stats_t;
+
+/**
+ * @brief Latency histogram of evse task
+ *
+ */
+typedef struct
+{
+    uint32_t count;
+    uint32_t p50;       // us
+    uint32_t p99;       // us
+    uint32_t max;       // us
+    uint32_t buckets[EVSE_LATENCY_BUCKETS];
+} evse_latency_stats_t;
+
+/**
+ * @brief Handler of evse state change events
+ *
+ * @param connector index of connector whose snapshot changed
+ * @param events changed EVSE_EVENT_*_BIT, filtered by subscribed mask
+ * @param arg
+ */
+typedef void (*evse_event_handler_t)(uint8_t connector, uint32_t events, void* arg);
+
 /**
  * @brief Initialize evse
  *
@@ -46,8 +151,9 @@ void evse_init(void);
  * @brief Set evse controller to available state or F
  *
  * @param available
+ * @return esp_err_t ESP_ERR_NO_MEM when command queue is full
  */
-void evse_set_available(bool available);
+esp_err_t evse_set_available(bool available);
 
 /**
  * @brief Return true if evse controller is available
@@ -58,11 +164,148 @@ void evse_set_available(bool available);
 bool evse_is_available(void);
 
 /**
- * @brief Main loop of evse
+ * @brief Safety and pilot loop of evse, executed by evse task
  *
  */
 void evse_process(void);
 
+/**
+ * @brief Wake evse task to process immediately, can be called from ISR
+ *
+ */
+void evse_notify_from_isr(void);
+
+/**
+ * @brief Get execution statistics of safety and pilot loop
+ *
+ * @param stats
+ */
+void evse_get_process_stats(evse_loop_stats_t* stats);
+
+/**
+ * @brief Get execution statistics of metering loop
+ *
+ * @param stats
+ */
+void evse_get_meter_stats(evse_loop_stats_t* stats);
+
+/**
+ * @brief Get counter of transition table entry, counted when entry changes state.
+ * State changes of errors, availability and limits are not driven by table and not counted
+ *
+ * @param state EVSE_STATE_A to EVSE_STATE_D2
+ * @param pilot_voltage
+ * @param can_charging
+ * @param stats
+ * @return esp_err_t ESP_ERR_INVALID_ARG when state or pilot_voltage is out of table
+ */
+esp_err_t evse_get_transition_stats(evse_state_t state, pilot_voltage_t pilot_voltage, bool can_charging, evse_transition_stats_t* stats);
+
+/**
+ * @brief Get latency histogram, percentiles are upper bounds of histogram buckets
+ *
+ * @param latency
+ * @param stats
+ */
+void evse_get_latency_stats(evse_latency_t latency, evse_latency_stats_t* stats);
+
+/**
+ * @brief Reset execution statistics of all loops, state transition counters and latency histograms
+ *
+ */
+void evse_reset_stats(void);
+
+/**
+ * @brief Subscribe to evse state change events
+ *
+ * Handler is called from evse task after snapshot with changes was published, must be short and not blocking,
+ * e.g. notify own task
+ *
+ * @param mask EVSE_EVENT_*_BIT
+ * @param handler
+ * @param arg passed to handler
+ * @return esp_err_t
+ */
+esp_err_t evse_subscribe(uint32_t mask, evse_event_handler_t handler, void* arg);
+
+/**
+ * @brief Wait until commands posted by setters from calling task are applied by evse task
+ *
+ * Setters of charging current, enabled, available, authorize and session limits are queued and return immediately,
+ * getters reflect the new value after evse task processed it. Call only where value is read back right after setting it,
+ * returns immediately when calling task has no pending commands
+ *
+ * @param timeout_ms
+ * @return esp_err_t ESP_ERR_TIMEOUT when not applied in time
+ */
+esp_err_t evse_wait_commands(uint32_t timeout_ms);
+
+/**
+ * @brief Get last published snapshot of evse and energy meter state, lock-free, without waiting to evse_process
+ *
+ * @param snapshot
+ */
+void evse_get_snapshot(evse_snapshot_t* snapshot);
+
+/**
+ * @brief Get number of connectors driven by evse, functions without connector parameter address first connector
+ *
+ * @return uint8_t
+ */
+uint8_t evse_get_connector_count(void);
+
+/**
+ * @brief Get last published snapshot of connector, energy meter values are only in snapshot of first connector
+ *
+ * @param connector
+ * @param snapshot
+ * @return esp_err_t ESP_ERR_INVALID_ARG when connector not exists
+ */
+esp_err_t evse_connector_get_snapshot(uint8_t connector, evse_snapshot_t* snapshot);
+
+/**
+ * @brief Get current offered to vehicle on connector by generated pilot pwm duty
+ *
+ * @param connector
+ * @return uint16_t A*10, 0 when connector not exists
+ */
+uint16_t evse_connector_get_offered_current(uint8_t connector);
+
+/**
+ * @brief Set charging current of connector
+ *
+ * @param connector
+ * @param charging_current A*10
+ * @return esp_err_t ESP_ERR_INVALID_ARG when out of range, ESP_ERR_NO_MEM when command queue is full
+ */
+esp_err_t evse_connector_set_charging_current(uint8_t connector, uint16_t charging_current);
+
+/**
+ * @brief Set enabled charging of connector
+ *
+ * @param connector
+ * @param enabled
+ * @return esp_err_t ESP_ERR_INVALID_ARG when out of range, ESP_ERR_NO_MEM when command queue is full
+ */
+esp_err_t evse_connector_set_enabled(uint8_t connector, bool enabled);
+
+/**
+ * @brief Set connector to available state or F
+ *
+ * @param connector
+ * @param available
+ * @return esp_err_t ESP_ERR_INVALID_ARG when out of range, ESP_ERR_NO_MEM when command queue is full
+ */
+esp_err_t evse_connector_set_available(uint8_t connector, bool available);
+
+/**
+ * @brief Authorize to start charging on connector when authorization is required
+ *
+ * @param connector
+ * @return esp_err_t ESP_ERR_INVALID_ARG when out of range, ESP_ERR_NO_MEM when command queue is full
+ */
+esp_err_t evse_connector_authorize(uint8_t connector);
+
 /**
  * @brief Return current evse state
  *
@@ -126,10 +369,17 @@ uint16_t evse_get_charging_current(void);
  * @brief Set charging current
  *
  * @param charging_current current in A*10
- * @return esp_err_t
+ * @return esp_err_t ESP_ERR_INVALID_ARG when out of range, ESP_ERR_NO_MEM when command queue is full
  */
 esp_err_t evse_set_charging_current(uint16_t charging_current);
 
+/**
+ * @brief Get current offered to vehicle by generated pilot pwm duty, may differ from charging current by duty resolution
+ *
+ * @return current in A*10, 0 when pilot is not pwm
+ */
+uint16_t evse_get_offered_current(void);
+
 /**
  * @brief Get default charging current, stored in NVS
  *
@@ -163,8 +413,9 @@ void evse_set_require_auth(bool require_auth);
 /**
  * @brief Authorize to start charging when authorization is required
  *
+ * @return esp_err_t ESP_ERR_NO_MEM when command queue is full
  */
-void evse_authorize(void);
+esp_err_t evse_authorize(void);
 
 /**
  * @brief Check when is pending authorize to start charging
@@ -186,8 +437,9 @@ bool evse_is_enabled(void);
  * @brief Set enabled charging
  *
  * @param enabled
+ * @return esp_err_t ESP_ERR_NO_MEM when command queue is full
  */
-void evse_set_enabled(bool enabled);
+esp_err_t evse_set_enabled(bool enabled);
 
 /**
  * @brief Is session consumption, charging time or under power limit reached
@@ -253,25 +505,42 @@ esp_err_t evse_set_temp_threshold(uint8_t temp_threshold);
 uint8_t evse_get_temp_threshold(void);
 
 /**
- * @brief Set consumption limit
+ * @brief Set consumption limit, charging stops when session consumption reaches it
  *
- * @param consumption_limit Consumption in Ws
+ * @param consumption_limit Consumption in Wh
+ * @return esp_err_t ESP_ERR_NO_MEM when command queue is full
  */
-void evse_set_consumption_limit(uint32_t consumption_limit);
+esp_err_t evse_set_consumption_limit(uint32_t consumption_limit);
 
 /**
  * @brief Get charging time limit
  *
- * @return Time in s
+ * @return Time in s, rounded up
  */
 uint32_t evse_get_charging_time_limit(void);
 
 /**
- * @brief Set charging time limit
+ * @brief Set charging time limit, charging stops when session charging time in ms reaches it
  *
  * @param charging_time_limit Time in s
+ * @return esp_err_t ESP_ERR_NO_MEM when command queue is full
+ */
+esp_err_t evse_set_charging_time_limit(uint32_t charging_time_limit);
+
+/**
+ * @brief Get charging time limit
+ *
+ * @return Time in ms
+ */
+uint32_t evse_get_charging_time_limit_ms(void);
+
+/**
+ * @brief Set charging time limit in ms resolution, charging stops when session charging time in ms reaches it
+ *
+ * @param charging_time_limit Time in ms
+ * @return esp_err_t ESP_ERR_NO_MEM when command queue is full
  */
-void evse_set_charging_time_limit(uint32_t charging_time_limit);
+esp_err_t evse_set_charging_time_limit_ms(uint32_t charging_time_limit);
 
 /**
  * @brief Get under power limit
@@ -284,8 +553,9 @@ uint16_t evse_get_under_power_limit(void);
  * @brief Set under power limit
  *
  * @param under_power_limit power in W
+ * @return esp_err_t ESP_ERR_NO_MEM when command queue is full
  */
-void evse_set_under_power_limit(uint16_t under_power_limit);
+esp_err_t evse_set_under_power_limit(uint16_t under_power_limit);
 
 /**
  * @brief Get consumption limit, stored in NVS
@@ -1,10 +1,15 @@
 #include <sys/param.h>
+#include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs.h"
 
 #include "evse.h"
@@ -26,6 +31,17 @@
 #define C1_D1_AC_RELAY_WAIT_TIME        6000    // 6sec
 #define TEMP_THRESHOLD_MIN              40
 #define TEMP_THRESHOLD_MAX              80
+#define PROCESS_PERIOD                  50      // 50ms
+#define PROCESS_IDLE_PERIOD             200     // 200ms
+#define METER_PERIOD                    100     // 100ms
+
+#define COMMAND_QUEUE_SIZE              16
+#define COMMAND_POSTERS                 8       // tasks tracked for waiting to own commands, least recent is replaced
+#define MAX_SUBSCRIBERS                 8
+
+#define PROCESS_BIT                     BIT0
+
+#define COMMAND_DONE_BITS               ((1 << COMMAND_POSTERS) - 1) // bit per poster, cleared by its waiting task
 
 #define NVS_NAMESPACE                   "evse"
 #define NVS_MAX_CHARGING_CURRENT        "max_chrg_curr"
@@ -46,135 +62,334 @@ static const char* TAG = "evse";
 
 static nvs_handle nvs;
 
-static SemaphoreHandle_t mutex;
+static TaskHandle_t evse_task;
 
-static evse_state_t state = EVSE_STATE_A;   // not hold error state
+static TaskHandle_t meter_task;
 
-static uint32_t error = 0;
+static bool socket_outlet = false;
 
-static bool error_cleared = false;
+static bool rcm = false;
 
-static uint16_t charging_current;
+static uint8_t temp_threshold = 60;
 
-static uint32_t consumption_limit = 0;
+static bool require_auth = false;
 
-static uint32_t charging_time_limit = 0;
+static uint8_t max_charging_current = 32;
+
+static uint8_t connector_count = 1;
 
-static uint16_t under_power_limit = 0;
+enum pilot_state_e {
+    PILOT_STATE_12V,
+    PILOT_STATE_N12V,
+    PILOT_STATE_PWM
+};
 
-static uint8_t reached_limit = 0;
+typedef struct
+{
+    uint8_t index;
+    evse_state_t state;             // not hold error state
+    uint32_t error;
+    bool error_cleared;
+    uint16_t charging_current;
+    uint32_t consumption_limit;
+    uint32_t charging_time_limit;   // ms
+    uint16_t under_power_limit;
+    uint8_t reached_limit;
+    bool rcm_selftest;
+    bool enabled;
+    bool available;
+    bool authorized;
+    TickType_t auth_grant_to;
+    TickType_t error_wait_to;
+    TickType_t under_power_wait_to;
+    TickType_t c1_d1_ac_relay_wait_to;
+    uint8_t cable_max_current;
+    enum pilot_state_e pilot_state;
+    bool socket_lock_locked;
+    evse_state_t prev_state;
+    evse_snapshot_t snapshot;
+    uint32_t snapshot_seq;
+    portMUX_TYPE snapshot_spinlock;
+    evse_transition_stats_t transition_stats[EVSE_STATE_D2 + 1][PILOT_VOLTAGE_1 + 1][2];
+    pilot_voltage_t prev_pilot_voltage;
+    int64_t pilot_measure_time;     // end of last pilot measurement
+    int64_t pilot_change_time;
+    bool ac_relay_state;
+    int64_t disable_command_time;
+    esp_timer_handle_t limit_timer;
+} evse_t;
+
+// socket lock, proximity and energy meter are single instance, they serve first connector
+static evse_t connectors[BOARD_CONFIG_CONNECTORS_MAX] = {
+    [0 ... BOARD_CONFIG_CONNECTORS_MAX - 1] = {
+        .state = EVSE_STATE_A,
+        .enabled = true,
+        .available = true,
+        .cable_max_current = 63,
+        .pilot_state = PILOT_STATE_12V,
+        .prev_state = EVSE_STATE_A,
+        .snapshot_spinlock = portMUX_INITIALIZER_UNLOCKED,
+        .prev_pilot_voltage = PILOT_VOLTAGE_12
+    }
+};
 
-static bool socket_outlet = false;
+struct loop_stats_s
+{
+    evse_loop_stats_t stats;
+    uint32_t sec_iterations;
+    int64_t sec_start;
+    int64_t prev_periodic_start;
+};
 
-static bool rcm = false;
+static struct loop_stats_s process_stats = { 0 };
 
-static bool rcm_selftest = false;
+static struct loop_stats_s meter_stats = { 0 };
 
-static uint8_t temp_threshold = 60;
+struct latency_histogram_s
+{
+    uint32_t buckets[EVSE_LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+};
 
-static bool enabled = true;
+static struct latency_histogram_s latency_histograms[EVSE_LATENCY_COUNT] = { 0 };
 
-static bool available = true;
+enum command_type_e {
+    COMMAND_SET_CHARGING_CURRENT,
+    COMMAND_SET_ENABLED,
+    COMMAND_SET_AVAILABLE,
+    COMMAND_AUTHORIZE,
+    COMMAND_SET_CONSUMPTION_LIMIT,
+    COMMAND_SET_CHARGING_TIME_LIMIT,
+    COMMAND_SET_UNDER_POWER_LIMIT
+};
 
-static bool require_auth = false;
+struct command_s
+{
+    uint8_t connector;
+    enum command_type_e type;
+    uint32_t value;
+    uint32_t ticket;
+    int64_t time;
+};
 
-static bool authorized = false;
+static QueueHandle_t command_queue;
 
-static TickType_t auth_grant_to = 0;
+static SemaphoreHandle_t command_post_mutex;
 
-static TickType_t error_wait_to = 0;
+static EventGroupHandle_t command_event_group;
 
-static TickType_t under_power_start_time = 0;
+static uint32_t command_posted_ticket = 0;
 
-static TickType_t c1_d1_ac_relay_wait_to = 0;
+static uint32_t command_done_ticket = 0;
 
-static uint8_t max_charging_current = 32;
+struct command_poster_s
+{
+    TaskHandle_t task;
+    uint32_t ticket;
+};
 
-static uint8_t cable_max_current = 63;
+// guarded by command_post_mutex
+static struct command_poster_s command_posters[COMMAND_POSTERS];
 
-enum pilot_state_e {
-    PILOT_STATE_12V,
-    PILOT_STATE_N12V,
-    PILOT_STATE_PWM
+static uint8_t command_poster_next = 0;
+
+struct subscriber_s
+{
+    uint32_t mask;
+    evse_event_handler_t handler;
+    void* arg;
 };
 
-static enum pilot_state_e pilot_state = PILOT_STATE_12V;
+static struct subscriber_s subscribers[MAX_SUBSCRIBERS];
+
+static uint8_t subscriber_count = 0;
+
+static portMUX_TYPE subscriber_spinlock = portMUX_INITIALIZER_UNLOCKED;
 
-static bool socket_lock_locked = false;
+static void record_latency(evse_latency_t latency, int64_t start)
+{
+    struct latency_histogram_s* histogram = &latency_histograms[latency];
+    uint32_t time = esp_timer_get_time() - start;
+    uint8_t bucket = time > 0 ? MIN(31 - __builtin_clz(time), EVSE_LATENCY_BUCKETS - 1) : 0;
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    if (time > histogram->max) {
+        histogram->max = time;
+    }
+}
+
+static void notify_process(void)
+{
+    if (evse_task) {
+        xTaskNotify(evse_task, PROCESS_BIT, eSetBits);
+    }
+}
 
-static evse_state_t prev_state = EVSE_STATE_A;
+// command_post_mutex must be held
+static uint8_t get_command_poster(TaskHandle_t task)
+{
+    for (uint8_t i = 0; i < COMMAND_POSTERS; i++) {
+        if (command_posters[i].task == task) {
+            return i;
+        }
+    }
+
+    uint8_t index = command_poster_next;
+    command_poster_next = (command_poster_next + 1) % COMMAND_POSTERS;
+    command_posters[index].task = task;
+    // commands of replaced task are not known, wait for all posted
+    command_posters[index].ticket = command_posted_ticket;
+
+    return index;
+}
 
-static void set_error_bits(uint32_t bits)
+static esp_err_t post_command(uint8_t connector, enum command_type_e type, uint32_t value)
 {
-    error |= bits;
+    esp_err_t ret = ESP_OK;
+    struct command_s command = {
+        .connector = connector,
+        .type = type,
+        .value = value,
+        .time = esp_timer_get_time()
+    };
+
+    // held only to keep tickets in queue order, never across evse_process
+    xSemaphoreTake(command_post_mutex, portMAX_DELAY);
+    command.ticket = command_posted_ticket + 1;
+    if (xQueueSend(command_queue, &command, 0) == pdTRUE) {
+        __atomic_store_n(&command_posted_ticket, command.ticket, __ATOMIC_RELEASE);
+        command_posters[get_command_poster(xTaskGetCurrentTaskHandle())].ticket = command.ticket;
+    } else {
+        ESP_LOGE(TAG, "Command queue full, command %d dropped", type);
+        ret = ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(command_post_mutex);
+
+    notify_process();
+
+    return ret;
+}
+
+static evse_state_t get_state(evse_t* evse)
+{
+    return evse->error ? EVSE_STATE_E : evse->state;
+}
+
+static bool is_pending_auth(evse_t* evse)
+{
+    return evse_state_is_session(evse->state) && !evse->authorized;
+}
+
+static bool is_socket_locked(evse_t* evse)
+{
+    return evse->index == 0 && board_config.socket_lock && socket_outlet;
+}
+
+// deadline 0 is not set, compared by difference to survive tick count wrap
+static TickType_t get_deadline(TickType_t timeout)
+{
+    TickType_t deadline = xTaskGetTickCount() + timeout;
+    return deadline != 0 ? deadline : 1;
+}
+
+static bool is_deadline_passed(TickType_t deadline)
+{
+    return deadline != 0 && (int32_t)(xTaskGetTickCount() - deadline) >= 0;
+}
+
+static void set_error_bits(evse_t* evse, uint32_t bits)
+{
+    if (evse->index == 0 && bits & ~evse->error & (EVSE_ERR_PILOT_FAULT_BIT | EVSE_ERR_DIODE_SHORT_BIT)) {
+        pilot_capture_trigger();
+    }
+    evse->error |= bits;
     if (bits & EVSE_ERR_AUTO_CLEAR_BITS) {
-        error_wait_to = xTaskGetTickCount() + pdMS_TO_TICKS(ERROR_WAIT_TIME);
+        evse->error_wait_to = get_deadline(pdMS_TO_TICKS(ERROR_WAIT_TIME));
     }
 }
 
-static void clear_error_bits(uint32_t bits)
+static void clear_error_bits(evse_t* evse, uint32_t bits)
 {
-    bool has_error = error != 0;
-    error &= ~bits;
+    bool has_error = evse->error != 0;
+    evse->error &= ~bits;
 
-    error_cleared |= has_error && error == 0;
+    evse->error_cleared |= has_error && evse->error == 0;
 }
 
-static void set_pilot(enum pilot_state_e state)
+static void set_pilot(evse_t* evse, enum pilot_state_e pilot_state)
 {
-    if (pilot_state != state) {
-        pilot_state = state;
-        switch (pilot_state)
+    if (evse->pilot_state != pilot_state) {
+        evse->pilot_state = pilot_state;
+        if (evse->pilot_state != PILOT_STATE_PWM && evse->disable_command_time > 0) {
+            record_latency(EVSE_LATENCY_DISABLE_PILOT, evse->disable_command_time);
+            evse->disable_command_time = 0;
+        }
+        switch (evse->pilot_state)
         {
         case PILOT_STATE_12V:
-            pilot_set_level(true);
+            pilot_set_level(evse->index, true);
             break;
         case PILOT_STATE_N12V:
-            pilot_set_level(false);
+            pilot_set_level(evse->index, false);
             break;
         case PILOT_STATE_PWM:
-            pilot_set_amps(MIN(charging_current, cable_max_current * 10));
+            pilot_set_amps(evse->index, MIN(evse->charging_current, evse->cable_max_current * 10));
             break;
         }
     }
 }
 
-static void set_socket_lock(bool locked)
+static void set_ac_relay(evse_t* evse, bool ac_relay_state)
 {
-    if (error & (EVSE_ERR_LOCK_FAULT_BIT | EVSE_ERR_UNLOCK_FAULT_BIT)) {
+    ac_relay_set_state(evse->index, ac_relay_state);
+
+    if (evse->ac_relay_state != ac_relay_state) {
+        evse->ac_relay_state = ac_relay_state;
+        if (evse->pilot_change_time > 0) {
+            record_latency(EVSE_LATENCY_PILOT_RELAY, evse->pilot_change_time);
+            evse->pilot_change_time = 0;
+        }
+    }
+}
+
+static void set_socket_lock(evse_t* evse, bool locked)
+{
+    if (evse->error & (EVSE_ERR_LOCK_FAULT_BIT | EVSE_ERR_UNLOCK_FAULT_BIT)) {
         return;
     }
-    if (socket_lock_locked != locked) {
-        socket_lock_locked = locked;
-        socket_lock_set_locked(socket_lock_locked);
+    if (evse->socket_lock_locked != locked) {
+        evse->socket_lock_locked = locked;
+        socket_lock_set_locked(evse->socket_lock_locked);
     }
 }
 
-static void perform_rcm_selftest(void)
+static void perform_rcm_selftest(evse_t* evse)
 {
-    if (!rcm_selftest) {
+    if (!evse->rcm_selftest) {
         if(board_config.rcm_test) {
             if (!rcm_test()) {
                 ESP_LOGE(TAG, "Residual current monitor self test fail");
-                set_error_bits(EVSE_ERR_RCM_SELFTEST_FAULT_BIT);
+                set_error_bits(evse, EVSE_ERR_RCM_SELFTEST_FAULT_BIT);
             } else {
                 ESP_LOGI(TAG, "Residual current monitor self test success");
             }
         } else {
             ESP_LOGW(TAG, "Residual current monitor self test disabled even RCM present");
         }
-        rcm_selftest = true;
+        evse->rcm_selftest = true;
     }
 }
 
-static void apply_state(void)
+static void apply_state(evse_t* evse)
 {
-    evse_state_t new_state = evse_get_state(); // getter method detect error state
+    evse_state_t new_state = get_state(evse); // getter method detect error state
 
-    if (prev_state != new_state) {
+    if (evse->prev_state != new_state) {
         ESP_LOGI(TAG, "Enter %s state", evse_state_to_str(new_state));
-        if (error) {
-            ESP_LOGI(TAG, "Error bits %"PRIu32"", error);
+        if (evse->error) {
+            ESP_LOGI(TAG, "Error bits %"PRIu32"", evse->error);
         }
 
         switch (new_state)
@@ -182,106 +397,436 @@ static void apply_state(void)
         case EVSE_STATE_A:
         case EVSE_STATE_E:
         case EVSE_STATE_F:
-            ac_relay_set_state(false);
-            set_pilot(new_state == EVSE_STATE_A ? PILOT_STATE_12V : PILOT_STATE_N12V);
+            set_ac_relay(evse, false);
+            set_pilot(evse, new_state == EVSE_STATE_A ? PILOT_STATE_12V : PILOT_STATE_N12V);
 
-            if (board_config.socket_lock && socket_outlet) {
-                set_socket_lock(false);
+            if (is_socket_locked(evse)) {
+                set_socket_lock(evse, false);
+            }
+            evse->authorized = false;
+            evse->reached_limit = 0;
+            evse->under_power_wait_to = 0;
+            evse->rcm_selftest = false;
+            evse->c1_d1_ac_relay_wait_to = 0;
+            if (evse->index == 0) {
+                energy_meter_stop_session();
             }
-            authorized = false;
-            reached_limit = 0;
-            under_power_start_time = 0;
-            rcm_selftest = false;
-            c1_d1_ac_relay_wait_to = 0;
-            energy_meter_stop_session();
             break;
         case EVSE_STATE_B1:
-            set_pilot(PILOT_STATE_12V);
-            ac_relay_set_state(false);
+            set_pilot(evse, PILOT_STATE_12V);
+            set_ac_relay(evse, false);
 
-            c1_d1_ac_relay_wait_to = 0;
-            if (board_config.socket_lock && socket_outlet) {
-                set_socket_lock(true);
+            evse->c1_d1_ac_relay_wait_to = 0;
+            if (is_socket_locked(evse)) {
+                set_socket_lock(evse, true);
             }
             if (rcm) {
-                perform_rcm_selftest();
+                perform_rcm_selftest(evse);
             }
-            if (socket_outlet) {
-                cable_max_current = proximity_get_max_current();
+            if (evse->index == 0) {
+                if (socket_outlet) {
+                    evse->cable_max_current = proximity_get_max_current();
+                }
+                energy_meter_start_session();
             }
-            energy_meter_start_session();
             break;
         case EVSE_STATE_B2:
-            set_pilot(PILOT_STATE_PWM);
-            ac_relay_set_state(false);
+            set_pilot(evse, PILOT_STATE_PWM);
+            set_ac_relay(evse, false);
             break;
         case EVSE_STATE_C1:
         case EVSE_STATE_D1:
-            set_pilot(PILOT_STATE_12V);
-            c1_d1_ac_relay_wait_to = xTaskGetTickCount() + pdMS_TO_TICKS(C1_D1_AC_RELAY_WAIT_TIME);
+            set_pilot(evse, PILOT_STATE_12V);
+            evse->c1_d1_ac_relay_wait_to = get_deadline(pdMS_TO_TICKS(C1_D1_AC_RELAY_WAIT_TIME));
             break;
         case EVSE_STATE_C2:
         case EVSE_STATE_D2:
-            set_pilot(PILOT_STATE_PWM);
-            ac_relay_set_state(true);
+            set_pilot(evse, PILOT_STATE_PWM);
+            set_ac_relay(evse, true);
             break;
         }
 
-        prev_state = new_state;
+        evse->prev_state = new_state;
     }
 }
 
-static bool can_charging(void)
+// next state by [state][pilot voltage][can charging], EVSE_STATE_E is pilot fault
+static const evse_state_t transitions[EVSE_STATE_D2 + 1][PILOT_VOLTAGE_1 + 1][2] = {
+    [EVSE_STATE_A] = {
+        [PILOT_VOLTAGE_12]  = { EVSE_STATE_A, EVSE_STATE_A },
+        [PILOT_VOLTAGE_9]   = { EVSE_STATE_B1, EVSE_STATE_B1 },
+        [PILOT_VOLTAGE_6]   = { EVSE_STATE_E, EVSE_STATE_E },
+        [PILOT_VOLTAGE_3]   = { EVSE_STATE_E, EVSE_STATE_E },
+        [PILOT_VOLTAGE_1]   = { EVSE_STATE_E, EVSE_STATE_E }
+    },
+    [EVSE_STATE_B1 ... EVSE_STATE_B2] = {
+        [PILOT_VOLTAGE_12]  = { EVSE_STATE_A, EVSE_STATE_A },
+        [PILOT_VOLTAGE_9]   = { EVSE_STATE_B1, EVSE_STATE_B2 },
+        [PILOT_VOLTAGE_6]   = { EVSE_STATE_C1, EVSE_STATE_C2 },
+        [PILOT_VOLTAGE_3]   = { EVSE_STATE_E, EVSE_STATE_E },
+        [PILOT_VOLTAGE_1]   = { EVSE_STATE_E, EVSE_STATE_E }
+    },
+    [EVSE_STATE_C1 ... EVSE_STATE_C2] = {
+        [PILOT_VOLTAGE_12]  = { EVSE_STATE_A, EVSE_STATE_A },
+        [PILOT_VOLTAGE_9]   = { EVSE_STATE_B1, EVSE_STATE_B2 },
+        [PILOT_VOLTAGE_6]   = { EVSE_STATE_C1, EVSE_STATE_C2 },
+        [PILOT_VOLTAGE_3]   = { EVSE_STATE_D1, EVSE_STATE_D2 },
+        [PILOT_VOLTAGE_1]   = { EVSE_STATE_E, EVSE_STATE_E }
+    },
+    [EVSE_STATE_D1 ... EVSE_STATE_D2] = {
+        [PILOT_VOLTAGE_12]  = { EVSE_STATE_E, EVSE_STATE_E },
+        [PILOT_VOLTAGE_9]   = { EVSE_STATE_E, EVSE_STATE_E },
+        [PILOT_VOLTAGE_6]   = { EVSE_STATE_C1, EVSE_STATE_C2 },
+        [PILOT_VOLTAGE_3]   = { EVSE_STATE_D1, EVSE_STATE_D2 },
+        [PILOT_VOLTAGE_1]   = { EVSE_STATE_E, EVSE_STATE_E }
+    }
+};
+
+static bool can_charging(evse_t* evse)
 {
-    if (!enabled) {
+    if (!evse->enabled) {
         return false;
     }
 
-    if (!available) {
+    if (!evse->available) {
         return false;
     }
 
-    if (!authorized) {
+    if (!evse->authorized) {
         return false;
     }
 
-    if (reached_limit != 0) {
+    if (evse->reached_limit != 0) {
         return false;
     }
 
-    if (socket_outlet && board_config.socket_lock && socket_lock_get_status() != SOCKED_LOCK_STATUS_IDLE) {
+    if (is_socket_locked(evse) && socket_lock_get_status() != SOCKED_LOCK_STATUS_IDLE) {
         return false;
     }
 
     return true;
 }
 
-void evse_process(void)
+static void apply_command(evse_t* evse, const struct command_s* command)
 {
-    xSemaphoreTake(mutex, portMAX_DELAY);
+    switch (command->type)
+    {
+    case COMMAND_SET_CHARGING_CURRENT:
+        evse->charging_current = command->value;
+        if (evse->pilot_state == PILOT_STATE_PWM) {
+            pilot_set_amps(evse->index, MIN(evse->charging_current, evse->cable_max_current * 10));
+        }
+        break;
+    case COMMAND_SET_ENABLED:
+        evse->enabled = command->value;
+        if (!evse->enabled && evse->disable_command_time == 0) {
+            evse->disable_command_time = command->time;
+        }
+        break;
+    case COMMAND_SET_AVAILABLE:
+        evse->available = command->value;
+        if (!evse->available && evse->disable_command_time == 0) {
+            evse->disable_command_time = command->time;
+        }
+        break;
+    case COMMAND_AUTHORIZE:
+        evse->auth_grant_to = get_deadline(pdMS_TO_TICKS(AUTHORIZED_TIME));
+        evse->under_power_wait_to = 0;
+        break;
+    case COMMAND_SET_CONSUMPTION_LIMIT:
+        evse->consumption_limit = command->value;
+        evse->reached_limit &= ~LIMIT_CONSUMPTION_BIT;
+        break;
+    case COMMAND_SET_CHARGING_TIME_LIMIT:
+        evse->charging_time_limit = command->value;
+        evse->reached_limit &= ~LIMIT_CHARGING_TIME_BIT;
+        break;
+    case COMMAND_SET_UNDER_POWER_LIMIT:
+        evse->under_power_limit = command->value;
+        break;
+    }
+}
+
+static void process_commands(void)
+{
+    struct command_s command;
+    bool processed = false;
+
+    while (xQueueReceive(command_queue, &command, 0) == pdTRUE) {
+        apply_command(&connectors[command.connector], &command);
+        record_latency(EVSE_LATENCY_COMMAND, command.time);
+        __atomic_store_n(&command_done_ticket, command.ticket, __ATOMIC_RELEASE);
+        processed = true;
+    }
+
+    if (processed) {
+        xEventGroupSetBits(command_event_group, COMMAND_DONE_BITS);
+    }
+}
+
+static uint32_t get_snapshot_events(const evse_snapshot_t* prev, const evse_snapshot_t* next)
+{
+    uint32_t events = 0;
 
+    if (prev->state != next->state) {
+        events |= EVSE_EVENT_STATE_BIT;
+    }
+    if (prev->error != next->error) {
+        events |= EVSE_EVENT_ERROR_BIT;
+    }
+    if (prev->enabled != next->enabled) {
+        events |= EVSE_EVENT_ENABLED_BIT;
+    }
+    if (prev->available != next->available) {
+        events |= EVSE_EVENT_AVAILABLE_BIT;
+    }
+    if (prev->pending_auth != next->pending_auth) {
+        events |= EVSE_EVENT_AUTH_BIT;
+    }
+    if (prev->limit_reached != next->limit_reached || prev->consumption_limit != next->consumption_limit ||
+            prev->charging_time_limit != next->charging_time_limit || prev->under_power_limit != next->under_power_limit) {
+        events |= EVSE_EVENT_LIMIT_BIT;
+    }
+    if (prev->charging_current != next->charging_current) {
+        events |= EVSE_EVENT_CURRENT_BIT;
+    }
+
+    return events;
+}
+
+static void dispatch_events(uint8_t connector, uint32_t events)
+{
+    uint8_t count = __atomic_load_n(&subscriber_count, __ATOMIC_ACQUIRE);
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (subscribers[i].mask & events) {
+            subscribers[i].handler(connector, subscribers[i].mask & events, subscribers[i].arg);
+        }
+    }
+}
+
+static void get_session_counters(int64_t now, uint64_t* consumption, uint32_t* charging_time)
+{
+    int64_t time;
+    energy_meter_get_session_counters(consumption, charging_time, &time);
+
+    // extrapolate from last metering period, only when counters are updated by charging meter task
+    uint32_t elapsed_ms = (now - time) / 1000;
+    if (now > time && elapsed_ms <= 2 * METER_PERIOD) {
+        *consumption += (uint64_t)energy_meter_get_power() * elapsed_ms / 3600;
+        *charging_time += elapsed_ms;
+    }
+}
+
+static void arm_limit_timer(evse_t* evse, uint64_t consumption, uint32_t charging_time)
+{
+    int64_t timeout = INT64_MAX;    // us
+    uint16_t power = energy_meter_get_power();
+
+    esp_timer_stop(evse->limit_timer);
+
+    if (!evse_state_is_charging(evse->state)) {
+        return;
+    }
+
+    if (evse->consumption_limit > 0) {
+        uint64_t limit = (uint64_t)evse->consumption_limit * 1000;
+        if (consumption >= limit) {
+            // limit lowered below session consumption, process as soon as possible
+            timeout = 0;
+        } else if (power > 0) {
+            timeout = (limit - consumption) * 3600000 / power;
+        }
+    }
+
+    if (evse->charging_time_limit > 0) {
+        timeout = MIN(timeout, ((int64_t)evse->charging_time_limit - charging_time) * 1000);
+    }
+
+    if (timeout < INT64_MAX) {
+        esp_timer_start_once(evse->limit_timer, MAX(timeout, 1000));
+    }
+}
+
+static void limit_timer_callback(void* arg)
+{
+    notify_process();
+}
+
+static void apply_transition(evse_t* evse, pilot_voltage_t pilot_voltage)
+{
+    bool charging = can_charging(evse);
+    evse_state_t next_state = transitions[evse->state][pilot_voltage][charging];
+
+    if (next_state != evse->state) {
+        evse_transition_stats_t* transition = &evse->transition_stats[evse->state][pilot_voltage][charging];
+        transition->count++;
+        transition->last_time = esp_timer_get_time() / 1000000;
+    }
+
+    if (next_state == EVSE_STATE_E) {
+        set_error_bits(evse, EVSE_ERR_PILOT_FAULT_BIT);
+    } else {
+        evse->state = next_state;
+    }
+}
+
+static void publish_snapshot(evse_t* evse)
+{
+    evse_snapshot_t next = { 0 };
+
+    next.version = evse->snapshot.version + 1;
+    next.state = get_state(evse);
+    next.error = evse->error;
+    next.enabled = evse->enabled;
+    next.available = evse->available;
+    next.pending_auth = is_pending_auth(evse);
+    next.limit_reached = evse->reached_limit != 0;
+    next.charging_current = evse->charging_current;
+    next.consumption_limit = evse->consumption_limit;
+    next.charging_time_limit = (evse->charging_time_limit + 999) / 1000;
+    next.under_power_limit = evse->under_power_limit;
+    if (evse->index == 0) {
+        next.power = energy_meter_get_power();
+        next.session_time = energy_meter_get_session_time();
+        next.charging_time = energy_meter_get_charging_time();
+        next.consumption = energy_meter_get_consumption();
+        next.consumption_mwh = energy_meter_get_consumption_mwh();
+        next.total_consumption = energy_meter_get_total_consumption();
+        next.apparent_power = energy_meter_get_apparent_power();
+        next.power_factor = energy_meter_get_power_factor();
+        energy_meter_get_voltage(next.voltage);
+        energy_meter_get_current(next.current);
+        energy_meter_get_active_power(next.phase_power);
+        next.frequency = energy_meter_get_frequency();
+    }
+
+    // writer must not be preempted while sequence is odd, otherwise reader on same core could spin
+    portENTER_CRITICAL(&evse->snapshot_spinlock);
+    uint32_t events = get_snapshot_events(&evse->snapshot, &next);
+    __atomic_store_n(&evse->snapshot_seq, evse->snapshot_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    evse->snapshot = next;
+    __atomic_store_n(&evse->snapshot_seq, evse->snapshot_seq + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&evse->snapshot_spinlock);
+
+    if (events) {
+        dispatch_events(evse->index, events);
+    }
+}
+
+static void update_loop_stats(struct loop_stats_s* loop, int64_t start, int64_t end)
+{
+    uint32_t time = end - start;
+
+    loop->stats.iterations++;
+    loop->stats.last_time = time;
+    if (time > loop->stats.max_time) {
+        loop->stats.max_time = time;
+    }
+
+    loop->sec_iterations++;
+    if (end - loop->sec_start >= 1000000) {
+        loop->stats.iterations_per_sec = loop->sec_iterations;
+        loop->sec_iterations = 0;
+        loop->sec_start = end;
+    }
+}
+
+static void update_loop_jitter(struct loop_stats_s* loop, int64_t start, TickType_t period)
+{
+    if (loop->prev_periodic_start > 0) {
+        int32_t jitter = (start - loop->prev_periodic_start) - (int64_t)pdTICKS_TO_MS(period) * 1000;
+
+        loop->stats.last_jitter = jitter;
+        if (abs(jitter) > loop->stats.max_jitter) {
+            loop->stats.max_jitter = abs(jitter);
+        }
+    }
+    loop->prev_periodic_start = start;
+}
+
+// limits are measured by energy meter, only on first connector
+static void check_limits(evse_t* evse)
+{
+    // check consumption and charging time limit, reached bits are hold until session ends or limit changes
+    uint64_t consumption;
+    uint32_t charging_time;
+    get_session_counters(esp_timer_get_time(), &consumption, &charging_time);
+
+    if (evse->consumption_limit > 0 && consumption >= (uint64_t)evse->consumption_limit * 1000) {
+        evse->reached_limit |= LIMIT_CONSUMPTION_BIT;
+    }
+
+    if (evse->charging_time_limit > 0 && charging_time >= evse->charging_time_limit) {
+        evse->reached_limit |= LIMIT_CHARGING_TIME_BIT;
+    }
+
+    // check under power limit
+    if (evse_state_is_charging(evse->state)) {
+        if (evse->under_power_limit > 0 && energy_meter_get_power() < evse->under_power_limit) {
+            if (evse->under_power_wait_to == 0) {
+                evse->under_power_wait_to = get_deadline(pdMS_TO_TICKS(UNDER_POWER_TIME));
+            }
+        } else {
+            evse->under_power_wait_to = 0;
+        }
+
+        if (is_deadline_passed(evse->under_power_wait_to)) {
+            evse->reached_limit |= LIMIT_UNDER_POWER_BIT;
+        } else {
+            evse->reached_limit &= ~LIMIT_UNDER_POWER_BIT;
+        }
+    }
+
+    if (evse->reached_limit > 0 && evse_state_is_charging(evse->state)) {
+        ESP_LOGI(TAG, "Reached limit %d", evse->reached_limit);
+        if (evse->state == EVSE_STATE_B2) {
+            evse->state = EVSE_STATE_B1;
+        }
+        if (evse->state == EVSE_STATE_C2) {
+            evse->state = EVSE_STATE_C1;
+        }
+        if (evse->state == EVSE_STATE_D2) {
+            evse->state = EVSE_STATE_D1;
+        }
+    }
+
+    arm_limit_timer(evse, consumption, charging_time);
+}
+
+static void process_connector(evse_t* evse)
+{
     pilot_voltage_t pilot_voltage;
     bool pilot_down_voltage_n12;
-    pilot_measure(&pilot_voltage, &pilot_down_voltage_n12);
+    pilot_measure(evse->index, &pilot_voltage, &pilot_down_voltage_n12);
+    int64_t pilot_measure_time = esp_timer_get_time();
+
+    if (pilot_voltage != evse->prev_pilot_voltage) {
+        // voltage changed after previous measurement still seen old voltage
+        evse->pilot_change_time = evse->pilot_measure_time > 0 ? evse->pilot_measure_time : pilot_measure_time;
+        evse->prev_pilot_voltage = pilot_voltage;
+    }
+    evse->pilot_measure_time = pilot_measure_time;
 
-    if (error_wait_to != 0 && xTaskGetTickCount() >= error_wait_to) {
-        clear_error_bits(EVSE_ERR_AUTO_CLEAR_BITS);
-        state = EVSE_STATE_A;
-        error_wait_to = 0;
+    if (is_deadline_passed(evse->error_wait_to)) {
+        clear_error_bits(evse, EVSE_ERR_AUTO_CLEAR_BITS);
+        evse->state = EVSE_STATE_A;
+        evse->error_wait_to = 0;
     }
 
-    if (pilot_state == PILOT_STATE_PWM && !pilot_down_voltage_n12) {
-        set_error_bits(EVSE_ERR_DIODE_SHORT_BIT);
+    if (evse->pilot_state == PILOT_STATE_PWM && !pilot_down_voltage_n12) {
+        set_error_bits(evse, EVSE_ERR_DIODE_SHORT_BIT);
     }
 
-    if (board_config.socket_lock && socket_outlet) {
+    if (is_socket_locked(evse)) {
         switch (socket_lock_get_status())
         {
         case SOCKED_LOCK_STATUS_LOCKING_FAIL:
-            set_error_bits(EVSE_ERR_LOCK_FAULT_BIT);
+            set_error_bits(evse, EVSE_ERR_LOCK_FAULT_BIT);
             break;
         case SOCKED_LOCK_STATUS_UNLOCKING_FAIL:
-            set_error_bits(EVSE_ERR_UNLOCK_FAULT_BIT);
+            set_error_bits(evse, EVSE_ERR_UNLOCK_FAULT_BIT);
             break;
         default:
             break;
@@ -290,243 +835,340 @@ void evse_process(void)
 
     if (rcm) {
         if (rcm_is_triggered()) {
-            set_error_bits(EVSE_ERR_RCM_TRIGGERED_BIT);
+            set_error_bits(evse, EVSE_ERR_RCM_TRIGGERED_BIT);
         }
     }
 
     if ((board_config.onewire && board_config.onewire_temp_sensor) ||
             board_config.thermistor) {
         if (temp_sensor_get_high() > (temp_threshold * 100)) {
-            set_error_bits(EVSE_ERR_TEMPERATURE_HIGH_BIT);
+            set_error_bits(evse, EVSE_ERR_TEMPERATURE_HIGH_BIT);
         } else {
-            clear_error_bits(EVSE_ERR_TEMPERATURE_HIGH_BIT);
+            clear_error_bits(evse, EVSE_ERR_TEMPERATURE_HIGH_BIT);
         }
 
         if (temp_sensor_is_error()) {
-            set_error_bits(EVSE_ERR_TEMPERATURE_FAULT_BIT);
+            set_error_bits(evse, EVSE_ERR_TEMPERATURE_FAULT_BIT);
         } else {
-            clear_error_bits(EVSE_ERR_TEMPERATURE_FAULT_BIT);
+            clear_error_bits(evse, EVSE_ERR_TEMPERATURE_FAULT_BIT);
         }
     }
 
-    if (error == 0 && !error_cleared) {
+    if (evse->error == 0 && !evse->error_cleared) {
         //no errors
         //after clear error, process on next iteration, after apply_state
 
-        switch (state)
+        bool ac_relay_forced_off = false;
+
+        if (evse->state == EVSE_STATE_B1 && !evse->authorized) {
+            if (require_auth) {
+                evse->authorized = evse->auth_grant_to != 0 && (int32_t)(evse->auth_grant_to - xTaskGetTickCount()) >= 0;
+                evse->auth_grant_to = 0;
+            } else {
+                evse->authorized = true;
+            }
+        }
+
+        if ((evse->state == EVSE_STATE_C1 || evse->state == EVSE_STATE_D1) &&
+                is_deadline_passed(evse->c1_d1_ac_relay_wait_to)) {
+            ESP_LOGW(TAG, "Force switch off ac relay");
+            set_ac_relay(evse, false);
+            evse->c1_d1_ac_relay_wait_to = 0;
+            ac_relay_forced_off = true;
+        }
+
+        switch (evse->state)
         {
         case EVSE_STATE_A:
-            if (!available) {
-                state = EVSE_STATE_F;
-                break;
-            }
-            switch (pilot_voltage)
-            {
-            case PILOT_VOLTAGE_12:
-                // stay in current state
-                break;
-            case PILOT_VOLTAGE_9:
-                state = EVSE_STATE_B1;
-                break;
-            default:
-                set_error_bits(EVSE_ERR_PILOT_FAULT_BIT);
-            }
-            break;
         case EVSE_STATE_B1:
-            if (!authorized) {
-                if (require_auth) {
-                    authorized = auth_grant_to >= xTaskGetTickCount();
-                    auth_grant_to = 0;
-                } else {
-                    authorized = true;
-                }
-            }
-            // fallthrough
         case EVSE_STATE_B2:
-            if (!available) {
-                state = EVSE_STATE_F;
-                break;
-            }
-            switch (pilot_voltage)
-            {
-            case PILOT_VOLTAGE_12:
-                state = EVSE_STATE_A;
-                break;
-            case PILOT_VOLTAGE_9:
-                if (can_charging()) {
-                    state = EVSE_STATE_B2;
-                } else {
-                    state = EVSE_STATE_B1;
-                }
-                break;
-            case PILOT_VOLTAGE_6:
-                if (can_charging()) {
-                    state = EVSE_STATE_C2;
-                } else {
-                    state = EVSE_STATE_C1;
-                }
-                break;
-            default:
-                set_error_bits(EVSE_ERR_PILOT_FAULT_BIT);
+            if (!evse->available) {
+                evse->state = EVSE_STATE_F;
+            } else {
+                apply_transition(evse, pilot_voltage);
             }
             break;
         case EVSE_STATE_C1:
-            if (c1_d1_ac_relay_wait_to != 0 && xTaskGetTickCount() >= c1_d1_ac_relay_wait_to) {
-                ESP_LOGW(TAG, "Force switch off ac relay");
-                ac_relay_set_state(false);
-                c1_d1_ac_relay_wait_to = 0;
-                if (!available) {
-                    state = EVSE_STATE_F;
-                    break;
-                }
-            }
-            // fallthrough
         case EVSE_STATE_C2:
-            if (!enabled || !available) {
-                state = EVSE_STATE_C1;
-                break;
-            }
-            switch (pilot_voltage)
-            {
-            case PILOT_VOLTAGE_12:
-                state = EVSE_STATE_A;
-                break;
-            case PILOT_VOLTAGE_9:
-                if (can_charging()) {
-                    state = EVSE_STATE_B2;
-                } else {
-                    state = EVSE_STATE_B1;
-                }
-                break;
-            case PILOT_VOLTAGE_6:
-                if (can_charging()) {
-                    state = EVSE_STATE_C2;
-                } else {
-                    state = EVSE_STATE_C1;
-                }
-                break;
-            case PILOT_VOLTAGE_3:
-                if (can_charging()) {
-                    state = EVSE_STATE_D2;
-                } else {
-                    state = EVSE_STATE_D1;
-                }
-                break;
-            default:
-                set_error_bits(EVSE_ERR_PILOT_FAULT_BIT);
-            }
-            break;
         case EVSE_STATE_D1:
-            if (c1_d1_ac_relay_wait_to != 0 && xTaskGetTickCount() >= c1_d1_ac_relay_wait_to) {
-                ESP_LOGW(TAG, "Force switch off ac relay");
-                ac_relay_set_state(false);
-                c1_d1_ac_relay_wait_to = 0;
-                if (!available) {
-                    state = EVSE_STATE_F;
-                    break;
-                }
-            }
-            // fallthrough
         case EVSE_STATE_D2:
-            if (!enabled || !available) {
-                state = EVSE_STATE_D1;
-                break;
-            }
-            switch (pilot_voltage)
-            {
-            case PILOT_VOLTAGE_6:
-                if (can_charging()) {
-                    state = EVSE_STATE_C2;
-                } else {
-                    state = EVSE_STATE_C1;
-                }
-                break;
-            case PILOT_VOLTAGE_3:
-                if (can_charging()) {
-                    state = EVSE_STATE_D2;
-                } else {
-                    state = EVSE_STATE_D1;
-                }
-                break;
-            default:
-                set_error_bits(EVSE_ERR_PILOT_FAULT_BIT);
+            if (ac_relay_forced_off && !evse->available) {
+                evse->state = EVSE_STATE_F;
+            } else if (!evse->enabled || !evse->available) {
+                evse->state = evse->state <= EVSE_STATE_C2 ? EVSE_STATE_C1 : EVSE_STATE_D1;
+            } else {
+                apply_transition(evse, pilot_voltage);
             }
             break;
         case EVSE_STATE_E:
             break;
         case EVSE_STATE_F:
-            if (available) {
-                state = EVSE_STATE_A;
-                break;
+            if (evse->available) {
+                evse->state = EVSE_STATE_A;
             }
             break;
         }
 
-        // check consumption limit
-        if (consumption_limit > 0 && energy_meter_get_consumption() > consumption_limit) {
-            reached_limit |= LIMIT_CONSUMPTION_BIT;
-        } else {
-            reached_limit &= ~LIMIT_CONSUMPTION_BIT;
+        if (evse->index == 0) {
+            check_limits(evse);
         }
+    }
 
-        // check charging time limit
-        if (charging_time_limit > 0 && energy_meter_get_charging_time() > charging_time_limit) {
-            reached_limit |= LIMIT_CHARGING_TIME_BIT;
-        } else {
-            reached_limit &= ~LIMIT_CHARGING_TIME_BIT;
+    apply_state(evse);
+
+    evse->error_cleared = false;
+
+    // latencies are measured only within the iteration that caused them
+    evse->pilot_change_time = 0;
+    evse->disable_command_time = 0;
+
+    publish_snapshot(evse);
+}
+
+void evse_process(void)
+{
+    int64_t start = esp_timer_get_time();
+
+    process_commands();
+
+    for (uint8_t i = 0; i < connector_count; i++) {
+        process_connector(&connectors[i]);
+    }
+
+    update_loop_stats(&process_stats, start, esp_timer_get_time());
+}
+
+esp_err_t evse_subscribe(uint32_t mask, evse_event_handler_t handler, void* arg)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (mask == 0 || handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&subscriber_spinlock);
+    if (subscriber_count < MAX_SUBSCRIBERS) {
+        subscribers[subscriber_count].mask = mask;
+        subscribers[subscriber_count].handler = handler;
+        subscribers[subscriber_count].arg = arg;
+        __atomic_store_n(&subscriber_count, subscriber_count + 1, __ATOMIC_RELEASE);
+    } else {
+        ret = ESP_ERR_NO_MEM;
+    }
+    portEXIT_CRITICAL(&subscriber_spinlock);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Max subscribers reached");
+    }
+
+    return ret;
+}
+
+esp_err_t evse_wait_commands(uint32_t timeout_ms)
+{
+    xSemaphoreTake(command_post_mutex, portMAX_DELAY);
+    uint8_t poster = get_command_poster(xTaskGetCurrentTaskHandle());
+    uint32_t ticket = command_posters[poster].ticket;
+    xSemaphoreGive(command_post_mutex);
+
+    // cleared before checking ticket, so commands done meanwhile set it again
+    EventBits_t bit = BIT(poster);
+    xEventGroupClearBits(command_event_group, bit);
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+
+    while ((int32_t)(__atomic_load_n(&command_done_ticket, __ATOMIC_ACQUIRE) - ticket) < 0) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            return ESP_ERR_TIMEOUT;
         }
+        xEventGroupWaitBits(command_event_group, bit, pdTRUE, pdFALSE, timeout - elapsed);
+    }
 
-        // check under power limit
-        if (evse_state_is_charging(state)) {
-            if (under_power_limit > 0 && energy_meter_get_power() < under_power_limit) {
-                if (under_power_start_time == 0) {
-                    under_power_start_time = xTaskGetTickCount();
-                }
-            } else {
-                under_power_start_time = 0;
-            }
+    return ESP_OK;
+}
 
-            if (under_power_start_time > 0 && under_power_start_time + pdMS_TO_TICKS(UNDER_POWER_TIME) < xTaskGetTickCount()) {
-                reached_limit |= LIMIT_UNDER_POWER_BIT;
-            } else {
-                reached_limit &= ~LIMIT_UNDER_POWER_BIT;
-            }
+static void get_snapshot(evse_t* evse, evse_snapshot_t* out)
+{
+    uint32_t seq;
+
+    do {
+        seq = __atomic_load_n(&evse->snapshot_seq, __ATOMIC_ACQUIRE);
+        *out = evse->snapshot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&evse->snapshot_seq, __ATOMIC_RELAXED));
+}
+
+void evse_get_snapshot(evse_snapshot_t* out)
+{
+    get_snapshot(&connectors[0], out);
+}
+
+void evse_get_process_stats(evse_loop_stats_t* stats)
+{
+    *stats = process_stats.stats;
+}
+
+void evse_get_meter_stats(evse_loop_stats_t* stats)
+{
+    *stats = meter_stats.stats;
+}
+
+esp_err_t evse_get_transition_stats(evse_state_t state, pilot_voltage_t pilot_voltage, bool can_charging, evse_transition_stats_t* stats)
+{
+    if (state < EVSE_STATE_A || state > EVSE_STATE_D2 || pilot_voltage < PILOT_VOLTAGE_12 || pilot_voltage > PILOT_VOLTAGE_1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *stats = connectors[0].transition_stats[state][pilot_voltage][can_charging];
+    stats->next_state = transitions[state][pilot_voltage][can_charging];
+
+    return ESP_OK;
+}
+
+void evse_get_latency_stats(evse_latency_t latency, evse_latency_stats_t* stats)
+{
+    const struct latency_histogram_s* histogram = &latency_histograms[latency];
+    uint32_t p50_count = (histogram->count + 1) / 2;
+    uint32_t p99_count = ((uint64_t)histogram->count * 99 + 99) / 100;
+    uint32_t sum = 0;
+
+    memcpy(stats->buckets, histogram->buckets, sizeof(stats->buckets));
+    stats->count = histogram->count;
+    stats->max = histogram->max;
+    stats->p50 = 0;
+    stats->p99 = 0;
+
+    // percentile is upper bound of bucket, limited by max
+    for (uint8_t i = 0; i < EVSE_LATENCY_BUCKETS && sum < p99_count; i++) {
+        sum += histogram->buckets[i];
+        uint32_t upper = MIN((2UL << i) - 1, histogram->max);
+        if (stats->p50 == 0 && sum >= p50_count) {
+            stats->p50 = upper;
+        }
+        if (sum >= p99_count) {
+            stats->p99 = upper;
         }
+    }
+}
 
-        if (reached_limit > 0 && evse_state_is_charging(state)) {
-            ESP_LOGI(TAG, "Reached limit %d", reached_limit);
-            if (state == EVSE_STATE_B2) {
-                state = EVSE_STATE_B1;
-            }
-            if (state == EVSE_STATE_C2) {
-                state = EVSE_STATE_C1;
-            }
-            if (state == EVSE_STATE_D2) {
-                state = EVSE_STATE_D1;
+void evse_reset_stats(void)
+{
+    process_stats.stats.iterations = 0;
+    process_stats.stats.max_time = 0;
+    process_stats.stats.max_jitter = 0;
+
+    meter_stats.stats.iterations = 0;
+    meter_stats.stats.max_time = 0;
+    meter_stats.stats.max_jitter = 0;
+
+    for (uint8_t i = 0; i < connector_count; i++) {
+        memset(connectors[i].transition_stats, 0, sizeof(connectors[i].transition_stats));
+    }
+
+    memset(latency_histograms, 0, sizeof(latency_histograms));
+}
+
+static TickType_t get_deadline_timeout(TickType_t deadline, TickType_t now, TickType_t timeout)
+{
+    if (deadline != 0 && (int32_t)(deadline - now) > 0) {
+        return MIN(deadline - now, timeout);
+    }
+    return timeout;
+}
+
+static TickType_t get_process_period(void)
+{
+    for (uint8_t i = 0; i < connector_count; i++) {
+        switch (get_state(&connectors[i]))
+        {
+        case EVSE_STATE_A:
+        case EVSE_STATE_E:
+        case EVSE_STATE_F:
+            break;
+        default:
+            return pdMS_TO_TICKS(PROCESS_PERIOD);
+        }
+    }
+
+    return pdMS_TO_TICKS(PROCESS_IDLE_PERIOD);
+}
+
+static TickType_t get_process_timeout(TickType_t next_wake_time)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t timeout = (int32_t)(next_wake_time - now) > 0 ? next_wake_time - now : 0;
+
+    for (uint8_t i = 0; i < connector_count; i++) {
+        evse_t* evse = &connectors[i];
+
+        timeout = get_deadline_timeout(evse->error_wait_to, now, timeout);
+        timeout = get_deadline_timeout(evse->c1_d1_ac_relay_wait_to, now, timeout);
+        timeout = get_deadline_timeout(evse->under_power_wait_to, now, timeout);
+    }
+
+    return timeout;
+}
+
+static void evse_task_func(void* param)
+{
+    uint32_t notification;
+    TickType_t next_wake_time = xTaskGetTickCount();
+    TickType_t period = 0;
+    bool periodic = true;
+
+    while (true) {
+        if (periodic) {
+            update_loop_jitter(&process_stats, esp_timer_get_time(), period);
+        }
+
+        evse_process();
+
+        if (periodic) {
+            period = get_process_period();
+            next_wake_time += period;
+            if ((int32_t)(next_wake_time - xTaskGetTickCount()) < 0) {
+                // overrun, restart schedule from now
+                next_wake_time = xTaskGetTickCount();
             }
         }
+
+        TickType_t timeout = get_process_timeout(next_wake_time);
+        periodic = xTaskNotifyWait(0x00, 0xff, &notification, timeout) == pdFALSE && (int32_t)(xTaskGetTickCount() - next_wake_time) >= 0;
     }
+}
+
+static void meter_task_func(void* param)
+{
+    TickType_t last_wake_time = xTaskGetTickCount();
 
-    apply_state();
+    while (true) {
+        int64_t start = esp_timer_get_time();
+        update_loop_jitter(&meter_stats, start, pdMS_TO_TICKS(METER_PERIOD));
 
-    error_cleared = false;
+        energy_meter_process(evse_state_is_charging(evse_get_state()), connectors[0].charging_current);
 
-    xSemaphoreGive(mutex);
+        update_loop_stats(&meter_stats, start, esp_timer_get_time());
 
-    energy_meter_process(evse_state_is_charging(evse_get_state()), charging_current);
+        if (xTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(METER_PERIOD)) == pdFALSE) {
+            // overrun, block anyway so lower priority tasks are not starved, restart schedule from now
+            vTaskDelay(1);
+            last_wake_time = xTaskGetTickCount();
+        }
+    }
 }
 
 void evse_init()
 {
     ESP_ERROR_CHECK(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs));
 
-    mutex = xSemaphoreCreateMutex();
+    command_queue = xQueueCreate(COMMAND_QUEUE_SIZE, sizeof(struct command_s));
+    command_post_mutex = xSemaphoreCreateMutex();
+    command_event_group = xEventGroupCreate();
 
     nvs_get_u8(nvs, NVS_MAX_CHARGING_CURRENT, &max_charging_current);
 
-    charging_current = max_charging_current * 10;
-    nvs_get_u16(nvs, NVS_DEFAULT_CHARGING_CURRENT, &charging_current);
-
     uint8_t u8;
     if (nvs_get_u8(nvs, NVS_REQUIRE_AUTH, &u8) == ESP_OK) {
         require_auth = u8;
@@ -543,20 +1185,56 @@ void evse_init()
 
     nvs_get_u8(nvs, NVS_TEMP_THRESHOLD, &temp_threshold);
 
-    nvs_get_u32(nvs, NVS_DEFAULT_CONSUMPTION_LIMIT, &consumption_limit);
+    connector_count = board_config_get_connector_count();
+
+    for (uint8_t i = 0; i < connector_count; i++) {
+        evse_t* evse = &connectors[i];
+
+        evse->index = i;
+        pilot_set_level(i, true);
+
+        const esp_timer_create_args_t limit_timer_args = {
+            .callback = limit_timer_callback,
+            .name = "evse_limit"
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&limit_timer_args, &evse->limit_timer));
 
-    nvs_get_u32(nvs, NVS_DEFAULT_CHARGING_TIME_LIMIT, &charging_time_limit);
+        evse->charging_current = max_charging_current * 10;
+        nvs_get_u16(nvs, NVS_DEFAULT_CHARGING_CURRENT, &evse->charging_current);
 
-    nvs_get_u16(nvs, NVS_DEFAULT_UNDER_POWER_LIMIT, &under_power_limit);
+        if (i == 0) {
+            nvs_get_u32(nvs, NVS_DEFAULT_CONSUMPTION_LIMIT, &evse->consumption_limit);
+
+            uint32_t charging_time_limit = 0;
+            nvs_get_u32(nvs, NVS_DEFAULT_CHARGING_TIME_LIMIT, &charging_time_limit);
+            evse->charging_time_limit = MIN(charging_time_limit, UINT32_MAX / 1000) * 1000;
+
+            nvs_get_u16(nvs, NVS_DEFAULT_UNDER_POWER_LIMIT, &evse->under_power_limit);
+        }
 
-    pilot_set_level(true);
+        perform_rcm_selftest(evse);
 
-    perform_rcm_selftest();
+        publish_snapshot(evse);
+    }
+
+    xTaskCreate(evse_task_func, "evse_task", 4 * 1024, NULL, 10, &evse_task);
+    xTaskCreate(meter_task_func, "evse_meter_task", 4 * 1024, NULL, 4, &meter_task);
+}
+
+void IRAM_ATTR evse_notify_from_isr(void)
+{
+    BaseType_t higher_task_woken = pdFALSE;
+
+    if (evse_task) {
+        xTaskNotifyFromISR(evse_task, PROCESS_BIT, eSetBits, &higher_task_woken);
+    }
+
+    portYIELD_FROM_ISR(higher_task_woken);
 }
 
 evse_state_t evse_get_state(void)
 {
-    return error ? EVSE_STATE_E : state;
+    return get_state(&connectors[0]);
 }
 
 const char* evse_state_to_str(evse_state_t state)
@@ -611,7 +1289,7 @@ const char* evse_state_to_str_long(evse_state_t state)
 
 uint32_t evse_get_error(void)
 {
-    return error;
+    return connectors[0].error;
 }
 
 const char* evse_error_to_str(uint32_t error)
@@ -685,29 +1363,17 @@ esp_err_t evse_set_max_charging_current(uint8_t value)
 
 uint16_t evse_get_charging_current(void)
 {
-    return charging_current;
+    return connectors[0].charging_current;
 }
 
 esp_err_t evse_set_charging_current(uint16_t value)
 {
-    ESP_LOGI(TAG, "Set charging current %dA/10", value);
-
-    if (value < CHARGING_CURRENT_MIN || value > max_charging_current * 10) {
-        ESP_LOGE(TAG, "Charging current out of range");
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    xSemaphoreTake(mutex, portMAX_DELAY);
-
-    charging_current = value;
-
-    if (pilot_state == PILOT_STATE_PWM) {
-        pilot_set_amps(MIN(charging_current, cable_max_current * 10));
-    }
-
-    xSemaphoreGive(mutex);
+    return evse_connector_set_charging_current(0, value);
+}
 
-    return ESP_OK;
+uint16_t evse_get_offered_current(void)
+{
+    return pilot_get_amps(0);
 }
 
 uint16_t evse_get_default_charging_current(void)
@@ -811,110 +1477,83 @@ void evse_set_require_auth(bool _require_auth)
 
     nvs_set_u8(nvs, NVS_REQUIRE_AUTH, require_auth);
     nvs_commit(nvs);
+
+    notify_process();
 }
 
-void evse_authorize(void)
+esp_err_t evse_authorize(void)
 {
-    ESP_LOGI(TAG, "Authorize");
-    auth_grant_to = xTaskGetTickCount() + pdMS_TO_TICKS(AUTHORIZED_TIME);
-    under_power_start_time = 0;
+    return evse_connector_authorize(0);
 }
 
 bool evse_is_pending_auth(void)
 {
-    return evse_state_is_session(state) && !authorized;
+    return is_pending_auth(&connectors[0]);
 }
 
 bool evse_is_enabled(void)
 {
-    return enabled;
+    return connectors[0].enabled;
 }
 
-void evse_set_enabled(bool value)
+esp_err_t evse_set_enabled(bool value)
 {
-    ESP_LOGI(TAG, "Set enabled %d", value);
-
-    xSemaphoreTake(mutex, portMAX_DELAY);
-
-    if (enabled != value) {
-        enabled = value;
-        // if (!enabled) {
-        //     if (state == EVSE_STATE_C2) {
-        //         state = EVSE_STATE_C1;
-        //     } else if (state == EVSE_STATE_D2) {
-        //         state = EVSE_STATE_D1;
-        //     }
-        //     apply_state();
-        // }
-    }
-
-    xSemaphoreGive(mutex);
+    return evse_connector_set_enabled(0, value);
 }
 
 bool evse_is_available(void)
 {
-    return available;
+    return connectors[0].available;
 }
 
-void evse_set_available(bool value)
+esp_err_t evse_set_available(bool value)
 {
-    ESP_LOGI(TAG, "Set available %d", value);
-    xSemaphoreTake(mutex, portMAX_DELAY);
-
-    if (available != value) {
-        available = value;
-        // if (available) {
-        //     if (state == EVSE_STATE_F) {
-        //         state = EVSE_STATE_A;
-        //     }
-        // } else {
-        //     if (state == EVSE_STATE_C2) {
-        //         state = EVSE_STATE_C1;
-        //     } else if (state == EVSE_STATE_D2) {
-        //         state = EVSE_STATE_D1;
-        //     } else {
-        //         state = EVSE_STATE_F;
-        //     }
-        // }
-        // apply_state();
-    }
-
-    xSemaphoreGive(mutex);
+    return evse_connector_set_available(0, value);
 }
 
 bool evse_is_limit_reached(void)
 {
-    return reached_limit != 0;
+    return connectors[0].reached_limit != 0;
 }
 
 uint32_t evse_get_consumption_limit(void)
 {
-    return consumption_limit;
+    return connectors[0].consumption_limit;
 }
 
-void evse_set_consumption_limit(uint32_t value)
+esp_err_t evse_set_consumption_limit(uint32_t value)
 {
-    consumption_limit = value;
+    return post_command(0, COMMAND_SET_CONSUMPTION_LIMIT, value);
 }
 
 uint32_t evse_get_charging_time_limit(void)
 {
-    return charging_time_limit;
+    return (connectors[0].charging_time_limit + 999) / 1000;
+}
+
+esp_err_t evse_set_charging_time_limit(uint32_t value)
+{
+    return post_command(0, COMMAND_SET_CHARGING_TIME_LIMIT, MIN(value, UINT32_MAX / 1000) * 1000);
+}
+
+uint32_t evse_get_charging_time_limit_ms(void)
+{
+    return connectors[0].charging_time_limit;
 }
 
-void evse_set_charging_time_limit(uint32_t value)
+esp_err_t evse_set_charging_time_limit_ms(uint32_t value)
 {
-    charging_time_limit = value;
+    return post_command(0, COMMAND_SET_CHARGING_TIME_LIMIT, value);
 }
 
 uint16_t evse_get_under_power_limit(void)
 {
-    return under_power_limit;
+    return connectors[0].under_power_limit;
 }
 
-void evse_set_under_power_limit(uint16_t value)
+esp_err_t evse_set_under_power_limit(uint16_t value)
 {
-    under_power_limit = value;
+    return post_command(0, COMMAND_SET_UNDER_POWER_LIMIT, value);
 }
 
 uint32_t evse_get_default_consumption_limit(void)
@@ -955,3 +1594,77 @@ void evse_set_default_under_power_limit(uint16_t value)
     nvs_set_u16(nvs, NVS_DEFAULT_UNDER_POWER_LIMIT, value);
     nvs_commit(nvs);
 }
+
+uint8_t evse_get_connector_count(void)
+{
+    return connector_count;
+}
+
+esp_err_t evse_connector_get_snapshot(uint8_t connector, evse_snapshot_t* snapshot)
+{
+    if (connector >= connector_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    get_snapshot(&connectors[connector], snapshot);
+
+    return ESP_OK;
+}
+
+uint16_t evse_connector_get_offered_current(uint8_t connector)
+{
+    return connector < connector_count ? pilot_get_amps(connector) : 0;
+}
+
+esp_err_t evse_connector_set_charging_current(uint8_t connector, uint16_t value)
+{
+    ESP_LOGI(TAG, "Set charging current %dA/10 connector %d", value, connector);
+
+    if (connector >= connector_count) {
+        ESP_LOGE(TAG, "Connector out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (value < CHARGING_CURRENT_MIN || value > max_charging_current * 10) {
+        ESP_LOGE(TAG, "Charging current out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return post_command(connector, COMMAND_SET_CHARGING_CURRENT, value);
+}
+
+esp_err_t evse_connector_set_enabled(uint8_t connector, bool value)
+{
+    ESP_LOGI(TAG, "Set enabled %d connector %d", value, connector);
+
+    if (connector >= connector_count) {
+        ESP_LOGE(TAG, "Connector out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return post_command(connector, COMMAND_SET_ENABLED, value);
+}
+
+esp_err_t evse_connector_set_available(uint8_t connector, bool value)
+{
+    ESP_LOGI(TAG, "Set available %d connector %d", value, connector);
+
+    if (connector >= connector_count) {
+        ESP_LOGE(TAG, "Connector out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return post_command(connector, COMMAND_SET_AVAILABLE, value);
+}
+
+esp_err_t evse_connector_authorize(uint8_t connector)
+{
+    ESP_LOGI(TAG, "Authorize connector %d", connector);
+
+    if (connector >= connector_count) {
+        ESP_LOGE(TAG, "Connector out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return post_command(connector, COMMAND_AUTHORIZE, 0);
+}
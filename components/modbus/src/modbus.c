@@ -35,6 +35,14 @@
 #define MODBUS_REG_EMETER_L1_CUR        213 // 2 word
 #define MODBUS_REG_EMETER_L2_CUR        215 // 2 word
 #define MODBUS_REG_EMETER_L3_CUR        217 // 2 word
+#define MODBUS_REG_EMETER_APP_POWER     219
+#define MODBUS_REG_EMETER_POWER_FACTOR  220
+#define MODBUS_REG_EMETER_L1_POWER      221
+#define MODBUS_REG_EMETER_L2_POWER      222
+#define MODBUS_REG_EMETER_L3_POWER      223
+#define MODBUS_REG_EMETER_CONSUMPTION_MWH 224 // 4 word
+#define MODBUS_REG_EMETER_TOTAL_CONSUMPTION 228 // 4 word
+#define MODBUS_REG_EMETER_FREQUENCY     232
 
 #define MODBUS_REG_SOCKET_OUTLET        300
 #define MODBUS_REG_RCM                  301
@@ -60,6 +68,11 @@
 #define MODBUS_REG_APP_VERSION          405 //16 word
 #define MODBUS_REG_RESTART              421
 
+#define MODBUS_REG_LATENCY              500 // 8 word per evse_latency_t: count, p50, p99, max in us, 2 word each
+
+#define MODBUS_REG_CONNECTOR            1000 // block per connector, evse registers 100 to 112 at same offset
+#define MODBUS_CONNECTOR_BLOCK_SIZE     100
+
 #define MODBUS_EX_NONE                  0x00
 #define MODBUS_EX_ILLEGAL_FUNCTION      0x01
 #define MODBUS_EX_ILLEGAL_DATA_ADDRESS  0x02
@@ -71,6 +84,7 @@
 
 #define UINT32_GET_HI(value)            ((uint16_t)(((uint32_t) (value)) >> 16))
 #define UINT32_GET_LO(value)            ((uint16_t)(((uint32_t) (value)) & 0xFFFF))
+#define UINT64_GET_WORD(value, word)    ((uint16_t)(((uint64_t) (value)) >> (48 - 16 * (word))))
 
 #define NVS_NAMESPACE                   "modbus"
 #define NVS_UNIT_ID                     "unit_id"
@@ -105,103 +119,163 @@ static uint32_t get_uptime(void)
     return esp_timer_get_time() / 1000000;
 }
 
-static bool read_holding_register(uint16_t addr, uint16_t* value)
+static uint32_t get_latency_value(uint16_t offset)
+{
+    evse_latency_stats_t stats;
+    evse_get_latency_stats(offset / 8, &stats);
+
+    switch ((offset % 8) / 2) {
+    case 0:
+        return stats.count;
+    case 1:
+        return stats.p50;
+    case 2:
+        return stats.p99;
+    default:
+        return stats.max;
+    }
+}
+
+// connector of register block, 0 for registers outside connector blocks
+static uint8_t get_register_connector(uint16_t addr)
+{
+    return addr >= MODBUS_REG_CONNECTOR ? (addr - MODBUS_REG_CONNECTOR) / MODBUS_CONNECTOR_BLOCK_SIZE : 0;
+}
+
+// evse register of connector block register, 0 when offset is not evse register
+static uint16_t get_connector_register(uint16_t addr)
+{
+    uint16_t offset = (addr - MODBUS_REG_CONNECTOR) % MODBUS_CONNECTOR_BLOCK_SIZE;
+    return offset <= MODBUS_REG_AUTHORISE - MODBUS_REG_STATE ? MODBUS_REG_STATE + offset : 0;
+}
+
+static bool read_holding_register(const evse_snapshot_t* snapshot, uint8_t connector, uint16_t addr, uint16_t* value)
 {
     ESP_LOGD(TAG, "HR read %d", addr);
     switch (addr) {
     case MODBUS_REG_STATE:
-        const char* state_str = evse_state_to_str(evse_get_state());
+        const char* state_str = evse_state_to_str(snapshot->state);
         *value = state_str[0] << 8 | state_str[1];
         break;
     case MODBUS_REG_ERROR:
-        *value = UINT32_GET_HI(evse_get_error());
+        *value = UINT32_GET_HI(snapshot->error);
         break;
     case MODBUS_REG_ERROR + 1:
-        *value = UINT32_GET_LO(evse_get_error());
+        *value = UINT32_GET_LO(snapshot->error);
         break;
     case MODBUS_REG_ENABLED:
-        *value = evse_is_enabled();
+        *value = snapshot->enabled;
         break;
     case MODBUS_REG_AVAILABLE:
-        *value = evse_is_available();
+        *value = snapshot->available;
         break;
     case MODBUS_REG_PENDING_AUTH:
-        *value = evse_is_pending_auth();
+        *value = snapshot->pending_auth;
         break;
     case MODBUS_REG_CHR_CURRENT:
-        *value = evse_get_charging_current();
+        *value = snapshot->charging_current;
         break;
     case MODBUS_REG_CONSUMPTION_LIM:
-        *value = UINT32_GET_HI(evse_get_consumption_limit());
+        *value = UINT32_GET_HI(snapshot->consumption_limit);
         break;
     case MODBUS_REG_CONSUMPTION_LIM + 1:
-        *value = UINT32_GET_LO(evse_get_consumption_limit());
+        *value = UINT32_GET_LO(snapshot->consumption_limit);
         break;
     case MODBUS_REG_CHR_TIME_LIM:
-        *value = UINT32_GET_HI(evse_get_charging_time_limit());
+        *value = UINT32_GET_HI(snapshot->charging_time_limit);
         break;
     case MODBUS_REG_CHR_TIME_LIM + 1:
-        *value = UINT32_GET_LO(evse_get_charging_time_limit());
+        *value = UINT32_GET_LO(snapshot->charging_time_limit);
         break;
     case MODBUS_REG_UNDER_POWER_LIM:
-        *value = evse_get_under_power_limit();
+        *value = snapshot->under_power_limit;
         break;
     case MODBUS_REG_EMETER_POWER:
-        *value = energy_meter_get_power();
+        *value = snapshot->power;
         break;
     case MODBUS_REG_EMETER_SES_TIME:
-        *value = UINT32_GET_HI(energy_meter_get_session_time());
+        *value = UINT32_GET_HI(snapshot->session_time);
         break;
     case MODBUS_REG_EMETER_SES_TIME + 1:
-        *value = UINT32_GET_LO(energy_meter_get_session_time());
+        *value = UINT32_GET_LO(snapshot->session_time);
         break;
     case MODBUS_REG_EMETER_CHR_TIME:
-        *value = UINT32_GET_HI(energy_meter_get_charging_time());
+        *value = UINT32_GET_HI(snapshot->charging_time);
         break;
     case MODBUS_REG_EMETER_CHR_TIME + 1:
-        *value = UINT32_GET_LO(energy_meter_get_charging_time());
+        *value = UINT32_GET_LO(snapshot->charging_time);
         break;
     case MODBUS_REG_EMETER_CONSUMPTION:
-        *value = UINT32_GET_HI(energy_meter_get_consumption());
+        *value = UINT32_GET_HI(snapshot->consumption);
         break;
     case MODBUS_REG_EMETER_CONSUMPTION + 1:
-        *value = UINT32_GET_LO(energy_meter_get_consumption());
+        *value = UINT32_GET_LO(snapshot->consumption);
         break;
     case MODBUS_REG_EMETER_L1_VTL:
-        *value = UINT32_GET_HI(energy_meter_get_l1_voltage() * 1000);
+        *value = UINT32_GET_HI(snapshot->voltage[0] * 1000);
         break;
     case MODBUS_REG_EMETER_L1_VTL + 1:
-        *value = UINT32_GET_LO(energy_meter_get_l1_voltage() * 1000);
+        *value = UINT32_GET_LO(snapshot->voltage[0] * 1000);
         break;
     case MODBUS_REG_EMETER_L2_VTL:
-        *value = UINT32_GET_HI(energy_meter_get_l2_voltage() * 1000);
+        *value = UINT32_GET_HI(snapshot->voltage[1] * 1000);
         break;
     case MODBUS_REG_EMETER_L2_VTL + 1:
-        *value = UINT32_GET_LO(energy_meter_get_l2_voltage() * 1000);
+        *value = UINT32_GET_LO(snapshot->voltage[1] * 1000);
         break;
     case MODBUS_REG_EMETER_L3_VTL:
-        *value = UINT32_GET_HI(energy_meter_get_l3_voltage() * 1000);
+        *value = UINT32_GET_HI(snapshot->voltage[2] * 1000);
         break;
     case MODBUS_REG_EMETER_L3_VTL + 1:
-        *value = UINT32_GET_LO(energy_meter_get_l3_voltage() * 1000);
+        *value = UINT32_GET_LO(snapshot->voltage[2] * 1000);
         break;
     case MODBUS_REG_EMETER_L1_CUR:
-        *value = UINT32_GET_HI(energy_meter_get_l1_current() * 1000);
+        *value = UINT32_GET_HI(snapshot->current[0] * 1000);
         break;
     case MODBUS_REG_EMETER_L1_CUR + 1:
-        *value = UINT32_GET_LO(energy_meter_get_l1_current() * 1000);
+        *value = UINT32_GET_LO(snapshot->current[0] * 1000);
         break;
     case MODBUS_REG_EMETER_L2_CUR:
-        *value = UINT32_GET_HI(energy_meter_get_l2_current() * 1000);
+        *value = UINT32_GET_HI(snapshot->current[1] * 1000);
         break;
     case MODBUS_REG_EMETER_L2_CUR + 1:
-        *value = UINT32_GET_LO(energy_meter_get_l2_current() * 1000);
+        *value = UINT32_GET_LO(snapshot->current[1] * 1000);
         break;
     case MODBUS_REG_EMETER_L3_CUR:
-        *value = UINT32_GET_HI(energy_meter_get_l3_current() * 1000);
+        *value = UINT32_GET_HI(snapshot->current[2] * 1000);
         break;
     case MODBUS_REG_EMETER_L3_CUR + 1:
-        *value = UINT32_GET_LO(energy_meter_get_l3_current() * 1000);
+        *value = UINT32_GET_LO(snapshot->current[2] * 1000);
+        break;
+    case MODBUS_REG_EMETER_APP_POWER:
+        *value = snapshot->apparent_power;
+        break;
+    case MODBUS_REG_EMETER_POWER_FACTOR:
+        *value = (int16_t) (snapshot->power_factor * 1000);
+        break;
+    case MODBUS_REG_EMETER_L1_POWER:
+        *value = (int16_t) snapshot->phase_power[0];
+        break;
+    case MODBUS_REG_EMETER_L2_POWER:
+        *value = (int16_t) snapshot->phase_power[1];
+        break;
+    case MODBUS_REG_EMETER_L3_POWER:
+        *value = (int16_t) snapshot->phase_power[2];
+        break;
+    case MODBUS_REG_EMETER_CONSUMPTION_MWH:
+    case MODBUS_REG_EMETER_CONSUMPTION_MWH + 1:
+    case MODBUS_REG_EMETER_CONSUMPTION_MWH + 2:
+    case MODBUS_REG_EMETER_CONSUMPTION_MWH + 3:
+        *value = UINT64_GET_WORD(snapshot->consumption_mwh, addr - MODBUS_REG_EMETER_CONSUMPTION_MWH);
+        break;
+    case MODBUS_REG_EMETER_TOTAL_CONSUMPTION:
+    case MODBUS_REG_EMETER_TOTAL_CONSUMPTION + 1:
+    case MODBUS_REG_EMETER_TOTAL_CONSUMPTION + 2:
+    case MODBUS_REG_EMETER_TOTAL_CONSUMPTION + 3:
+        *value = UINT64_GET_WORD(snapshot->total_consumption, addr - MODBUS_REG_EMETER_TOTAL_CONSUMPTION);
+        break;
+    case MODBUS_REG_EMETER_FREQUENCY:
+        *value = snapshot->frequency * 100;
         break;
     case MODBUS_REG_SOCKET_OUTLET:
         *value = evse_get_socket_outlet();
@@ -277,6 +351,13 @@ static bool read_holding_register(uint16_t addr, uint16_t* value)
         if (addr >= MODBUS_REG_APP_VERSION && addr <= MODBUS_REG_APP_VERSION + 16) {
             const esp_app_desc_t* app_desc = esp_app_get_description();
             *value = app_desc->version[(addr - MODBUS_REG_APP_VERSION) * 2] << 8 | app_desc->version[(addr - MODBUS_REG_APP_VERSION) * 2 + 1];
+        } else if (addr >= MODBUS_REG_LATENCY && addr < MODBUS_REG_LATENCY + EVSE_LATENCY_COUNT * 8) {
+            uint16_t offset = addr - MODBUS_REG_LATENCY;
+            uint32_t latency_value = get_latency_value(offset);
+            *value = offset % 2 ? UINT32_GET_LO(latency_value) : UINT32_GET_HI(latency_value);
+        } else if (addr >= MODBUS_REG_CONNECTOR && get_register_connector(addr) == connector && get_connector_register(addr) != 0) {
+            // snapshot is of register connector
+            return read_holding_register(snapshot, connector, get_connector_register(addr), value);
         } else {
             return MODBUS_EX_ILLEGAL_DATA_ADDRESS;
         }
@@ -284,31 +365,77 @@ static bool read_holding_register(uint16_t addr, uint16_t* value)
     return MODBUS_EX_NONE;
 }
 
-static bool write_holding_register(uint16_t addr, uint8_t* buffer, uint16_t left)
+// full evse command queue is reported as busy, master may retry
+static uint8_t get_command_ex(esp_err_t err)
+{
+    switch (err) {
+    case ESP_OK:
+        return MODBUS_EX_NONE;
+    case ESP_ERR_NO_MEM:
+        return MODBUS_EX_SLAVE_BUSY;
+    default:
+        return MODBUS_EX_ILLEGAL_DATA_VALUE;
+    }
+}
+
+static uint8_t write_holding_register(uint16_t addr, uint8_t* buffer, uint16_t left);
+
+static uint8_t write_connector_register(uint8_t connector, uint16_t addr, uint8_t* buffer, uint16_t left)
 {
     uint16_t value = MODBUS_READ_UINT16(buffer, 0);
-    ESP_LOGD(TAG, "HR write %d = %d", addr, value);
+
+    if (connector >= evse_get_connector_count()) {
+        return MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+    }
+
     switch (addr) {
     case MODBUS_REG_ENABLED:
         if (value > 1) {
             return MODBUS_EX_ILLEGAL_DATA_VALUE;
         }
-        evse_set_enabled(value);
-        break;
+        return get_command_ex(evse_connector_set_enabled(connector, value));
     case MODBUS_REG_AVAILABLE:
         if (value > 1) {
             return MODBUS_EX_ILLEGAL_DATA_VALUE;
         }
-        evse_set_available(value);
-        break;
+        return get_command_ex(evse_connector_set_available(connector, value));
     case MODBUS_REG_CHR_CURRENT:
-        if (evse_set_charging_current(value) != ESP_OK) {
+        return get_command_ex(evse_connector_set_charging_current(connector, value));
+    case MODBUS_REG_AUTHORISE:
+        if (value != 1) {
             return MODBUS_EX_ILLEGAL_DATA_VALUE;
         }
-        break;
+        return get_command_ex(evse_connector_authorize(connector));
+    default:
+        // session limits are measured by energy meter of first connector
+        if (connector == 0 && addr != 0) {
+            return write_holding_register(addr, buffer, left);
+        }
+        return MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+    }
+    return MODBUS_EX_NONE;
+}
+
+static uint8_t write_holding_register(uint16_t addr, uint8_t* buffer, uint16_t left)
+{
+    uint16_t value = MODBUS_READ_UINT16(buffer, 0);
+    ESP_LOGD(TAG, "HR write %d = %d", addr, value);
+    switch (addr) {
+    case MODBUS_REG_ENABLED:
+        if (value > 1) {
+            return MODBUS_EX_ILLEGAL_DATA_VALUE;
+        }
+        return get_command_ex(evse_set_enabled(value));
+    case MODBUS_REG_AVAILABLE:
+        if (value > 1) {
+            return MODBUS_EX_ILLEGAL_DATA_VALUE;
+        }
+        return get_command_ex(evse_set_available(value));
+    case MODBUS_REG_CHR_CURRENT:
+        return get_command_ex(evse_set_charging_current(value));
     case MODBUS_REG_CONSUMPTION_LIM:
         if (left > 0) {
-            evse_set_consumption_limit(value << 16 | MODBUS_READ_UINT16(buffer, 2));
+            return get_command_ex(evse_set_consumption_limit(value << 16 | MODBUS_READ_UINT16(buffer, 2)));
         } else {
             return MODBUS_EX_ILLEGAL_DATA_ADDRESS;
         }
@@ -317,7 +444,7 @@ static bool write_holding_register(uint16_t addr, uint8_t* buffer, uint16_t left
         break;
     case MODBUS_REG_CHR_TIME_LIM:
         if (left > 0) {
-            evse_set_charging_time_limit(value << 16 | MODBUS_READ_UINT16(buffer, 2));
+            return get_command_ex(evse_set_charging_time_limit(value << 16 | MODBUS_READ_UINT16(buffer, 2)));
         } else {
             return MODBUS_EX_ILLEGAL_DATA_ADDRESS;
         }
@@ -325,14 +452,12 @@ static bool write_holding_register(uint16_t addr, uint8_t* buffer, uint16_t left
     case MODBUS_REG_CHR_TIME_LIM + 1:
         break;
     case MODBUS_REG_UNDER_POWER_LIM:
-        evse_set_under_power_limit(value);
-        break;
+        return get_command_ex(evse_set_under_power_limit(value));
     case MODBUS_REG_AUTHORISE:
         if (value != 1) {
             return MODBUS_EX_ILLEGAL_DATA_VALUE;
         }
-        evse_authorize();
-        break;
+        return get_command_ex(evse_authorize());
     case MODBUS_REG_SOCKET_OUTLET:
         if (value != 0 || value != 1) {
             return MODBUS_EX_ILLEGAL_DATA_VALUE;
@@ -436,6 +561,9 @@ static bool write_holding_register(uint16_t addr, uint8_t* buffer, uint16_t left
         timeout_restart();
         break;
     default:
+        if (addr >= MODBUS_REG_CONNECTOR) {
+            return write_connector_register(get_register_connector(addr), get_connector_register(addr), buffer, left);
+        }
         return MODBUS_EX_ILLEGAL_DATA_ADDRESS;
     }
     return MODBUS_EX_NONE;
@@ -459,8 +587,16 @@ uint16_t modbus_request_exec(uint8_t* data, uint16_t len)
             data[2] = count * 2;
             resp_len = 3 + count * 2;
 
+            // coherent snapshot of connector of first register
+            uint8_t connector = get_register_connector(addr);
+            evse_snapshot_t snapshot;
+            if (evse_connector_get_snapshot(connector, &snapshot) != ESP_OK) {
+                ex = MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+                count = 0;
+            }
+
             for (uint16_t i = 0; i < count; i++) {
-                if ((ex = read_holding_register(addr + i, &value)) != MODBUS_EX_NONE) {
+                if ((ex = read_holding_register(&snapshot, connector, addr + i, &value)) != MODBUS_EX_NONE) {
                     break;
                 }
                 MODBUS_WRITE_UINT16(data, 3 + 2 * i, value);
@@ -486,6 +622,11 @@ uint16_t modbus_request_exec(uint8_t* data, uint16_t len)
             ex = MODBUS_EX_ILLEGAL_FUNCTION;
         }
 
+        if (fc == 6 || fc == 16) {
+            // response after written values are applied, read back returns them
+            evse_wait_commands(EVSE_COMMAND_WAIT_MS);
+        }
+
         if (ex != MODBUS_EX_NONE) {
             data[1] = 0x8 | fc;
             data[2] = ex;
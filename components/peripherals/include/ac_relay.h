@@ -2,6 +2,7 @@
 #define AC_RELAY_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * @brief Initialize ac relay
@@ -12,8 +13,9 @@ void ac_relay_init(void);
 /**
  * @brief Set state of ac relay
  * 
+ * @param connector index below board_config_get_connector_count
  * @param state 
  */
-void ac_relay_set_state(bool state);
+void ac_relay_set_state(uint8_t connector, bool state);
 
 #endif /* AC_RELAY_H_ */
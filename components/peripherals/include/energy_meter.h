@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include "esp_err.h"
 
+#define ENERGY_METER_HARMONICS      15
+
 /**
  * @brief Mode of energy meter
  *
@@ -13,10 +15,23 @@ typedef enum {
     ENERGY_METER_MODE_DUMMY,
     ENERGY_METER_MODE_CUR,
     ENERGY_METER_MODE_CUR_VLT,
-    //TODO ENERGY_METER_MODE_MODBUS
+    ENERGY_METER_MODE_MODBUS,
     ENERGY_METER_MODE_MAX
 } energy_meter_mode_t;
 
+/**
+ * @brief Values read from external meter (ENERGY_METER_MODE_MODBUS)
+ *
+ */
+typedef struct
+{
+    float voltage[3];               // V
+    float current[3];               // A
+    float power[3];                 // W, active
+    uint64_t energy;                // mWh, meter total import
+    bool has_energy;
+} energy_meter_external_t;
+
 /**
  * @brief Initialize energy meter
  *
@@ -72,6 +87,29 @@ bool energy_meter_is_three_phases(void);
  */
 void energy_meter_set_three_phases(bool three_phases);
 
+/**
+ * @brief Get interval of current harmonics analysis, stored in NVS
+ *
+ * @return Interval in s, 0 when disabled
+ */
+uint16_t energy_meter_get_harmonics_interval(void);
+
+/**
+ * @brief Set interval of current harmonics analysis, stored in NVS
+ *
+ * @param interval in s, 0 to disable
+ * @return esp_err_t
+ */
+esp_err_t energy_meter_set_harmonics_interval(uint16_t interval);
+
+/**
+ * @brief Get current THD and harmonics per phase, from last analysed window while charging with sampled current
+ *
+ * @param thd array of 3 values in %, relative to fundamental
+ * @param harmonics array of 3 x ENERGY_METER_HARMONICS values in A rms, index 0 is fundamental
+ */
+void energy_meter_get_harmonics(float* thd, float (*harmonics)[ENERGY_METER_HARMONICS]);
+
 /**
  * @brief Start energy meter session, if not started
  * 
@@ -92,13 +130,52 @@ void energy_meter_stop_session(void);
  */
 void energy_meter_process(bool charging, uint16_t charging_current);
 
+/**
+ * @brief Update values from external meter, used in ENERGY_METER_MODE_MODBUS
+ *
+ * @note When meter provides total energy, session consumption is counted from its increments instead of integrated power
+ *
+ * @param values
+ */
+void energy_meter_set_external(const energy_meter_external_t* values);
+
 /**
  * @brief Get session actual power
  *
+ * @note Active power when voltage is sampled (ENERGY_METER_MODE_CUR_VLT) or read from external meter (ENERGY_METER_MODE_MODBUS), otherwise equal to apparent power
+ *
  * @return Power in W
  */
 uint16_t energy_meter_get_power(void);
 
+/**
+ * @brief Get session actual apparent power
+ *
+ * @return Power in VA
+ */
+uint16_t energy_meter_get_apparent_power(void);
+
+/**
+ * @brief Get power factor of all phases, active power / apparent power
+ *
+ * @return Power factor 0 - 1
+ */
+float energy_meter_get_power_factor(void);
+
+/**
+ * @brief After energy_meter_process, get active power per phase
+ *
+ * @param power array of 3 values in W
+ */
+void energy_meter_get_active_power(float* power);
+
+/**
+ * @brief After energy_meter_process, get apparent power per phase
+ *
+ * @param power array of 3 values in VA
+ */
+void energy_meter_get_apparent_power_phases(float* power);
+
 /**
  * @brief Get session time
  *
@@ -120,6 +197,46 @@ uint32_t energy_meter_get_charging_time(void);
  */
 uint32_t energy_meter_get_consumption(void);
 
+/**
+ * @brief Get session consumption in full resolution
+ *
+ * @return Consumption in mWh
+ */
+uint64_t energy_meter_get_consumption_mwh(void);
+
+/**
+ * @brief After energy_meter_process, get grid frequency measured from zero crossings of sampled voltage, or current when voltage is not sampled
+ *
+ * @return Frequency in Hz, 0 when not measured
+ */
+float energy_meter_get_frequency(void);
+
+/**
+ * @brief Is zero drift alarm, zero measured while idle differed more than 25mV from zero in use
+ *
+ * @note Zeros of internal meter are cached in NVS and measured again after each minute idle
+ *
+ * @return true
+ * @return false
+ */
+bool energy_meter_is_zero_drift(void);
+
+/**
+ * @brief Get lifetime consumption of all sessions, persisted in NVS every 100Wh and on session end
+ *
+ * @return Consumption in mWh
+ */
+uint64_t energy_meter_get_total_consumption(void);
+
+/**
+ * @brief Get session consumption and charging time in full resolution, updated together by energy_meter_process
+ *
+ * @param consumption Consumption in mWh
+ * @param charging_time Time in ms
+ * @param time Time of update in us, esp_timer time base
+ */
+void energy_meter_get_session_counters(uint64_t* consumption, uint32_t* charging_time, int64_t* time);
+
 /**
  * @brief After energy_meter_process, get current measured voltage
  *
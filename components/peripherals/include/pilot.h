@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#define PILOT_CAPTURE_FRAMES    4
+
+#define PILOT_CAPTURE_SAMPLES   256
+
 /**
  * @brief Up pilot volate
  * 
@@ -17,6 +21,32 @@ typedef enum
     PILOT_VOLTAGE_1 // below 3V
 } pilot_voltage_t;
 
+/**
+ * @brief Pilot capture state
+ *
+ */
+typedef enum
+{
+    PILOT_CAPTURE_STATE_IDLE,
+    PILOT_CAPTURE_STATE_ARMED,  // recording, waiting for trigger
+    PILOT_CAPTURE_STATE_DONE
+} pilot_capture_state_t;
+
+/**
+ * @brief Captured frame of pilot samples
+ *
+ */
+typedef struct
+{
+    int64_t time;               // us since boot of first sample
+    uint32_t sample_freq;       // Hz
+    uint16_t count;
+    uint16_t high;              // mV, classified high plateau
+    uint16_t low;               // mV, classified low plateau
+    uint16_t raw[PILOT_CAPTURE_SAMPLES];
+    uint16_t voltage[PILOT_CAPTURE_SAMPLES]; // mV
+} pilot_capture_frame_t;
+
 /**
  * @brief Initialize pilot
  * 
@@ -26,24 +56,79 @@ void pilot_init(void);
 /**
  * @brief Set pilot to + or - 12V output
  * 
+ * @param connector index below board_config_get_connector_count
  * @param level When true output is +12V false means -12V 
  */
-void pilot_set_level(bool level);
+void pilot_set_level(uint8_t connector, bool level);
 
 /**
  * @brief Set pilot +-12V pwm output
  * 
+ * @param connector index below board_config_get_connector_count
  * @param amps current in A*10 
  */
-void pilot_set_amps(uint16_t amps);
+void pilot_set_amps(uint8_t connector, uint16_t amps);
+
+/**
+ * @brief Get current equivalent to generated pilot pwm duty
+ *
+ * @param connector index below board_config_get_connector_count
+ * @return current in A*10, 0 when pilot is not pwm
+ */
+uint16_t pilot_get_amps(uint8_t connector);
+
+/**
+ * @brief Get generated pilot pwm duty
+ *
+ * @param connector index below board_config_get_connector_count
+ * @return duty in %*100, 0 when pilot is not pwm
+ */
+uint16_t pilot_get_duty(uint8_t connector);
 
 
 /**
- * @brief Measure pilot up and down voltage
+ * @brief Measure pilot up and down voltage, when ADC capture fails previous measurement is repeated few times before classified as fault
  * 
+ * @param connector index below board_config_get_connector_count
  * @param up_voltage 
  * @param down_voltage_n12 true when down volage is -12V tolerant otherwise false
  */
-void pilot_measure(pilot_voltage_t *up_voltage, bool *down_voltage_n12);
+void pilot_measure(uint8_t connector, pilot_voltage_t *up_voltage, bool *down_voltage_n12);
+
+/**
+ * @brief Arm pilot capture of first connector, measured frames are recorded to ring buffer of PILOT_CAPTURE_FRAMES until triggered
+ *
+ * @param on_demand when true capture is triggered after PILOT_CAPTURE_FRAMES are recorded, otherwise waits for pilot_capture_trigger
+ */
+void pilot_capture_arm(bool on_demand);
+
+/**
+ * @brief Trigger armed pilot capture, ring buffer is frozen with last recorded frames
+ *
+ */
+void pilot_capture_trigger(void);
+
+/**
+ * @brief Get pilot capture state
+ *
+ * @return pilot_capture_state_t
+ */
+pilot_capture_state_t pilot_capture_get_state(void);
+
+/**
+ * @brief Get number of frames in done pilot capture
+ *
+ * @return uint8_t
+ */
+uint8_t pilot_capture_get_count(void);
+
+/**
+ * @brief Read frame of done pilot capture, oldest first
+ *
+ * @param index
+ * @param frame
+ * @return true when frame exists
+ */
+bool pilot_capture_read(uint8_t index, pilot_capture_frame_t* frame);
 
 #endif /* PILOT_H_ */
@@ -0,0 +1,104 @@
+#ifndef POWER_QUALITY_H_
+#define POWER_QUALITY_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "esp_err.h"
+
+#define POWER_QUALITY_EVENTS        32
+
+/**
+ * @brief Type of power quality event
+ *
+ */
+typedef enum {
+    POWER_QUALITY_EVENT_SAG,
+    POWER_QUALITY_EVENT_SWELL,
+    POWER_QUALITY_EVENT_INTERRUPTION
+} power_quality_event_type_t;
+
+/**
+ * @brief Finished power quality event
+ *
+ */
+typedef struct
+{
+    uint32_t id;                        // increasing from 1, resets at boot
+    power_quality_event_type_t type;
+    uint8_t phase;                      // 0 = L1
+    time_t time;                        // wall clock at start
+    uint32_t duration;                  // ms
+    float voltage;                      // V, lowest cycle rms of sag and interruption, highest of swell
+} power_quality_event_t;
+
+/**
+ * @brief Initialize power quality detector
+ *
+ */
+void power_quality_init(void);
+
+/**
+ * @brief Get sag threshold, stored in NVS
+ *
+ * @return Voltage in V
+ */
+uint16_t power_quality_get_sag_threshold(void);
+
+/**
+ * @brief Get swell threshold, stored in NVS
+ *
+ * @return Voltage in V
+ */
+uint16_t power_quality_get_swell_threshold(void);
+
+/**
+ * @brief Get interruption threshold, stored in NVS
+ *
+ * @return Voltage in V
+ */
+uint16_t power_quality_get_interruption_threshold(void);
+
+/**
+ * @brief Set thresholds, stored in NVS
+ *
+ * @param sag voltage in V, sag starts when cycle rms is below
+ * @param swell voltage in V, swell starts when cycle rms is above
+ * @param interruption voltage in V, sag is reported as interruption when cycle rms was below
+ * @return esp_err_t ESP_ERR_INVALID_ARG unless interruption < sag < swell
+ */
+esp_err_t power_quality_set_thresholds(uint16_t sag, uint16_t swell, uint16_t interruption);
+
+/**
+ * @brief Process one metering window, called from energy meter
+ *
+ * @param vlt_min lowest cycle rms per phase in V
+ * @param vlt_max highest cycle rms per phase in V
+ * @param phases number of phases measured
+ * @param start time of first sample in window, from esp_timer_get_time
+ * @param end time of last sample in window, from esp_timer_get_time
+ */
+void power_quality_process(const float* vlt_min, const float* vlt_max, uint8_t phases, int64_t start, int64_t end);
+
+/**
+ * @brief Finish ongoing events when voltage is not measured anymore, called from energy meter
+ *
+ */
+void power_quality_stop(void);
+
+/**
+ * @brief Get finished events, oldest first
+ *
+ * @param events buffer of POWER_QUALITY_EVENTS
+ * @return Number of events
+ */
+uint8_t power_quality_get_events(power_quality_event_t* events);
+
+/**
+ * @brief Power quality event type to string
+ *
+ * @param type
+ * @return const char*
+ */
+const char* power_quality_event_type_to_str(power_quality_event_type_t type);
+
+#endif /* POWER_QUALITY_H_ */
@@ -6,10 +6,21 @@
 
 static const char* TAG = "ac_relay";
 
+static gpio_num_t get_gpio(uint8_t connector)
+{
+    return connector == 0 ? board_config.ac_relay_gpio : board_config.connector_2_ac_relay_gpio;
+}
+
 void ac_relay_init(void)
 {
+    uint64_t pin_bit_mask = 0;
+
+    for (uint8_t i = 0; i < board_config_get_connector_count(); i++) {
+        pin_bit_mask |= BIT64(get_gpio(i));
+    }
+
     gpio_config_t conf = {
-        .pin_bit_mask = BIT64(board_config.ac_relay_gpio),
+        .pin_bit_mask = pin_bit_mask,
         .mode = GPIO_MODE_OUTPUT,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
         .pull_up_en = GPIO_PULLUP_DISABLE,
@@ -18,8 +29,8 @@ void ac_relay_init(void)
     ESP_ERROR_CHECK(gpio_config(&conf));
 }
 
-void ac_relay_set_state(bool state)
+void ac_relay_set_state(uint8_t connector, bool state)
 {
-    ESP_LOGI(TAG, "Set relay: %d", state);
-    gpio_set_level(board_config.ac_relay_gpio, state);
+    ESP_LOGI(TAG, "Set relay: %d connector %d", state, connector);
+    gpio_set_level(get_gpio(connector), state);
 }
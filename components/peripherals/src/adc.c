@@ -1,5 +1,34 @@
-#include "adc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "soc/soc_caps.h"
+
+#include "adc.h"
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define CAPTURE_OUTPUT_TYPE     ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define CAPTURE_GET_CHANNEL(p)  ((p)->type1.channel)
+#define CAPTURE_GET_DATA(p)     ((p)->type1.data)
+#else
+#define CAPTURE_OUTPUT_TYPE     ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define CAPTURE_GET_CHANNEL(p)  ((p)->type2.channel)
+#define CAPTURE_GET_DATA(p)     ((p)->type2.data)
+#endif
+
+#define CAPTURE_FRAME_SIZE      (256 * SOC_ADC_DIGI_RESULT_BYTES)
+#define CAPTURE_POOL_FRAMES     4
+#define CAPTURE_TIMEOUT_MS      20
+#define CAPTURE_LOCK_MS         5       // max wait of adc_capture for other adc users, rounded up to tick, background capture is stopped meanwhile
+// continuous mode results are scaled to oneshot bitwidth used by calibration
+#define CAPTURE_DATA_SHIFT      (SOC_ADC_RTC_MAX_BITWIDTH - SOC_ADC_DIGI_MAX_BITWIDTH)
+
+#define LUT_SHIFT               6
+#define LUT_STEP                (1 << LUT_SHIFT)
+#define LUT_SIZE                ((ADC_RAW_MAX + LUT_STEP) / LUT_STEP + 1)
+
+#define ATTEN_COUNT             (ADC_ATTEN_DB_12 + 1)
 
 const static char* TAG = "adc";
 
@@ -7,50 +36,322 @@ adc_oneshot_unit_handle_t adc_handle;
 
 adc_cali_handle_t adc_cali_handle;
 
-void adc_init(void)
+static adc_continuous_handle_t capture_handle;
+
+static SemaphoreHandle_t capture_mutex;
+
+// adc_capture and adc_read calls waiting for capture_mutex, background capture stops at next frame when non zero
+static volatile uint8_t urgent_waiting = 0;
+
+static portMUX_TYPE urgent_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile bool background_running = false;
+
+// given when waiting adc_capture or adc_read call got mutex or gave up
+static SemaphoreHandle_t urgent_done;
+
+// given from conversion done ISR, task notifications of capturing task are left to its owner
+static SemaphoreHandle_t capture_done;
+
+static uint8_t capture_frame[CAPTURE_FRAME_SIZE];
+
+// voltage in mV for each LUT_STEP raw value, linear interpolated between, per attenuation
+static int lut[ATTEN_COUNT][LUT_SIZE];
+
+static bool calibrated[ATTEN_COUNT];
+
+// upper limit of recommended input range per attenuation, in mV
+#if CONFIG_IDF_TARGET_ESP32
+static const int max_voltage[ATTEN_COUNT] = { 950, 1250, 1750, 2450 };
+#elif CONFIG_IDF_TARGET_ESP32S3
+static const int max_voltage[ATTEN_COUNT] = { 950, 1250, 1750, 3100 };
+#else
+static const int max_voltage[ATTEN_COUNT] = { 750, 1050, 1300, 2500 };
+#endif
+
+static void lut_init(adc_atten_t atten, adc_cali_handle_t cali_handle)
 {
-    adc_oneshot_unit_init_cfg_t conf = {
-        .unit_id = ADC_UNIT_1,
-        .clk_src = ADC_DIGI_CLK_SRC_DEFAULT,
-        .ulp_mode = ADC_ULP_MODE_DISABLE,
+    for (int i = 0; i < LUT_SIZE; i++) {
+        int raw = i * LUT_STEP;
+        ESP_ERROR_CHECK(adc_cali_raw_to_voltage(cali_handle, raw > ADC_RAW_MAX ? ADC_RAW_MAX : raw, &lut[atten][i]));
+        if (i > 0 && lut[atten][i] < lut[atten][i - 1]) {
+            lut[atten][i] = lut[atten][i - 1];
+        }
+    }
+}
+
+int adc_raw_to_voltage(int raw)
+{
+    return adc_atten_raw_to_voltage(ADC_ATTEN_DB_12, raw);
+}
+
+int adc_atten_raw_to_voltage(adc_atten_t atten, int raw)
+{
+    if (raw <= 0) {
+        return lut[atten][0];
+    }
+    if (raw >= ADC_RAW_MAX) {
+        raw = ADC_RAW_MAX;
+    }
+
+    int i = raw >> LUT_SHIFT;
+    int frac = raw & (LUT_STEP - 1);
+
+    return lut[atten][i] + (((lut[atten][i + 1] - lut[atten][i]) * frac) >> LUT_SHIFT);
+}
+
+bool adc_atten_is_calibrated(adc_atten_t atten)
+{
+    return calibrated[atten];
+}
+
+int adc_atten_get_max_voltage(adc_atten_t atten)
+{
+    return max_voltage[atten];
+}
+
+int adc_voltage_to_raw(int voltage)
+{
+    int lo = 0;
+    int hi = ADC_RAW_MAX + 1;
+
+    // lut is monotonic, find first raw value converted to voltage or above
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (adc_raw_to_voltage(mid) < voltage) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static bool IRAM_ATTR on_capture_done(adc_continuous_handle_t handle, const adc_continuous_evt_data_t* edata, void* user_data)
+{
+    BaseType_t higher_task_woken = pdFALSE;
+
+    xSemaphoreGiveFromISR(capture_done, &higher_task_woken);
+
+    return higher_task_woken == pdTRUE;
+}
+
+static void capture_init(void)
+{
+    capture_mutex = xSemaphoreCreateMutex();
+    capture_done = xSemaphoreCreateBinary();
+    urgent_done = xSemaphoreCreateBinary();
+
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = CAPTURE_FRAME_SIZE * CAPTURE_POOL_FRAMES,
+        .conv_frame_size = CAPTURE_FRAME_SIZE,
     };
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&conf, &adc_handle));
+    ESP_ERROR_CHECK(adc_continuous_new_handle(&handle_config, &capture_handle));
+
+    adc_continuous_evt_cbs_t cbs = {
+        .on_conv_done = on_capture_done,
+    };
+    ESP_ERROR_CHECK(adc_continuous_register_event_callbacks(capture_handle, &cbs, NULL));
+}
+
+// background capture is woken from waiting for its next frame, so it releases mutex at once
+static bool take_urgent(TickType_t timeout)
+{
+    portENTER_CRITICAL(&urgent_spinlock);
+    urgent_waiting++;
+    portEXIT_CRITICAL(&urgent_spinlock);
+
+    if (background_running) {
+        xSemaphoreGive(capture_done);
+    }
+    bool taken = xSemaphoreTake(capture_mutex, timeout) == pdTRUE;
+
+    portENTER_CRITICAL(&urgent_spinlock);
+    urgent_waiting--;
+    portEXIT_CRITICAL(&urgent_spinlock);
+    xSemaphoreGive(urgent_done);
+
+    return taken;
+}
+
+static esp_err_t capture(const adc_channel_t* channels, const adc_atten_t* attens, uint8_t channel_count, uint32_t sample_freq, uint16_t* samples, size_t count, bool background)
+{
+    if (channel_count == 0 || channel_count > ADC_CAPTURE_MAX_CHANNELS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (background) {
+        // urgent callers take mutex first, background capture then waits for them to finish
+        while (true) {
+            while (urgent_waiting) {
+                xSemaphoreTake(urgent_done, pdMS_TO_TICKS(CAPTURE_LOCK_MS) + 1);
+            }
+            xSemaphoreTake(capture_mutex, portMAX_DELAY);
+            if (!urgent_waiting) {
+                break;
+            }
+            xSemaphoreGive(capture_mutex);
+        }
+        background_running = true;
+    } else if (!take_urgent(pdMS_TO_TICKS(CAPTURE_LOCK_MS) + 1)) {
+        ESP_LOGW(TAG, "Capture failed: %s", esp_err_to_name(ESP_ERR_TIMEOUT));
+        return ESP_ERR_TIMEOUT;
+    }
+
+    adc_digi_pattern_config_t pattern[ADC_CAPTURE_MAX_CHANNELS];
+    for (uint8_t i = 0; i < channel_count; i++) {
+        pattern[i].atten = attens ? attens[i] : ADC_ATTEN_DB_12;
+        pattern[i].channel = channels[i];
+        pattern[i].unit = ADC_UNIT_1;
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+    adc_continuous_config_t config = {
+        .pattern_num = channel_count,
+        .adc_pattern = pattern,
+        .sample_freq_hz = sample_freq,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = CAPTURE_OUTPUT_TYPE,
+    };
+    esp_err_t ret = adc_continuous_config(capture_handle, &config);
+
+    if (ret == ESP_OK) {
+        xSemaphoreTake(capture_done, 0);
+
+        ret = adc_continuous_start(capture_handle);
+        if (ret == ESP_OK) {
+            uint32_t len = 0;
+
+            // discard frames completed after previous capture
+            while (adc_continuous_read(capture_handle, capture_frame, CAPTURE_FRAME_SIZE, &len, 0) == ESP_OK);
+
+            size_t counts[ADC_CAPTURE_MAX_CHANNELS] = { 0 };
+            size_t remaining = count * channel_count;
+            int64_t timeout_time = esp_timer_get_time() + (int64_t)remaining * 1000000 / sample_freq + CAPTURE_TIMEOUT_MS * 1000;
+
+            while (remaining > 0) {
+                int64_t timeout_us = timeout_time - esp_timer_get_time();
+                if (timeout_us <= 0 || xSemaphoreTake(capture_done, pdMS_TO_TICKS(timeout_us / 1000) + 1) != pdTRUE) {
+                    ret = ESP_ERR_TIMEOUT;
+                    break;
+                }
+                if (background && urgent_waiting) {
+                    ret = ESP_ERR_NOT_FINISHED;
+                    break;
+                }
 
-    bool calibrated = false;
+                while (remaining > 0 && adc_continuous_read(capture_handle, capture_frame, CAPTURE_FRAME_SIZE, &len, 0) == ESP_OK) {
+                    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+                        adc_digi_output_data_t* data = (adc_digi_output_data_t*)&capture_frame[i];
+                        for (uint8_t c = 0; c < channel_count; c++) {
+                            if (CAPTURE_GET_CHANNEL(data) == channels[c]) {
+                                if (counts[c] < count) {
+                                    samples[c * count + counts[c]++] = CAPTURE_GET_DATA(data) << CAPTURE_DATA_SHIFT;
+                                    remaining--;
+                                }
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+            adc_continuous_stop(capture_handle);
+        }
+    }
+
+    background_running = false;
+    xSemaphoreGive(capture_mutex);
+
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FINISHED) {
+        ESP_LOGW(TAG, "Capture failed: %s", esp_err_to_name(ret));
+    }
+
+    return ret;
+}
+
+esp_err_t adc_capture(const adc_channel_t* channels, const adc_atten_t* attens, uint8_t channel_count, uint32_t sample_freq, uint16_t* samples, size_t count)
+{
+    return capture(channels, attens, channel_count, sample_freq, samples, count, false);
+}
+
+esp_err_t adc_capture_background(const adc_channel_t* channels, const adc_atten_t* attens, uint8_t channel_count, uint32_t sample_freq, uint16_t* samples, size_t count)
+{
+    return capture(channels, attens, channel_count, sample_freq, samples, count, true);
+}
+
+esp_err_t adc_read(adc_channel_t channel, int* raw)
+{
+    take_urgent(portMAX_DELAY);
+    esp_err_t ret = adc_oneshot_read(adc_handle, channel, raw);
+    xSemaphoreGive(capture_mutex);
+
+    return ret;
+}
+
+static esp_err_t cali_create(adc_atten_t atten, adc_cali_handle_t* cali_handle)
+{
+    esp_err_t ret = ESP_ERR_NOT_SUPPORTED;
 
 #if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
-    if (!calibrated) {
-        ESP_LOGI(TAG, "Calibration scheme version is %s", "Curve Fitting");
+    if (ret != ESP_OK) {
         adc_cali_curve_fitting_config_t cali_config = {
             .unit_id = ADC_UNIT_1,
-            .atten = ADC_ATTEN_DB_12,
+            .atten = atten,
             .bitwidth = ADC_BITWIDTH_DEFAULT,
         };
-        if (adc_cali_create_scheme_curve_fitting(&cali_config, &adc_cali_handle) == ESP_OK) {
-            calibrated = true;
-        }
+        ret = adc_cali_create_scheme_curve_fitting(&cali_config, cali_handle);
     }
 #endif
 
 #if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
-    if (!calibrated) {
-        ESP_LOGI(TAG, "Calibration scheme version is %s", "Line Fitting");
+    if (ret != ESP_OK) {
         adc_cali_line_fitting_config_t cali_config = {
             .unit_id = ADC_UNIT_1,
-            .atten = ADC_ATTEN_DB_12,
+            .atten = atten,
             .bitwidth = ADC_BITWIDTH_DEFAULT,
 #if CONFIG_IDF_TARGET_ESP32
             .default_vref = 1100
 #endif
         };
-        if (adc_cali_create_scheme_line_fitting(&cali_config, &adc_cali_handle) == ESP_OK) {
-            calibrated = true;
-        }
+        ret = adc_cali_create_scheme_line_fitting(&cali_config, cali_handle);
     }
 #endif
 
-    if (!calibrated) {
+    return ret;
+}
+
+void adc_init(void)
+{
+    adc_oneshot_unit_init_cfg_t conf = {
+        .unit_id = ADC_UNIT_1,
+        .clk_src = ADC_DIGI_CLK_SRC_DEFAULT,
+        .ulp_mode = ADC_ULP_MODE_DISABLE,
+    };
+    ESP_ERROR_CHECK(adc_oneshot_new_unit(&conf, &adc_handle));
+
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    ESP_LOGI(TAG, "Calibration scheme version is %s", "Curve Fitting");
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    ESP_LOGI(TAG, "Calibration scheme version is %s", "Line Fitting");
+#endif
+
+    if (cali_create(ADC_ATTEN_DB_12, &adc_cali_handle) != ESP_OK) {
         ESP_LOGE(TAG, "No calibration scheme");
         ESP_ERROR_CHECK(ESP_FAIL);
     }
+    lut_init(ADC_ATTEN_DB_12, adc_cali_handle);
+    calibrated[ADC_ATTEN_DB_12] = true;
+
+    // lower attenuations are used only by capture, converted with LUT
+    for (adc_atten_t atten = ADC_ATTEN_DB_0; atten < ADC_ATTEN_DB_12; atten++) {
+        adc_cali_handle_t cali_handle;
+        if (cali_create(atten, &cali_handle) == ESP_OK) {
+            lut_init(atten, cali_handle);
+            calibrated[atten] = true;
+        } else {
+            ESP_LOGW(TAG, "No calibration for attenuation %d", atten);
+        }
+    }
+
+    capture_init();
 }
\ No newline at end of file
@@ -1,14 +1,105 @@
 #ifndef ADC_H_
 #define ADC_H_
 
+#include <stddef.h>
+#include <stdbool.h>
+#include "soc/soc_caps.h"
 #include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
 
+#define ADC_CAPTURE_MAX_CHANNELS    8
+
+#define ADC_RAW_MAX             ((1 << SOC_ADC_RTC_MAX_BITWIDTH) - 1)
+
+// full scale of captured samples, below ADC_RAW_MAX when continuous mode bitwidth is lower than oneshot
+#define ADC_CAPTURE_RAW_MAX     (((1 << SOC_ADC_DIGI_MAX_BITWIDTH) - 1) << (SOC_ADC_RTC_MAX_BITWIDTH - SOC_ADC_DIGI_MAX_BITWIDTH))
+
 extern adc_oneshot_unit_handle_t adc_handle;
 
 extern adc_cali_handle_t adc_cali_handle;
 
 void adc_init(void);
 
-#endif /* ADC_H_ */
\ No newline at end of file
+/**
+ * @brief Capture samples from ADC1 channels using continuous mode DMA, calling task is blocked until all samples are captured.
+ * Channels are sampled interleaved, captures and adc_read calls are serialized.
+ * Running background capture is stopped, other captures are waited for up to 5ms
+ *
+ * @param channels
+ * @param attens attenuation per channel, NULL for ADC_ATTEN_DB_12
+ * @param channel_count up to ADC_CAPTURE_MAX_CHANNELS
+ * @param sample_freq conversions per second of all channels
+ * @param samples buffer of count * channel_count raw values with same bitwidth as adc_cali_handle, stored per channel: samples[channel_index * count + sample_index]
+ * @param count number of samples per channel
+ * @return esp_err_t ESP_ERR_TIMEOUT when other capture did not finish in time
+ */
+esp_err_t adc_capture(const adc_channel_t* channels, const adc_atten_t* attens, uint8_t channel_count, uint32_t sample_freq, uint16_t* samples, size_t count);
+
+/**
+ * @brief Capture samples as adc_capture, for long windows of lower priority than other adc users.
+ * Capture is stopped when adc_capture or adc_read is called meanwhile
+ *
+ * @param channels
+ * @param attens attenuation per channel, NULL for ADC_ATTEN_DB_12
+ * @param channel_count up to ADC_CAPTURE_MAX_CHANNELS
+ * @param sample_freq conversions per second of all channels
+ * @param samples buffer of count * channel_count raw values, stored as in adc_capture
+ * @param count number of samples per channel
+ * @return esp_err_t ESP_ERR_NOT_FINISHED when stopped for other adc user, to be retried
+ */
+esp_err_t adc_capture_background(const adc_channel_t* channels, const adc_atten_t* attens, uint8_t channel_count, uint32_t sample_freq, uint16_t* samples, size_t count);
+
+/**
+ * @brief Read ADC1 channel in oneshot mode, waits while capture is running, background capture is stopped
+ *
+ * @param channel
+ * @param raw
+ * @return esp_err_t
+ */
+esp_err_t adc_read(adc_channel_t channel, int* raw);
+
+/**
+ * @brief Convert raw value to voltage, using lookup table built from adc_cali_handle at init
+ *
+ * @param raw
+ * @return int voltage in mV
+ */
+int adc_raw_to_voltage(int raw);
+
+/**
+ * @brief Convert raw value captured with attenuation to voltage, using lookup table built at init
+ *
+ * @param atten calibrated attenuation
+ * @param raw
+ * @return int voltage in mV
+ */
+int adc_atten_raw_to_voltage(adc_atten_t atten, int raw);
+
+/**
+ * @brief Attenuation has calibration, ADC_ATTEN_DB_12 always has
+ *
+ * @param atten
+ * @return true
+ * @return false
+ */
+bool adc_atten_is_calibrated(adc_atten_t atten);
+
+/**
+ * @brief Get upper limit of recommended input range of attenuation
+ *
+ * @param atten
+ * @return int voltage in mV
+ */
+int adc_atten_get_max_voltage(adc_atten_t atten);
+
+/**
+ * @brief Convert voltage to lowest raw value which is converted to voltage or above, for comparing thresholds on raw values
+ *
+ * @param voltage in mV
+ * @return int raw value
+ */
+int adc_voltage_to_raw(int voltage);
+
+#endif /* ADC_H_ */
@@ -199,12 +199,11 @@ esp_err_t aux_analog_read(const char* name, int* value)
     for (int i = 0; i < aux_ain_count; i++) {
         if (strcmp(aux_ain[i].name, name) == 0) {
             int raw = 0;
-            esp_err_t ret = adc_oneshot_read(adc_handle, aux_ain[i].adc, &raw);
+            esp_err_t ret = adc_read(aux_ain[i].adc, &raw);
             if (ret == ESP_OK) {
-                return adc_cali_raw_to_voltage(adc_cali_handle, raw, value);
-            } else {
-                return ret;
+                *value = adc_raw_to_voltage(raw);
             }
+            return ret;
         }
     }
     return ESP_ERR_NOT_FOUND;
@@ -1,6 +1,8 @@
 #include <memory.h>
 #include <math.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_timer.h"
@@ -11,54 +13,177 @@
 #include "energy_meter.h"
 #include "board_config.h"
 #include "adc.h"
+#include "power_quality.h"
 
 #define NVS_NAMESPACE           "evse_emeter"
 #define NVS_MODE                "mode"
 #define NVS_AC_VOLTAGE          "ac_voltage"
 #define NVS_three_phases         "three_phases"
+#define NVS_ZEROS               "zeros"
+#define NVS_HARMONICS_INTERVAL  "harm_interval"
+#define NVS_TOTAL_CONSUMPTION   "total_cons"
 
 #define ZERO_FIX                5000
-#define MEASURE_US              40000   //2 periods at 50Hz
+#define SLOPE_MIN_SPAN          512             // raw, calibration slope is taken at least this far around zero
+#define SAMPLE_FREQ             40000   // conversions per second of all channels
+#define WINDOW_MS               40      // contains at least 1 full period from 45Hz to 65Hz
+#define WINDOW_SAMPLES          (SAMPLE_FREQ * WINDOW_MS / 1000)
+#define CAPTURE_RETRY_MAX       5               // window captures stopped for pilot capture are restarted right after it
+#define MWH_US                  3600000000LL    // mW*us in 1 mWh
+#define TOTAL_SAVE_STEP         100000          // mWh, total consumption is written to NVS after this increase
+#define LINE_FREQ               50              // Hz, harmonics are analysed at multiples when frequency is not measured
+#define FREQ_MIN                40              // Hz
+#define FREQ_MAX                70              // Hz
+#define ZC_HYST                 32              // raw, zero crossing hysteresis
+#define HARMONICS_MIN_CUR       0.5f            // A, THD is not computed below this fundamental current
+#define ZERO_CHECK_MS           60000           // zeros are measured again after this idle time
+#define ZERO_SAVE_MV            1               // cached zeros are updated when measured zero differs more
+#define ZERO_DRIFT_MV           25              // drift alarm when measured zero differs more from zero in use
+#define EXTERNAL_TIMEOUT_US     5000000         // external meter values older than this are discarded
+#define RANGE_UP_PERCENT        95              // of attenuation input range, higher attenuation is used when current peak is above
+#define RANGE_DOWN_PERCENT      75              // lower attenuation is used when current peak stays below
+#define RANGE_DOWN_WINDOWS      25              // windows below lower range before switching
 
 
 static const char* TAG = "energy_meter";
 
 static nvs_handle nvs;
 
+static SemaphoreHandle_t mutex;
+
 static energy_meter_mode_t mode = ENERGY_METER_MODE_DUMMY;
 
 static uint16_t ac_voltage = 250;
 
 static bool three_phases = false;
 
-static uint16_t power = 0;
+static uint16_t power = 0;         // W, active
+
+static uint16_t va_power = 0;      // VA
+
+static uint32_t power_mw = 0;      // mW, active, full resolution for consumption
 
 static bool has_session = false;
 
 static int64_t start_time = 0;
 
-static uint32_t charging_time = 0;  // ms
+static int64_t charging_time = 0;   // us
+
+static uint64_t consumption = 0;    // mWh
+
+static int64_t consumption_rem = 0; // mW*us, remainder below 1 mWh
+
+static int64_t counters_time = 0;   // us, when consumption and charging time was updated
+
+static uint64_t total_consumption = 0;  // mWh, lifetime
+
+static uint64_t total_saved = 0;        // mWh, last written to NVS, accessed only by meter task
+
+static bool total_save_pending = false; // session ended, total is written by meter task
 
-static uint32_t consumption = 0;    // Ws
 
 static float cur[3] = { 0, 0, 0 };
 
 static float vlt[3] = { 0, 0, 0 };
 
-static float cur_sens_zero[3] = { 0, 0, 0 };
+static float act_power[3] = { 0, 0, 0 };
+
+static float frequency = 0;         // Hz
 
-static float vlt_sens_zero[3] = { 0, 0, 0 };
+static float app_power[3] = { 0, 0, 0 };
+
+static int32_t cur_sens_zero[3] = { 0, 0, 0 };   // raw, Q16
+
+static int32_t vlt_sens_zero[3] = { 0, 0, 0 };   // raw, Q16
+
+static int32_t saved_cur_zero[3] = { 0, 0, 0 };  // raw, Q16, cached in NVS
+
+static int32_t saved_vlt_zero[3] = { 0, 0, 0 };  // raw, Q16, cached in NVS
+
+static volatile bool zero_drift = false;
+
+static adc_atten_t cur_atten[3] = { ADC_ATTEN_DB_12, ADC_ATTEN_DB_12, ADC_ATTEN_DB_12 };
+
+static int32_t cur_db12_zero[3] = { 0, 0, 0 };  // raw, Q16, zero at ADC_ATTEN_DB_12 while lower attenuation is used
+
+static uint8_t cur_range_down[3] = { 0, 0, 0 };  // windows below lower range
+
+static bool cur_rezero[3] = { false, false, false };  // zero is measured from first window after attenuation change
+
+// zeros cached in NVS are used only with same channels
+typedef struct
+{
+    adc_channel_t channels[6];
+    uint8_t channel_count;
+    int32_t cur[3];
+    int32_t vlt[3];
+} zero_cache_t;
+
+static uint16_t harmonics_interval = 10;   // s
+
+static int64_t harmonics_time = 0;
+
+static float cur_thd[3] = { 0, 0, 0 };
+
+static float cur_harmonics[3][ENERGY_METER_HARMONICS];
+
+static portMUX_TYPE harmonics_spinlock = portMUX_INITIALIZER_UNLOCKED;
 
 static int64_t prev_time = 0;
 
+static TaskHandle_t sampler_task = NULL;
+
+static volatile bool sampling = false;
+
+static uint16_t window_buf[WINDOW_SAMPLES];
+
+static struct window_s
+{
+    float cur[3];
+    float vlt[3];
+    float power[3];     // active
+    float freq;         // Hz, 0 when not measured
+    uint16_t samples;   // per channel, integer number of periods when frequency is measured
+} windows[2];
+
+static volatile uint8_t window_index = 0;  // finished window
+
+static portMUX_TYPE window_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static energy_meter_external_t external;
+
+static int64_t external_time = 0;
+
+static portMUX_TYPE external_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool external_has_energy = false;
+
+static uint64_t external_energy = 0;        // mWh, meter total of last measure
+
+static bool external_energy_based = false;  // session consumption is counted from meter total, guarded by mutex
+
+static uint64_t external_energy_prev = 0;   // mWh, meter total counted to session, guarded by mutex
+
 static void (*measure_fn)(uint32_t delta_ms, uint16_t charging_current);
 
-static void set_calc_va_power(uint32_t delta_ms)
+// without sampled voltage active power is equal to apparent power
+static void set_calc_power(bool has_act_power)
 {
-    float va = (vlt[0] * cur[0]) + (vlt[1] * cur[1]) + (vlt[2] * cur[2]);
+    float total_act = 0;
+    float total_app = 0;
 
-    consumption += roundf((va * delta_ms) / 1000.0f);
-    power = roundf(va);
+    for (int i = 0; i < 3; i++) {
+        app_power[i] = vlt[i] * cur[i];
+        if (!has_act_power) {
+            act_power[i] = app_power[i];
+        }
+        total_act += act_power[i];
+        total_app += app_power[i];
+    }
+
+    power_mw = roundf(MAX(total_act, 0) * 1000);
+    power = roundf(power_mw / 1000.0f);
+    va_power = roundf(total_app);
 }
 
 static void measure_dummy(uint32_t delta_ms, uint16_t charging_current)
@@ -74,218 +199,661 @@ static void measure_dummy(uint32_t delta_ms, uint16_t charging_current)
         vlt[1] = vlt[2] = 0;
     }
 
-    set_calc_va_power(delta_ms);
+    frequency = 0;
+
+    set_calc_power(false);
 }
 
-static uint32_t read_adc(adc_channel_t channel)
+static uint8_t get_channels(adc_channel_t* channels, bool with_vlt)
 {
-    int adc_reading = 0;
-    adc_oneshot_read(adc_handle, channel, &adc_reading);
-    adc_cali_raw_to_voltage(adc_cali_handle, adc_reading, &adc_reading);
-    return adc_reading;
+    uint8_t count = 0;
+
+    channels[count++] = board_config.energy_meter_l1_cur_adc_channel;
+    if (board_config.energy_meter_three_phases) {
+        channels[count++] = board_config.energy_meter_l2_cur_adc_channel;
+        channels[count++] = board_config.energy_meter_l3_cur_adc_channel;
+    }
+
+    if (with_vlt) {
+        channels[count++] = board_config.energy_meter_l1_vlt_adc_channel;
+        if (board_config.energy_meter_three_phases) {
+            channels[count++] = board_config.energy_meter_l2_vlt_adc_channel;
+            channels[count++] = board_config.energy_meter_l3_vlt_adc_channel;
+        }
+    }
+
+    return count;
 }
 
-static float get_zero(adc_channel_t channel)
+static int32_t get_zero(const uint16_t* samples, size_t count)
 {
-    float sum = 0;
-    uint16_t samples = 0;
+    uint32_t sum = 0;
 
-    for (int64_t start_time = esp_timer_get_time(); esp_timer_get_time() - start_time < MEASURE_US; samples++) {
-        sum += read_adc(channel);
+    for (size_t i = 0; i < count; i++) {
+        sum += samples[i];
     }
 
-    return sum / samples;
+    return ((int64_t)sum << 16) / count;
 }
 
-static void measure_single_phase_cur(uint32_t delta_ms, uint16_t charging_current)
+// zero crossings with hysteresis, span from first crossing to last crossing in same direction covers integer number of periods
+static float get_period_span(const uint16_t* samples, size_t count, int32_t zero, float sample_freq, size_t* start, size_t* span)
 {
-    float cur_sum = 0;
-    uint16_t samples = 0;
-    uint32_t sample_cur;
-    float filtered_cur;
-    for (int64_t start_time = esp_timer_get_time(); esp_timer_get_time() - start_time < MEASURE_US; samples++) {
-        sample_cur = read_adc(board_config.energy_meter_l1_cur_adc_channel);
+    int32_t zero_raw = (zero + (1 << 15)) >> 16;
+    int8_t side = 0;
+    int8_t dir = 0;
+    size_t last_below = 0;
+    size_t last_above = 0;
+    size_t first = 0;
+    size_t last = 0;
+    float first_time = 0;
+    float last_time = 0;
+    uint16_t periods = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t d = samples[i] - zero_raw;
+        if (d <= 0) {
+            last_below = i;
+        }
+        if (d >= 0) {
+            last_above = i;
+        }
 
-        cur_sens_zero[0] += (sample_cur - cur_sens_zero[0]) / ZERO_FIX;
-        filtered_cur = sample_cur - cur_sens_zero[0];
-        cur_sum += filtered_cur * filtered_cur;
+        int8_t new_side = d > ZC_HYST ? 1 : (d < -ZC_HYST ? -1 : side);
+        if (side != 0 && new_side != side) {
+            // zero is between last sample on previous side and next sample
+            size_t j = new_side > 0 ? last_below : last_above;
+            int32_t d0 = samples[j] - zero_raw;
+            int32_t d1 = samples[j + 1] - zero_raw;
+            float time = j + (float)d0 / (d0 - d1);
+
+            if (dir == 0) {
+                dir = new_side;
+                first = j + 1;
+                first_time = time;
+            } else if (new_side == dir) {
+                last = j + 1;
+                last_time = time;
+                periods++;
+            }
+        }
+        side = new_side;
     }
 
-    cur[0] = sqrt(cur_sum / samples) * board_config.energy_meter_cur_scale;
-    vlt[0] = ac_voltage;
-    if (three_phases) {
-        vlt[1] = vlt[2] = vlt[0];
-        cur[1] = cur[2] = cur[0];
-    } else {
-        vlt[1] = vlt[2] = 0;
-        cur[1] = cur[2] = 0;
+    float freq = periods > 0 ? periods * sample_freq / (last_time - first_time) : 0;
+    if (freq < FREQ_MIN || freq > FREQ_MAX) {
+        *start = 0;
+        *span = count;
+        return 0;
     }
 
-    ESP_LOGD(TAG, "Current %f (samples %d)", cur[0], samples);
+    *start = first;
+    *span = last - first;
+    return freq;
+}
+
+static float atten_zero_to_voltage(adc_atten_t atten, int32_t zero)
+{
+    int v0 = adc_atten_raw_to_voltage(atten, zero >> 16);
+    int v1 = adc_atten_raw_to_voltage(atten, (zero >> 16) + 1);
 
-    set_calc_va_power(delta_ms);
+    return v0 + ((v1 - v0) * (zero & 0xffff)) / 65536.0f;
 }
 
-static void measure_single_phase_cur_vlt(uint32_t delta_ms, uint16_t charging_current)
+static float zero_to_voltage(int32_t zero)
 {
-    float cur_sum = 0;
-    float vlt_sum = 0;
-    uint32_t sample_cur;
-    uint32_t sample_vlt;
-    float filtered_cur;
-    float filtered_vlt;
-    uint16_t samples = 0;
+    return atten_zero_to_voltage(ADC_ATTEN_DB_12, zero);
+}
 
-    for (int64_t start_time = esp_timer_get_time(); esp_timer_get_time() - start_time < MEASURE_US; samples++) {
-        sample_cur = read_adc(board_config.energy_meter_l1_cur_adc_channel);
-        sample_vlt = read_adc(board_config.energy_meter_l1_vlt_adc_channel);
+static int32_t voltage_to_zero(adc_atten_t atten, float voltage)
+{
+    int lo = 0;
+    int hi = ADC_RAW_MAX;
+
+    // last raw value converted to voltage or below, lut is monotonic
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (adc_atten_raw_to_voltage(atten, mid) <= voltage) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    int v0 = adc_atten_raw_to_voltage(atten, lo);
+    int v1 = adc_atten_raw_to_voltage(atten, lo + 1);
+    float frac = v1 > v0 ? MIN(MAX((voltage - v0) / (v1 - v0), 0), 1) : 0;
+
+    return (lo << 16) + (int32_t)(frac * 65535);
+}
 
-        cur_sens_zero[0] += (sample_cur - cur_sens_zero[0]) / ZERO_FIX;
-        filtered_cur = sample_cur - cur_sens_zero[0];
-        cur_sum += filtered_cur * filtered_cur;
+static bool has_vlt_sens(void)
+{
+    return board_config.energy_meter == BOARD_CONFIG_ENERGY_METER_CUR_VLT;
+}
+
+// pilot capture stops window capture, restarted capture then fits before next pilot measure
+static esp_err_t capture_window(const adc_channel_t* channels, const adc_atten_t* attens, uint8_t channel_count, size_t count)
+{
+    esp_err_t err = ESP_ERR_NOT_FINISHED;
 
-        vlt_sens_zero[0] += (sample_vlt - vlt_sens_zero[0]) / ZERO_FIX;
-        filtered_vlt = sample_vlt - vlt_sens_zero[0];
-        vlt_sum += filtered_vlt * filtered_vlt;
+    for (uint8_t i = 0; i < CAPTURE_RETRY_MAX && err == ESP_ERR_NOT_FINISHED; i++) {
+        err = adc_capture_background(channels, attens, channel_count, SAMPLE_FREQ, window_buf, count);
     }
 
-    cur[0] = sqrt(cur_sum / samples) * board_config.energy_meter_cur_scale;
-    vlt[0] = sqrt(vlt_sum / samples) * board_config.energy_meter_vlt_scale;
-    if (three_phases) {
-        cur[1] = cur[2] = cur[0];
-        vlt[1] = vlt[2] = vlt[0];
-    } else {
-        cur[1] = cur[2] = 0;
-        vlt[1] = vlt[2] = 0;
+    return err;
+}
+
+static esp_err_t measure_zeros(int32_t* cur_zero, int32_t* vlt_zero)
+{
+    bool with_vlt = has_vlt_sens();
+    uint8_t phases = board_config.energy_meter_three_phases ? 3 : 1;
+    adc_channel_t channels[6];
+    uint8_t channel_count = get_channels(channels, with_vlt);
+    size_t count = WINDOW_SAMPLES / channel_count;
+
+    esp_err_t err = capture_window(channels, NULL, channel_count, count);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // mean over integer number of periods, crossings are found around mean of whole window
+    const uint16_t* ref_samples = &window_buf[with_vlt ? phases * count : 0];
+    size_t start;
+    size_t span;
+    get_period_span(ref_samples, count, get_zero(ref_samples, count), (float)SAMPLE_FREQ / channel_count, &start, &span);
+
+    for (uint8_t p = 0; p < phases; p++) {
+        cur_zero[p] = get_zero(&window_buf[p * count + start], span);
+        if (with_vlt) {
+            vlt_zero[p] = get_zero(&window_buf[(phases + p) * count + start], span);
+        }
+    }
+
+    return ESP_OK;
+}
+
+static bool load_zeros(void)
+{
+    zero_cache_t cache;
+    size_t size = sizeof(cache);
+    adc_channel_t channels[6];
+    uint8_t channel_count = get_channels(channels, has_vlt_sens());
+
+    if (nvs_get_blob(nvs, NVS_ZEROS, &cache, &size) != ESP_OK || size != sizeof(cache)) {
+        return false;
+    }
+
+    if (cache.channel_count != channel_count || memcmp(cache.channels, channels, channel_count * sizeof(adc_channel_t))) {
+        return false;
     }
 
-    ESP_LOGD(TAG, "Current %f (samples %d)", cur[0], samples);
-    ESP_LOGD(TAG, "Voltage %f (samples %d)", vlt[0], samples);
+    memcpy(cur_sens_zero, cache.cur, sizeof(cur_sens_zero));
+    memcpy(vlt_sens_zero, cache.vlt, sizeof(vlt_sens_zero));
+    memcpy(saved_cur_zero, cache.cur, sizeof(saved_cur_zero));
+    memcpy(saved_vlt_zero, cache.vlt, sizeof(saved_vlt_zero));
 
-    set_calc_va_power(delta_ms);
+    return true;
 }
 
-static void measure_three_phases_cur(uint32_t delta_ms, uint16_t charging_current)
+static void save_zeros(void)
 {
-    float cur_sum[3] = { 0, 0, 0 };
-    uint32_t sample_cur;
-    float filtered_cur;
-    uint16_t samples = 0;
-    for (int64_t start_time = esp_timer_get_time(); esp_timer_get_time() - start_time < MEASURE_US; samples++) {
-        //L1
-        sample_cur = read_adc(board_config.energy_meter_l1_cur_adc_channel);
+    zero_cache_t cache = { 0 };
 
-        cur_sens_zero[0] += (sample_cur - cur_sens_zero[0]) / ZERO_FIX;
-        filtered_cur = sample_cur - cur_sens_zero[0];
-        cur_sum[0] += filtered_cur * filtered_cur;
+    cache.channel_count = get_channels(cache.channels, has_vlt_sens());
+    memcpy(cache.cur, cur_sens_zero, sizeof(cache.cur));
+    memcpy(cache.vlt, vlt_sens_zero, sizeof(cache.vlt));
+
+    nvs_set_blob(nvs, NVS_ZEROS, &cache, sizeof(cache));
+    nvs_commit(nvs);
 
-        if (three_phases) {
-            //L2
-            sample_cur = read_adc(board_config.energy_meter_l2_cur_adc_channel);
+    memcpy(saved_cur_zero, cur_sens_zero, sizeof(saved_cur_zero));
+    memcpy(saved_vlt_zero, vlt_sens_zero, sizeof(saved_vlt_zero));
+}
 
-            cur_sens_zero[1] += (sample_cur - cur_sens_zero[1]) / ZERO_FIX;
-            filtered_cur = sample_cur - cur_sens_zero[1];
-            cur_sum[1] += filtered_cur * filtered_cur;
+static float get_zero_diff(int32_t a, int32_t b)
+{
+    return fabsf(zero_to_voltage(a) - zero_to_voltage(b));
+}
 
-            //L3
-            sample_cur = read_adc(board_config.energy_meter_l3_cur_adc_channel);
+// while idle no current flows, zeros measured from one window replace tracked zeros
+static void check_zeros(void)
+{
+    int32_t cur_zero[3] = { 0, 0, 0 };
+    int32_t vlt_zero[3] = { 0, 0, 0 };
+    float max_drift = 0;
+    float max_diff = 0;
 
-            cur_sens_zero[2] += (sample_cur - cur_sens_zero[2]) / ZERO_FIX;
-            filtered_cur = sample_cur - cur_sens_zero[2];
-            cur_sum[2] += filtered_cur * filtered_cur;
+    if (measure_zeros(cur_zero, vlt_zero) != ESP_OK) {
+        return;
+    }
+
+    for (uint8_t p = 0; p < 3; p++) {
+        max_drift = MAX(max_drift, MAX(get_zero_diff(cur_zero[p], cur_sens_zero[p]), get_zero_diff(vlt_zero[p], vlt_sens_zero[p])));
+        max_diff = MAX(max_diff, MAX(get_zero_diff(cur_zero[p], saved_cur_zero[p]), get_zero_diff(vlt_zero[p], saved_vlt_zero[p])));
+    }
+
+    if (max_drift > ZERO_DRIFT_MV) {
+        if (!zero_drift) {
+            ESP_LOGW(TAG, "Zero drift %fmV", max_drift);
         }
+        zero_drift = true;
     }
 
-    cur[0] = sqrt(cur_sum[0] / samples) * board_config.energy_meter_cur_scale;
-    vlt[0] = ac_voltage;
-    if (three_phases) {
-        cur[1] = sqrt(cur_sum[1] / samples) * board_config.energy_meter_cur_scale;
-        cur[2] = sqrt(cur_sum[2] / samples) * board_config.energy_meter_cur_scale;
-        vlt[1] = vlt[2] = ac_voltage;
+    memcpy(cur_sens_zero, cur_zero, sizeof(cur_sens_zero));
+    memcpy(vlt_sens_zero, vlt_zero, sizeof(vlt_sens_zero));
+
+    if (max_diff > ZERO_SAVE_MV) {
+        ESP_LOGD(TAG, "Saving zeros, changed %fmV", max_diff);
+        save_zeros();
+    }
+}
+
+// mean of instantaneous product around zeros, in raw^2, samples are accumulated as integers
+static float get_mean_product(const uint16_t* a, int32_t zero_a, const uint16_t* b, int32_t zero_b, size_t count)
+{
+    int32_t zero_a_raw = (zero_a + (1 << 15)) >> 16;
+    int32_t zero_b_raw = (zero_b + (1 << 15)) >> 16;
+    int32_t sum_a = 0;
+    int32_t sum_b = 0;
+    int64_t sum_ab = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t da = a[i] - zero_a_raw;
+        int32_t db = b[i] - zero_b_raw;
+        sum_a += da;
+        sum_b += db;
+        sum_ab += da * db;
+    }
+
+    // correct rounding of zeros: mean of (da - ra)(db - rb) = mean of da*db - rb * mean of da - ra * mean of db + ra*rb
+    float ra = (zero_a - (zero_a_raw << 16)) / 65536.0f;
+    float rb = (zero_b - (zero_b_raw << 16)) / 65536.0f;
+
+    return ((float)sum_ab - rb * sum_a - ra * sum_b) / count + ra * rb;
+}
+
+// rms in mV around zero, samples are accumulated as integers, calibration is applied once per window
+static float get_rms(const uint16_t* samples, size_t count, adc_atten_t atten, int32_t* zero, float* slope)
+{
+    int32_t zero_raw = (*zero + (1 << 15)) >> 16;
+    int32_t sum = 0;
+    uint64_t sum_sq = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t d = samples[i] - zero_raw;
+        sum += d;
+        sum_sq += (uint32_t)(d * d);
+    }
+
+    // correct rounding of zero: mean of (d - r)^2 = mean of d^2 - 2r * mean of d + r^2
+    float r = (*zero - (zero_raw << 16)) / 65536.0f;
+    float mean = (float)sum / count;
+    float mean_sq = (float)sum_sq / count - 2 * r * mean + r * r;
+    float rms = mean_sq > 0 ? sqrtf(mean_sq) : 0;
+
+    // calibration slope around zero over signal peak range, not narrower than SLOPE_MIN_SPAN as calibration is in whole mV
+    int32_t span = MAX((int32_t)(rms * M_SQRT2), SLOPE_MIN_SPAN);
+    int32_t lo = MAX(zero_raw - span, 0);
+    int32_t hi = MIN(zero_raw + span, ADC_RAW_MAX);
+    *slope = hi > lo ? (float)(adc_atten_raw_to_voltage(atten, hi) - adc_atten_raw_to_voltage(atten, lo)) / (hi - lo) : 0;
+
+    // slow zero tracking, per window equivalent of 1/ZERO_FIX per sample filter
+    int32_t window_mean = (zero_raw << 16) + ((int64_t)sum << 16) / (int32_t)count;
+    *zero += ((int64_t)(window_mean - *zero) * (int64_t)count) / ZERO_FIX;
+
+    return rms * *slope;
+}
+
+static uint16_t get_max(const uint16_t* samples, size_t count)
+{
+    uint16_t max = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        max = MAX(max, samples[i]);
+    }
+
+    return max;
+}
+
+// zero is kept in raw units of attenuation in use, zero at ADC_ATTEN_DB_12 is restored unchanged
+static void set_cur_atten(uint8_t p, adc_atten_t atten)
+{
+    if (cur_atten[p] == ADC_ATTEN_DB_12) {
+        cur_db12_zero[p] = cur_sens_zero[p];
+    }
+
+    if (atten == ADC_ATTEN_DB_12) {
+        cur_sens_zero[p] = cur_db12_zero[p];
+        cur_rezero[p] = false;
     } else {
-        cur[1] = cur[2] = 0;
-        vlt[1] = vlt[2] = 0;
+        cur_sens_zero[p] = voltage_to_zero(atten, atten_zero_to_voltage(cur_atten[p], cur_sens_zero[p]));
+        cur_rezero[p] = true;
+    }
+
+    ESP_LOGD(TAG, "L%d current attenuation %d -> %d", p + 1, cur_atten[p], atten);
+
+    cur_atten[p] = atten;
+    cur_range_down[p] = 0;
+}
+
+// lowest calibrated attenuation above from, where peak is below RANGE_DOWN_PERCENT of input range
+static adc_atten_t get_fitting_atten(adc_atten_t from, int peak)
+{
+    for (adc_atten_t atten = from; atten < ADC_ATTEN_DB_12; atten++) {
+        if (adc_atten_is_calibrated(atten) && peak <= adc_atten_get_max_voltage(atten) * RANGE_DOWN_PERCENT / 100) {
+            return atten;
+        }
+    }
+
+    return ADC_ATTEN_DB_12;
+}
+
+// attenuation is increased at once when current peak nears end of range, decreased when peak stays low
+static void update_cur_range(uint8_t p, uint16_t max_raw)
+{
+    adc_atten_t atten = cur_atten[p];
+    int peak = adc_atten_raw_to_voltage(atten, max_raw);
+
+    if (atten < ADC_ATTEN_DB_12 && (max_raw >= ADC_CAPTURE_RAW_MAX || peak > adc_atten_get_max_voltage(atten) * RANGE_UP_PERCENT / 100)) {
+        set_cur_atten(p, max_raw >= ADC_CAPTURE_RAW_MAX ? ADC_ATTEN_DB_12 : get_fitting_atten(atten + 1, peak));
+        return;
     }
 
-    ESP_LOGD(TAG, "Currents %f %f %f (samples %d)", cur[0], cur[1], cur[2], samples);
+    adc_atten_t lower = get_fitting_atten(ADC_ATTEN_DB_0, peak);
+    if (lower < atten) {
+        if (++cur_range_down[p] >= RANGE_DOWN_WINDOWS) {
+            set_cur_atten(p, lower);
+        }
+    } else {
+        cur_range_down[p] = 0;
+    }
+}
 
-    set_calc_va_power(delta_ms);
+static void reset_cur_ranges(void)
+{
+    for (uint8_t p = 0; p < 3; p++) {
+        if (cur_atten[p] != ADC_ATTEN_DB_12) {
+            set_cur_atten(p, ADC_ATTEN_DB_12);
+        }
+        cur_range_down[p] = 0;
+    }
 }
 
-static void measure_three_phases_cur_vlt(uint32_t delta_ms, uint16_t charging_current)
+// lowest and highest rms of one cycle, refreshed every half cycle over whole window, in raw units
+static void get_cycle_rms_range(const uint16_t* samples, size_t count, int32_t zero, size_t cycle, float* min, float* max)
 {
-    float cur_sum[3] = { 0, 0, 0 };
-    float vlt_sum[3] = { 0, 0, 0 };
-    uint32_t sample_cur;
-    uint32_t sample_vlt;
-    float filtered_cur;
-    float filtered_vlt;
-    uint16_t samples = 0;
-    for (int64_t start_time = esp_timer_get_time(); esp_timer_get_time() - start_time < MEASURE_US; samples++) {
-        //L1
-        sample_cur = read_adc(board_config.energy_meter_l1_cur_adc_channel);
-        sample_vlt = read_adc(board_config.energy_meter_l1_vlt_adc_channel);
+    int32_t zero_raw = (zero + (1 << 15)) >> 16;
+    float r = (zero - (zero_raw << 16)) / 65536.0f;
+    size_t half = MAX(cycle / 2, 1);
+
+    cycle = MIN(cycle, count);
+    *min = INFINITY;
+    *max = 0;
+    for (size_t start = 0; start < count; start += half) {
+        // last cycle ends at end of window
+        if (start + cycle > count) {
+            start = count - cycle;
+        }
+
+        int32_t sum = 0;
+        uint64_t sum_sq = 0;
+        for (size_t i = start; i < start + cycle; i++) {
+            int32_t d = samples[i] - zero_raw;
+            sum += d;
+            sum_sq += (uint32_t)(d * d);
+        }
 
-        cur_sens_zero[0] += (sample_cur - cur_sens_zero[0]) / ZERO_FIX;
-        filtered_cur = sample_cur - cur_sens_zero[0];
-        cur_sum[0] += filtered_cur * filtered_cur;
+        float mean_sq = (float)sum_sq / cycle - 2 * r * sum / cycle + r * r;
+        float rms = mean_sq > 0 ? sqrtf(mean_sq) : 0;
+        *min = MIN(*min, rms);
+        *max = MAX(*max, rms);
 
-        vlt_sens_zero[0] += (sample_vlt - vlt_sens_zero[0]) / ZERO_FIX;
-        filtered_vlt = sample_vlt - vlt_sens_zero[0];
-        vlt_sum[0] += filtered_vlt * filtered_vlt;
+        if (start + cycle >= count) {
+            break;
+        }
+    }
+}
 
-        if (three_phases) {
-            //L2
-            sample_cur = read_adc(board_config.energy_meter_l2_cur_adc_channel);
-            sample_vlt = read_adc(board_config.energy_meter_l2_vlt_adc_channel);
+// Goertzel filter at each harmonic of line frequency, rms in raw units
+static void get_harmonics(const uint16_t* samples, size_t count, int32_t zero, float sample_freq, float line_freq, float* harmonics)
+{
+    float z = zero / 65536.0f;
 
-            cur_sens_zero[1] += (sample_cur - cur_sens_zero[1]) / ZERO_FIX;
-            filtered_cur = sample_cur - cur_sens_zero[1];
-            cur_sum[1] += filtered_cur * filtered_cur;
+    for (uint8_t h = 0; h < ENERGY_METER_HARMONICS; h++) {
+        float coeff = 2 * cosf(2 * M_PI * (h + 1) * line_freq / sample_freq);
+        float s1 = 0;
+        float s2 = 0;
 
-            vlt_sens_zero[1] += (sample_vlt - vlt_sens_zero[1]) / ZERO_FIX;
-            filtered_vlt = sample_vlt - vlt_sens_zero[1];
-            vlt_sum[1] += filtered_vlt * filtered_vlt;
+        for (size_t i = 0; i < count; i++) {
+            float s0 = samples[i] - z + coeff * s1 - s2;
+            s2 = s1;
+            s1 = s0;
+        }
 
-            //L3
-            sample_cur = read_adc(board_config.energy_meter_l3_cur_adc_channel);
-            sample_vlt = read_adc(board_config.energy_meter_l3_vlt_adc_channel);
+        float power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+        harmonics[h] = sqrtf(MAX(power, 0)) * M_SQRT2 / count;
+    }
+}
 
-            cur_sens_zero[2] += (sample_cur - cur_sens_zero[2]) / ZERO_FIX;
-            filtered_cur = sample_cur - cur_sens_zero[2];
-            cur_sum[2] += filtered_cur * filtered_cur;
+static float get_thd(const float* harmonics)
+{
+    float sum_sq = 0;
 
-            vlt_sens_zero[2] += (sample_vlt - vlt_sens_zero[2]) / ZERO_FIX;
-            filtered_vlt = sample_vlt - vlt_sens_zero[2];
-            vlt_sum[2] += filtered_vlt * filtered_vlt;
+    if (harmonics[0] < HARMONICS_MIN_CUR) {
+        return 0;
+    }
+
+    for (uint8_t h = 1; h < ENERGY_METER_HARMONICS; h++) {
+        sum_sq += harmonics[h] * harmonics[h];
+    }
+
+    return sqrtf(sum_sq) / harmonics[0] * 100;
+}
+
+static void sampler_task_func(void* param)
+{
+    adc_channel_t channels[6];
+    adc_atten_t attens[6];
+
+    while (true) {
+        if (!sampling) {
+            power_quality_stop();
+            // zeros are checked and cached at ADC_ATTEN_DB_12
+            reset_cur_ranges();
+            if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ZERO_CHECK_MS)) == 0) {
+                check_zeros();
+            }
+            continue;
         }
+
+        bool with_vlt = mode == ENERGY_METER_MODE_CUR_VLT;
+        uint8_t phases = board_config.energy_meter_three_phases ? 3 : 1;
+        uint8_t channel_count = get_channels(channels, with_vlt);
+        size_t count = WINDOW_SAMPLES / channel_count;
+        for (uint8_t i = 0; i < channel_count; i++) {
+            attens[i] = i < phases ? cur_atten[i] : ADC_ATTEN_DB_12;
+        }
+
+        if (capture_window(channels, attens, channel_count, count) != ESP_OK) {
+            vTaskDelay(pdMS_TO_TICKS(WINDOW_MS));
+            continue;
+        }
+
+        int64_t now = esp_timer_get_time();
+        bool analyse = harmonics_interval > 0 && now - harmonics_time >= harmonics_interval * 1000000LL;
+        float thd[3] = { 0, 0, 0 };
+        float harmonics[3][ENERGY_METER_HARMONICS] = { 0 };
+        float vlt_min[3] = { 0, 0, 0 };
+        float vlt_max[3] = { 0, 0, 0 };
+
+        // fill back buffer, energy_meter_process reads front buffer
+        struct window_s* window = &windows[!window_index];
+        memset(window, 0, sizeof(struct window_s));
+
+        // samples with same index are from same pattern cycle, so span of reference channel applies to all channels
+        float sample_freq = (float)SAMPLE_FREQ / channel_count;
+        size_t start;
+        size_t span;
+        if (with_vlt) {
+            window->freq = get_period_span(&window_buf[phases * count], count, vlt_sens_zero[0], sample_freq, &start, &span);
+        } else {
+            window->freq = get_period_span(window_buf, count, cur_sens_zero[0], sample_freq, &start, &span);
+        }
+        // without measured frequency, e.g. during interruption, cycles are of line frequency
+        size_t cycle = lroundf(sample_freq / (window->freq > 0 ? window->freq : LINE_FREQ));
+
+        for (uint8_t p = 0; p < phases; p++) {
+            const uint16_t* cur_samples = &window_buf[p * count + start];
+            const uint16_t* vlt_samples = &window_buf[(phases + p) * count + start];
+            float cur_slope;
+            float vlt_slope;
+
+            if (cur_rezero[p] && window->freq > 0) {
+                cur_sens_zero[p] = get_zero(cur_samples, span);
+                cur_rezero[p] = false;
+            }
+
+            // current and voltage samples with same index are from same pattern cycle
+            float product = with_vlt ? get_mean_product(cur_samples, cur_sens_zero[p], vlt_samples, vlt_sens_zero[p], span) : 0;
+
+            if (analyse) {
+                get_harmonics(cur_samples, span, cur_sens_zero[p], sample_freq, window->freq > 0 ? window->freq : LINE_FREQ, harmonics[p]);
+            }
+
+            window->cur[p] = get_rms(cur_samples, span, cur_atten[p], &cur_sens_zero[p], &cur_slope) * board_config.energy_meter_cur_scale;
+
+            if (analyse) {
+                for (uint8_t h = 0; h < ENERGY_METER_HARMONICS; h++) {
+                    harmonics[p][h] *= cur_slope * board_config.energy_meter_cur_scale;
+                }
+                thd[p] = get_thd(harmonics[p]);
+            }
+            if (with_vlt) {
+                get_cycle_rms_range(&window_buf[(phases + p) * count], count, vlt_sens_zero[p], cycle, &vlt_min[p], &vlt_max[p]);
+                window->vlt[p] = get_rms(vlt_samples, span, ADC_ATTEN_DB_12, &vlt_sens_zero[p], &vlt_slope) * board_config.energy_meter_vlt_scale;
+                vlt_min[p] *= vlt_slope * board_config.energy_meter_vlt_scale;
+                vlt_max[p] *= vlt_slope * board_config.energy_meter_vlt_scale;
+                window->power[p] = product * cur_slope * vlt_slope * board_config.energy_meter_cur_scale * board_config.energy_meter_vlt_scale;
+            }
+
+            // applies from next window
+            update_cur_range(p, get_max(&window_buf[p * count], count));
+        }
+        window->samples = span;
+
+        if (with_vlt) {
+            power_quality_process(vlt_min, vlt_max, three_phases ? phases : 1, now - (int64_t)(count * 1000000 / sample_freq), now);
+        } else {
+            power_quality_stop();
+        }
+
+        if (analyse) {
+            harmonics_time = now;
+            portENTER_CRITICAL(&harmonics_spinlock);
+            memcpy(cur_thd, thd, sizeof(cur_thd));
+            memcpy(cur_harmonics, harmonics, sizeof(cur_harmonics));
+            portEXIT_CRITICAL(&harmonics_spinlock);
+        }
+
+        portENTER_CRITICAL(&window_spinlock);
+        window_index = !window_index;
+        portEXIT_CRITICAL(&window_spinlock);
     }
+}
 
-    cur[0] = sqrt(cur_sum[0] / samples) * board_config.energy_meter_cur_scale;
-    vlt[0] = sqrt(vlt_sum[0] / samples) * board_config.energy_meter_vlt_scale;
+static void measure_sampled(uint32_t delta_ms, uint16_t charging_current)
+{
+    struct window_s window;
+
+    portENTER_CRITICAL(&window_spinlock);
+    window = windows[window_index];
+    portEXIT_CRITICAL(&window_spinlock);
+
+    bool with_vlt = mode == ENERGY_METER_MODE_CUR_VLT;
+
+    cur[0] = window.cur[0];
+    vlt[0] = with_vlt ? window.vlt[0] : ac_voltage;
+    act_power[0] = window.power[0];
     if (three_phases) {
-        cur[1] = sqrt(cur_sum[1] / samples) * board_config.energy_meter_cur_scale;
-        cur[2] = sqrt(cur_sum[2] / samples) * board_config.energy_meter_cur_scale;
-        vlt[1] = sqrt(vlt_sum[1] / samples) * board_config.energy_meter_vlt_scale;
-        vlt[2] = sqrt(vlt_sum[2] / samples) * board_config.energy_meter_vlt_scale;
+        if (board_config.energy_meter_three_phases) {
+            cur[1] = window.cur[1];
+            cur[2] = window.cur[2];
+            vlt[1] = with_vlt ? window.vlt[1] : ac_voltage;
+            vlt[2] = with_vlt ? window.vlt[2] : ac_voltage;
+            act_power[1] = window.power[1];
+            act_power[2] = window.power[2];
+        } else {
+            cur[1] = cur[2] = cur[0];
+            vlt[1] = vlt[2] = vlt[0];
+            act_power[1] = act_power[2] = act_power[0];
+        }
     } else {
         cur[1] = cur[2] = 0;
         vlt[1] = vlt[2] = 0;
+        act_power[1] = act_power[2] = 0;
+    }
+
+    ESP_LOGD(TAG, "Currents %fA %fA %fA (samples %d)", cur[0], cur[1], cur[2], window.samples);
+    ESP_LOGD(TAG, "Voltages %fV %fV %fV (samples %d)", vlt[0], vlt[1], vlt[2], window.samples);
+    ESP_LOGD(TAG, "Frequency %fHz", window.freq);
+
+    frequency = window.freq;
+
+    set_calc_power(with_vlt);
+}
+
+static void measure_external(uint32_t delta_ms, uint16_t charging_current)
+{
+    energy_meter_external_t values;
+    int64_t time;
+
+    portENTER_CRITICAL(&external_spinlock);
+    values = external;
+    time = external_time;
+    portEXIT_CRITICAL(&external_spinlock);
+
+    if (time == 0 || esp_timer_get_time() - time > EXTERNAL_TIMEOUT_US) {
+        memset(&values, 0, sizeof(values));
     }
 
-    ESP_LOGD(TAG, "Currents %fA %fA %fA (samples %d)", cur[0], cur[1], cur[2], samples);
-    ESP_LOGD(TAG, "Voltages %fV %fV %fV (samples %d)", vlt[0], vlt[1], vlt[2], samples);
+    memcpy(cur, values.current, sizeof(cur));
+    memcpy(vlt, values.voltage, sizeof(vlt));
+    memcpy(act_power, values.power, sizeof(act_power));
+
+    external_has_energy = values.has_energy;
+    external_energy = values.energy;
+
+    frequency = 0;
 
-    set_calc_va_power(delta_ms);
+    set_calc_power(true);
+}
+
+// meter total since previous call, previous total is kept over polling gaps until session starts
+static uint64_t get_external_energy_delta(void)
+{
+    uint64_t delta = 0;
+
+    if (external_has_energy) {
+        // meter total going backwards (replaced or reset meter) is not counted
+        if (external_energy_based && external_energy >= external_energy_prev) {
+            delta = external_energy - external_energy_prev;
+        }
+        external_energy_prev = external_energy;
+        external_energy_based = true;
+    }
+
+    return delta;
 }
 
 static void* get_measure_fn(energy_meter_mode_t mode)
 {
     switch (mode) {
     case ENERGY_METER_MODE_CUR:
-        return board_config.energy_meter_three_phases ? measure_three_phases_cur : measure_single_phase_cur;
     case ENERGY_METER_MODE_CUR_VLT:
-        return board_config.energy_meter_three_phases ? measure_three_phases_cur_vlt : measure_single_phase_cur_vlt;
+        return measure_sampled;
+    case ENERGY_METER_MODE_MODBUS:
+        return measure_external;
     default:
         return measure_dummy;
     }
@@ -295,59 +863,43 @@ void energy_meter_init(void)
 {
     ESP_ERROR_CHECK(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs));
 
+    mutex = xSemaphoreCreateMutex();
+
     uint8_t u8 = ENERGY_METER_MODE_DUMMY;
     nvs_get_u8(nvs, NVS_MODE, &u8);
     mode = u8;
     measure_fn = get_measure_fn(mode);
 
     nvs_get_u16(nvs, NVS_AC_VOLTAGE, &ac_voltage);
-    adc_oneshot_chan_cfg_t config = {
-        .bitwidth = ADC_BITWIDTH_DEFAULT,
-        .atten = ADC_ATTEN_DB_12
-    };
+    nvs_get_u16(nvs, NVS_HARMONICS_INTERVAL, &harmonics_interval);
 
     if (nvs_get_u8(nvs, NVS_three_phases, &u8) == ESP_OK) {
         three_phases = u8;
     }
 
+    nvs_get_u64(nvs, NVS_TOTAL_CONSUMPTION, &total_consumption);
+    total_saved = total_consumption;
+
     if (board_config.energy_meter == BOARD_CONFIG_ENERGY_METER_CUR) {
         vlt[0] = ac_voltage;
-
-        ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.energy_meter_l1_cur_adc_channel, &config));
-        if (board_config.energy_meter_three_phases) {
-            ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.energy_meter_l2_cur_adc_channel, &config));
-            ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.energy_meter_l3_cur_adc_channel, &config));
-        }
     }
 
-    if (board_config.energy_meter == BOARD_CONFIG_ENERGY_METER_CUR_VLT) {
-        ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.energy_meter_l1_cur_adc_channel, &config));
-        ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.energy_meter_l1_vlt_adc_channel, &config));
+    if (board_config.energy_meter == BOARD_CONFIG_ENERGY_METER_CUR || board_config.energy_meter == BOARD_CONFIG_ENERGY_METER_CUR_VLT) {
+        int64_t start = esp_timer_get_time();
+        bool cached = load_zeros();
 
-        if (board_config.energy_meter_three_phases) {
-            ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.energy_meter_l2_cur_adc_channel, &config));
-            ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.energy_meter_l3_cur_adc_channel, &config));
-            ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.energy_meter_l2_vlt_adc_channel, &config));
-            ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.energy_meter_l3_vlt_adc_channel, &config));
+        // measuring zeros at boot is wrong when current flows, e.g. after watchdog reset while charging
+        if (!cached) {
+            ESP_ERROR_CHECK(measure_zeros(cur_sens_zero, vlt_sens_zero));
+            save_zeros();
         }
-    }
-
-    if (board_config.energy_meter == BOARD_CONFIG_ENERGY_METER_CUR || board_config.energy_meter == BOARD_CONFIG_ENERGY_METER_CUR_VLT) {
-        cur_sens_zero[0] = get_zero(board_config.energy_meter_l1_cur_adc_channel);
-        if (board_config.energy_meter_three_phases) {
-            cur_sens_zero[1] = get_zero(board_config.energy_meter_l2_cur_adc_channel);
-            cur_sens_zero[2] = get_zero(board_config.energy_meter_l3_cur_adc_channel);
+        ESP_LOGI(TAG, "Zeros %s in %lldus", cached ? "loaded" : "measured", esp_timer_get_time() - start);
+        ESP_LOGI(TAG, "Current zero %fmV %fmV %fmV", zero_to_voltage(cur_sens_zero[0]), zero_to_voltage(cur_sens_zero[1]), zero_to_voltage(cur_sens_zero[2]));
+        if (has_vlt_sens()) {
+            ESP_LOGI(TAG, "Voltage zero %fmV %fmV %fmV", zero_to_voltage(vlt_sens_zero[0]), zero_to_voltage(vlt_sens_zero[1]), zero_to_voltage(vlt_sens_zero[2]));
         }
-        ESP_LOGI(TAG, "Current zero %f %f %f", cur_sens_zero[0], cur_sens_zero[1], cur_sens_zero[2]);
 
-        if (board_config.energy_meter == BOARD_CONFIG_ENERGY_METER_CUR_VLT) {
-            vlt_sens_zero[0] = get_zero(board_config.energy_meter_l1_vlt_adc_channel);
-            if (board_config.energy_meter_three_phases) {
-                vlt_sens_zero[1] = get_zero(board_config.energy_meter_l2_vlt_adc_channel);
-                vlt_sens_zero[2] = get_zero(board_config.energy_meter_l3_vlt_adc_channel);
-            }
-            ESP_LOGI(TAG, "Voltage zero %f %f %f", vlt_sens_zero[0], vlt_sens_zero[1], vlt_sens_zero[2]);
-        }
+        xTaskCreate(sampler_task_func, "energy_meter_task", 3 * 1024, NULL, 5, &sampler_task);
     }
 }
 
@@ -377,8 +929,13 @@ esp_err_t energy_meter_set_mode(energy_meter_mode_t _mode)
         }
     }
 
+    xSemaphoreTake(mutex, portMAX_DELAY);
     mode = _mode;
     measure_fn = get_measure_fn(mode);
+    // energy counted by other mode since previous meter total must not be counted again
+    external_energy_based = false;
+    xSemaphoreGive(mutex);
+
     nvs_set_u8(nvs, NVS_MODE, mode);
     nvs_commit(nvs);
 
@@ -404,6 +961,33 @@ esp_err_t energy_meter_set_ac_voltage(uint16_t _ac_voltage)
     return ESP_OK;
 }
 
+uint16_t energy_meter_get_harmonics_interval(void)
+{
+    return harmonics_interval;
+}
+
+esp_err_t energy_meter_set_harmonics_interval(uint16_t _harmonics_interval)
+{
+    if (_harmonics_interval > 3600) {
+        ESP_LOGE(TAG, "Harmonics interval out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    harmonics_interval = _harmonics_interval;
+    nvs_set_u16(nvs, NVS_HARMONICS_INTERVAL, harmonics_interval);
+    nvs_commit(nvs);
+
+    return ESP_OK;
+}
+
+void energy_meter_get_harmonics(float* thd, float (*harmonics)[ENERGY_METER_HARMONICS])
+{
+    portENTER_CRITICAL(&harmonics_spinlock);
+    memcpy(thd, cur_thd, sizeof(cur_thd));
+    memcpy(harmonics, cur_harmonics, sizeof(cur_harmonics));
+    portEXIT_CRITICAL(&harmonics_spinlock);
+}
+
 bool energy_meter_is_three_phases(void)
 {
     return three_phases;
@@ -416,43 +1000,126 @@ void energy_meter_set_three_phases(bool _three_phases)
     nvs_commit(nvs);
 }
 
+// nvs entries are appended with crc and wear levelled over pages, power loss keeps previous or new value
+static void save_total_consumption(void)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint64_t total = total_consumption;
+    bool save = total_save_pending ? total != total_saved : total - total_saved >= TOTAL_SAVE_STEP;
+    total_save_pending = false;
+    xSemaphoreGive(mutex);
+
+    if (save) {
+        esp_err_t err = nvs_set_u64(nvs, NVS_TOTAL_CONSUMPTION, total);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        if (err == ESP_OK) {
+            total_saved = total;
+        } else {
+            ESP_LOGE(TAG, "Total consumption save failed: %s", esp_err_to_name(err));
+        }
+    }
+}
+
 void energy_meter_start_session(void)
 {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+
     if (!has_session) {
         ESP_LOGI(TAG, "Start session");
         start_time = esp_timer_get_time();
         has_session = true;
+        external_energy_based = false;
     }
+
+    xSemaphoreGive(mutex);
 }
 
 void energy_meter_stop_session(void)
 {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+
     if (has_session) {
         ESP_LOGI(TAG, "Stop session");
         start_time = 0;
         consumption = 0;
+        consumption_rem = 0;
         charging_time = 0;
         has_session = false;
+        // energy since last step is persisted on session end, flash is not written from caller task
+        total_save_pending = true;
     }
+
+    xSemaphoreGive(mutex);
 }
 
 void energy_meter_process(bool charging, uint16_t charging_current)
 {
     int64_t now = esp_timer_get_time();
-    uint32_t delta_ms = (now - prev_time) / 1000;
+    int64_t delta_us = prev_time > 0 ? now - prev_time : 0;
 
     if (charging) {
-        (*measure_fn)(delta_ms, charging_current);
-        charging_time += delta_ms;
+        bool start_sampling = !sampling && measure_fn == measure_sampled;
+        sampling = measure_fn == measure_sampled;
+        if (start_sampling && sampler_task) {
+            xTaskNotifyGive(sampler_task);
+        }
+
+        (*measure_fn)(delta_us / 1000, charging_current);
+
+        // consumption and charging time are updated together, evse extrapolates them from counters_time
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        if (has_session) {
+            uint64_t prev_consumption = consumption;
+            if (measure_fn == measure_external && (external_has_energy || external_energy_based)) {
+                consumption += get_external_energy_delta();
+            } else {
+                consumption_rem += (int64_t)power_mw * delta_us;
+                consumption += consumption_rem / MWH_US;
+                consumption_rem %= MWH_US;
+            }
+            total_consumption += consumption - prev_consumption;
+            charging_time += delta_us;
+        }
+        counters_time = now;
+        xSemaphoreGive(mutex);
     } else {
+        if (sampling) {
+            sampling = false;
+            portENTER_CRITICAL(&window_spinlock);
+            memset(windows, 0, sizeof(windows));
+            portEXIT_CRITICAL(&window_spinlock);
+            portENTER_CRITICAL(&harmonics_spinlock);
+            memset(cur_thd, 0, sizeof(cur_thd));
+            memset(cur_harmonics, 0, sizeof(cur_harmonics));
+            portEXIT_CRITICAL(&harmonics_spinlock);
+        }
+        external_has_energy = false;
+
         vlt[0] = vlt[1] = vlt[2] = 0;
         cur[0] = cur[1] = cur[2] = 0;
+        act_power[0] = act_power[1] = act_power[2] = 0;
+        app_power[0] = app_power[1] = app_power[2] = 0;
         power = 0;
+        power_mw = 0;
+        va_power = 0;
+        frequency = 0;
     }
 
+    save_total_consumption();
+
     prev_time = now;
 }
 
+void energy_meter_set_external(const energy_meter_external_t* values)
+{
+    portENTER_CRITICAL(&external_spinlock);
+    external = *values;
+    external_time = esp_timer_get_time();
+    portEXIT_CRITICAL(&external_spinlock);
+}
+
 uint16_t energy_meter_get_power(void)
 {
     return power;
@@ -467,14 +1134,72 @@ uint32_t energy_meter_get_session_time(void)
     }
 }
 
+uint16_t energy_meter_get_apparent_power(void)
+{
+    return va_power;
+}
+
+float energy_meter_get_power_factor(void)
+{
+    return va_power > 0 ? MIN((float)power / va_power, 1.0f) : 0;
+}
+
+void energy_meter_get_active_power(float* power)
+{
+    memcpy(power, act_power, sizeof(act_power));
+}
+
+void energy_meter_get_apparent_power_phases(float* power)
+{
+    memcpy(power, app_power, sizeof(app_power));
+}
+
 uint32_t energy_meter_get_charging_time(void)
 {
-    return charging_time / 1000;
+    return charging_time / 1000000;
 }
 
 uint32_t energy_meter_get_consumption(void)
 {
-    return consumption / 3600;
+    return energy_meter_get_consumption_mwh() / 1000;
+}
+
+uint64_t energy_meter_get_consumption_mwh(void)
+{
+    // 64-bit value is not read atomically
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint64_t value = consumption;
+    xSemaphoreGive(mutex);
+
+    return value;
+}
+
+float energy_meter_get_frequency(void)
+{
+    return frequency;
+}
+
+bool energy_meter_is_zero_drift(void)
+{
+    return zero_drift;
+}
+
+uint64_t energy_meter_get_total_consumption(void)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint64_t value = total_consumption;
+    xSemaphoreGive(mutex);
+
+    return value;
+}
+
+void energy_meter_get_session_counters(uint64_t* _consumption, uint32_t* _charging_time, int64_t* time)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    *_consumption = consumption;
+    *_charging_time = charging_time / 1000;
+    *time = counters_time;
+    xSemaphoreGive(mutex);
 }
 
 void energy_meter_get_voltage(float* voltage)
@@ -525,6 +1250,8 @@ const char* energy_meter_mode_to_str(energy_meter_mode_t mode)
         return "cur";
     case ENERGY_METER_MODE_CUR_VLT:
         return "cur_vlt";
+    case ENERGY_METER_MODE_MODBUS:
+        return "modbus";
     default:
         return "dummy";
     }
@@ -538,6 +1265,9 @@ energy_meter_mode_t energy_meter_str_to_mode(const char* str)
     if (!strcmp(str, "cur_vlt")) {
         return ENERGY_METER_MODE_CUR_VLT;
     }
+    if (!strcmp(str, "modbus")) {
+        return ENERGY_METER_MODE_MODBUS;
+    }
     return ENERGY_METER_MODE_DUMMY;
 }
 
@@ -549,6 +1279,8 @@ const char* energy_meter_mode_to_str_mqtt(energy_meter_mode_t mode)
         return "Current sensing";
     case ENERGY_METER_MODE_CUR_VLT:
         return "Current and voltage sensing";
+    case ENERGY_METER_MODE_MODBUS:
+        return "Modbus meter";
     default:
         return "Dummy";
     }
@@ -562,5 +1294,8 @@ energy_meter_mode_t energy_meter_str_to_mode_mqtt(const char* str)
     if (!strcmp(str, "Current and voltage sensing")) {
         return ENERGY_METER_MODE_CUR_VLT;
     }
+    if (!strcmp(str, "Modbus meter")) {
+        return ENERGY_METER_MODE_MODBUS;
+    }
     return ENERGY_METER_MODE_DUMMY;
 }
@@ -7,6 +7,7 @@
 #include "socket_lock.h"
 #include "rcm.h"
 #include "energy_meter.h"
+#include "power_quality.h"
 #include "aux_io.h"
 #include "temp_sensor.h"
 
@@ -18,6 +19,7 @@ void peripherals_init(void)
     ac_relay_init();
     socket_lock_init();
     rcm_init();
+    power_quality_init();
     energy_meter_init();
     led_init();
     aux_init();
@@ -1,117 +1,380 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/ledc.h"
-#include "rom/ets_sys.h"
+#include "soc/soc.h"
+#include "soc/soc_caps.h"
 
 #include "pilot.h"
 #include "board_config.h"
 #include "adc.h"
 
-#define PILOT_PWM_TIMER         LEDC_TIMER_0
-#define PILOT_PWM_CHANNEL       LEDC_CHANNEL_0
+#define PILOT_PWM_TIMER         LEDC_TIMER_0    // shared by connectors, channel is connector index
 #define PILOT_PWM_SPEED_MODE    LEDC_LOW_SPEED_MODE
-#define PILOT_PWM_DUTY_RES      LEDC_TIMER_10_BIT
-#define PILOT_PWM_MAX_DUTY      1023
+#define PILOT_PWM_FREQ          1000
+#define PILOT_PWM_CLK_FREQ      APB_CLK_FREQ
 
-#define PILOT_SAMPLES      64
+#define PILOT_SAMPLES           PILOT_CAPTURE_SAMPLES
+#define PILOT_SAMPLE_FREQ       MIN(128000, SOC_ADC_SAMPLE_FREQ_THRES_HIGH)  // samples covers at least 2 periods of pwm
+#define PILOT_EDGE_GUARD        (PILOT_SAMPLE_FREQ / 40000)  // samples skipped around edges, ~25us
+#define PILOT_EDGE_MIN_RAW      400     // min high-low swing to consider output as pwm
+#define PILOT_CAPTURE_FAIL_MAX  3       // consecutive failed captures classified from previous plateaus
 
 static const char* TAG = "pilot";
 
+static uint16_t samples[PILOT_SAMPLES];
+
+static uint8_t duty_resolution;
+
+static uint32_t full_duty;          // duty value of 100%
+
+static int threshold_12;
+
+static int threshold_9;
+
+static int threshold_6;
+
+static int threshold_3;
+
+static int threshold_n12;
+
+static struct pilot_s
+{
+    adc_channel_t adc_channel;
+    uint16_t pwm_duty;              // %*100
+    uint16_t pwm_amps;              // A*10
+    int last_high;
+    int last_low;
+    uint8_t capture_fail_count;
+} pilots[BOARD_CONFIG_CONNECTORS_MAX] = {
+    [0 ... BOARD_CONFIG_CONNECTORS_MAX - 1] = {
+        .last_low = ADC_RAW_MAX
+    }
+};
+
+static portMUX_TYPE capture_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile pilot_capture_state_t capture_state = PILOT_CAPTURE_STATE_IDLE;
+
+static bool capture_on_demand;
+
+static struct capture_frame_s
+{
+    int64_t time;
+    uint16_t count;
+    uint16_t high;
+    uint16_t low;
+    uint16_t raw[PILOT_CAPTURE_SAMPLES];
+} capture_frames[PILOT_CAPTURE_FRAMES];
+
+static uint8_t capture_head = 0;    // next frame to write
+
+static uint8_t capture_count = 0;
+
+static int plateau[PILOT_SAMPLES];
+
+static int compare_int(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+static int median(int* values, size_t count)
+{
+    qsort(values, count, sizeof(int), compare_int);
+    return values[count / 2];
+}
+
+static bool near_edge(size_t i, size_t count, int threshold)
+{
+    bool is_high = samples[i] >= threshold;
+    size_t from = i >= PILOT_EDGE_GUARD ? i - PILOT_EDGE_GUARD : 0;
+    size_t to = i + PILOT_EDGE_GUARD < count ? i + PILOT_EDGE_GUARD : count - 1;
+
+    for (size_t j = from; j <= to; j++) {
+        if ((samples[j] >= threshold) != is_high) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// samples are time ordered, split them on pwm edges and take median of high and low plateaus
+static void get_plateaus(size_t count, int* high, int* low)
+{
+    int max = 0;
+    int min = INT32_MAX;
+
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i] > max) {
+            max = samples[i];
+        }
+        if (samples[i] < min) {
+            min = samples[i];
+        }
+    }
+
+    if (max - min < PILOT_EDGE_MIN_RAW) {
+        // constant level, no edges
+        for (size_t i = 0; i < count; i++) {
+            plateau[i] = samples[i];
+        }
+        *high = *low = median(plateau, count);
+        return;
+    }
+
+    int threshold = (max + min) / 2;
+    size_t high_count = 0;
+    size_t low_count = 0;
+
+    // high plateau samples from begin, low plateau samples from end of buffer
+    for (size_t i = 0; i < count; i++) {
+        if (!near_edge(i, count, threshold)) {
+            if (samples[i] >= threshold) {
+                plateau[high_count++] = samples[i];
+            } else {
+                plateau[count - ++low_count] = samples[i];
+            }
+        }
+    }
+
+    *high = high_count > 0 ? median(plateau, high_count) : max;
+    *low = low_count > 0 ? median(&plateau[count - low_count], low_count) : min;
+}
+
 void pilot_init(void)
 {
+    // highest resolution where timer clock divider is at least 1
+    duty_resolution = SOC_LEDC_TIMER_BIT_WIDTH;
+    while (duty_resolution > 1 && (PILOT_PWM_CLK_FREQ / PILOT_PWM_FREQ) < (1UL << duty_resolution)) {
+        duty_resolution--;
+    }
+    full_duty = 1UL << duty_resolution;
+
     ledc_timer_config_t ledc_timer = {
         .speed_mode = PILOT_PWM_SPEED_MODE,
         .timer_num = PILOT_PWM_TIMER,
-        .duty_resolution = PILOT_PWM_DUTY_RES,
-        .freq_hz = 1000,
-        .clk_cfg = LEDC_AUTO_CLK
+        .duty_resolution = duty_resolution,
+        .freq_hz = PILOT_PWM_FREQ,
+        .clk_cfg = LEDC_USE_APB_CLK
     };
     ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
 
-    ledc_channel_config_t ledc_channel = {
-        .speed_mode = PILOT_PWM_SPEED_MODE,
-        .channel = PILOT_PWM_CHANNEL,
-        .timer_sel = PILOT_PWM_TIMER,
-        .intr_type = LEDC_INTR_DISABLE,
-        .gpio_num = board_config.pilot_pwm_gpio,
-        .duty = 0,
-        .hpoint = 0
-    };
-    ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
-    ESP_ERROR_CHECK(ledc_stop(PILOT_PWM_SPEED_MODE, PILOT_PWM_CHANNEL, 1));
+    pilots[0].adc_channel = board_config.pilot_adc_channel;
+    pilots[1].adc_channel = board_config.connector_2_pilot_adc_channel;
+
+    for (uint8_t i = 0; i < board_config_get_connector_count(); i++) {
+        ledc_channel_config_t ledc_channel = {
+            .speed_mode = PILOT_PWM_SPEED_MODE,
+            .channel = LEDC_CHANNEL_0 + i,
+            .timer_sel = PILOT_PWM_TIMER,
+            .intr_type = LEDC_INTR_DISABLE,
+            .gpio_num = i == 0 ? board_config.pilot_pwm_gpio : board_config.connector_2_pilot_pwm_gpio,
+            .duty = 0,
+            .hpoint = 0
+        };
+        ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+        ESP_ERROR_CHECK(ledc_stop(PILOT_PWM_SPEED_MODE, LEDC_CHANNEL_0 + i, 1));
+    }
 
     ledc_fade_func_install(0);
 
-    adc_oneshot_chan_cfg_t config = {
-        .bitwidth = ADC_BITWIDTH_DEFAULT,
-        .atten = ADC_ATTEN_DB_12
-    };
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.pilot_adc_channel, &config));
+    threshold_12 = adc_voltage_to_raw(board_config.pilot_down_threshold_12);
+    threshold_9 = adc_voltage_to_raw(board_config.pilot_down_threshold_9);
+    threshold_6 = adc_voltage_to_raw(board_config.pilot_down_threshold_6);
+    threshold_3 = adc_voltage_to_raw(board_config.pilot_down_threshold_3);
+    // first raw value above threshold
+    threshold_n12 = adc_voltage_to_raw(board_config.pilot_down_threshold_n12 + 1);
 }
 
-void pilot_set_level(bool level)
+void pilot_set_level(uint8_t connector, bool level)
 {
-    ESP_LOGI(TAG, "Set level %d", level);
+    struct pilot_s* pilot = &pilots[connector];
+
+    ESP_LOGI(TAG, "Set level %d connector %d", level, connector);
 
-    ledc_stop(PILOT_PWM_SPEED_MODE, PILOT_PWM_CHANNEL, level);
+    pilot->pwm_duty = 0;
+    pilot->pwm_amps = 0;
+
+    ledc_stop(PILOT_PWM_SPEED_MODE, LEDC_CHANNEL_0 + connector, level);
 }
 
-void pilot_set_amps(uint16_t amps)
+void pilot_set_amps(uint8_t connector, uint16_t amps)
 {
+    struct pilot_s* pilot = &pilots[connector];
     uint32_t duty = 0;
 
     if ((amps >= 60) && (amps <= 510)) {
         // amps = (duty cycle %) X 0.6
-        duty = (amps / 10) * (PILOT_PWM_MAX_DUTY / 60);
+        duty = ((uint64_t)amps * full_duty + 300) / 600;
     } else if ((amps > 510) && (amps <= 800)) {
         // amps = (duty cycle % - 64) X 2.5
-        duty = ((amps / 10) * (PILOT_PWM_MAX_DUTY / 250)) + (64 * (PILOT_PWM_MAX_DUTY / 100));
+        duty = ((uint64_t)(amps + 1600) * full_duty + 1250) / 2500;
     } else {
         ESP_LOGE(TAG, "Try set invalid ampere value %d A*10", amps);
         return;
     }
 
-    ESP_LOGI(TAG, "Set amp %dA*10 duty %lu/%d", amps, duty, PILOT_PWM_MAX_DUTY);
+    pilot->pwm_duty = ((uint64_t)duty * 10000 + full_duty / 2) / full_duty;
+    if (pilot->pwm_duty <= 8500) {
+        pilot->pwm_amps = ((uint64_t)duty * 600 + full_duty / 2) / full_duty;
+    } else {
+        pilot->pwm_amps = ((uint64_t)duty * 2500 + full_duty / 2) / full_duty - 1600;
+    }
 
-    ledc_set_duty(PILOT_PWM_SPEED_MODE, PILOT_PWM_CHANNEL, duty);
-    ledc_update_duty(PILOT_PWM_SPEED_MODE, PILOT_PWM_CHANNEL);
+    ESP_LOGI(TAG, "Set amp %dA*10 duty %" PRIu32 "/%" PRIu32 ", generated %dA*10 connector %d", amps, duty, full_duty, pilot->pwm_amps, connector);
+
+    ledc_set_duty(PILOT_PWM_SPEED_MODE, LEDC_CHANNEL_0 + connector, duty);
+    ledc_update_duty(PILOT_PWM_SPEED_MODE, LEDC_CHANNEL_0 + connector);
 }
 
-void pilot_measure(pilot_voltage_t* up_voltage, bool* down_voltage_n12)
+uint16_t pilot_get_amps(uint8_t connector)
 {
-    int high = 0;
-    int low = 3300;
+    return pilots[connector].pwm_amps;
+}
 
-    for (int i = 0; i < 100; i++) {
-        int adc_reading;
-        adc_oneshot_read(adc_handle, board_config.pilot_adc_channel, &adc_reading);
+uint16_t pilot_get_duty(uint8_t connector)
+{
+    return pilots[connector].pwm_duty;
+}
 
-        if (adc_reading > high) {
-            high = adc_reading;
-        } else if (adc_reading < low) {
-            low = adc_reading;
+static void capture_record(int64_t time, size_t count, int high, int low)
+{
+    portENTER_CRITICAL(&capture_spinlock);
+    if (capture_state == PILOT_CAPTURE_STATE_ARMED) {
+        struct capture_frame_s* frame = &capture_frames[capture_head];
+        frame->time = time;
+        frame->count = count < PILOT_CAPTURE_SAMPLES ? count : PILOT_CAPTURE_SAMPLES;
+        frame->high = high;
+        frame->low = low;
+        for (uint16_t i = 0; i < frame->count; i++) {
+            frame->raw[i] = samples[i];
         }
-        ets_delay_us(100);
+
+        capture_head = (capture_head + 1) % PILOT_CAPTURE_FRAMES;
+        if (capture_count < PILOT_CAPTURE_FRAMES) {
+            capture_count++;
+        }
+        if (capture_on_demand && capture_count == PILOT_CAPTURE_FRAMES) {
+            capture_state = PILOT_CAPTURE_STATE_DONE;
+        }
+    }
+    portEXIT_CRITICAL(&capture_spinlock);
+}
+
+void pilot_measure(uint8_t connector, pilot_voltage_t* up_voltage, bool* down_voltage_n12)
+{
+    struct pilot_s* pilot = &pilots[connector];
+    int high = 0;
+    int low = ADC_RAW_MAX;
+    size_t count = 0;
+
+    esp_err_t ret = adc_capture(&pilot->adc_channel, NULL, 1, PILOT_SAMPLE_FREQ, samples, PILOT_SAMPLES);
+    // capture may wait for other adc users, time of first sample
+    int64_t time = esp_timer_get_time() - (int64_t)PILOT_SAMPLES * 1000000 / PILOT_SAMPLE_FREQ;
+
+    if (ret == ESP_OK) {
+        count = PILOT_SAMPLES;
+        get_plateaus(count, &high, &low);
+        pilot->last_high = high;
+        pilot->last_low = low;
+        pilot->capture_fail_count = 0;
+    } else if (pilot->capture_fail_count < PILOT_CAPTURE_FAIL_MAX) {
+        // transient failure, keep previous classification instead of reporting pilot fault
+        pilot->capture_fail_count++;
+        high = pilot->last_high;
+        low = pilot->last_low;
     }
 
-    adc_cali_raw_to_voltage(adc_cali_handle, high, &high);
-    adc_cali_raw_to_voltage(adc_cali_handle, low, &low);
+    if (connector == 0 && capture_state == PILOT_CAPTURE_STATE_ARMED) {
+        capture_record(time, count, high, low);
+    }
 
-    ESP_LOGV(TAG, "Measure: %dmV - %dmV", low, high);
+    ESP_LOGV(TAG, "Measure: %dmV - %dmV", adc_raw_to_voltage(low), adc_raw_to_voltage(high));
 
-    if (high >= board_config.pilot_down_threshold_12) {
+    if (high >= threshold_12) {
         *up_voltage = PILOT_VOLTAGE_12;
-    } else if (high >= board_config.pilot_down_threshold_9) {
+    } else if (high >= threshold_9) {
         *up_voltage = PILOT_VOLTAGE_9;
-    } else if (high >= board_config.pilot_down_threshold_6) {
+    } else if (high >= threshold_6) {
         *up_voltage = PILOT_VOLTAGE_6;
-    } else if (high >= board_config.pilot_down_threshold_3) {
+    } else if (high >= threshold_3) {
         *up_voltage = PILOT_VOLTAGE_3;
     } else {
         *up_voltage = PILOT_VOLTAGE_1;
     }
 
-    *down_voltage_n12 = low <= board_config.pilot_down_threshold_n12;
+    *down_voltage_n12 = low < threshold_n12;
 
     ESP_LOGV(TAG, "Up voltage %d", *up_voltage);
     ESP_LOGV(TAG, "Down voltage below 12V %d", *down_voltage_n12);
 }
+
+void pilot_capture_arm(bool on_demand)
+{
+    portENTER_CRITICAL(&capture_spinlock);
+    capture_on_demand = on_demand;
+    capture_head = 0;
+    capture_count = 0;
+    capture_state = PILOT_CAPTURE_STATE_ARMED;
+    portEXIT_CRITICAL(&capture_spinlock);
+
+    ESP_LOGI(TAG, "Capture armed, on demand %d", on_demand);
+}
+
+void pilot_capture_trigger(void)
+{
+    bool triggered = false;
+
+    portENTER_CRITICAL(&capture_spinlock);
+    if (capture_state == PILOT_CAPTURE_STATE_ARMED) {
+        capture_state = PILOT_CAPTURE_STATE_DONE;
+        triggered = true;
+    }
+    portEXIT_CRITICAL(&capture_spinlock);
+
+    if (triggered) {
+        ESP_LOGI(TAG, "Capture triggered");
+    }
+}
+
+pilot_capture_state_t pilot_capture_get_state(void)
+{
+    return capture_state;
+}
+
+uint8_t pilot_capture_get_count(void)
+{
+    return capture_state == PILOT_CAPTURE_STATE_DONE ? capture_count : 0;
+}
+
+bool pilot_capture_read(uint8_t index, pilot_capture_frame_t* frame)
+{
+    bool ret = false;
+
+    portENTER_CRITICAL(&capture_spinlock);
+    if (capture_state == PILOT_CAPTURE_STATE_DONE && index < capture_count) {
+        struct capture_frame_s* src = &capture_frames[(capture_head + PILOT_CAPTURE_FRAMES - capture_count + index) % PILOT_CAPTURE_FRAMES];
+        frame->time = src->time;
+        frame->count = src->count;
+        frame->high = src->high;
+        frame->low = src->low;
+        memcpy(frame->raw, src->raw, src->count * sizeof(uint16_t));
+        ret = true;
+    }
+    portEXIT_CRITICAL(&capture_spinlock);
+
+    if (ret) {
+        frame->sample_freq = PILOT_SAMPLE_FREQ;
+        for (uint16_t i = 0; i < frame->count; i++) {
+            frame->voltage[i] = adc_raw_to_voltage(frame->raw[i]);
+        }
+        frame->high = adc_raw_to_voltage(frame->high);
+        frame->low = adc_raw_to_voltage(frame->low);
+    }
+
+    return ret;
+}
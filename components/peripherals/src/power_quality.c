@@ -0,0 +1,214 @@
+#include <inttypes.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "power_quality.h"
+
+#define NVS_NAMESPACE           "evse_pq"
+#define NVS_SAG                 "sag"
+#define NVS_SWELL               "swell"
+#define NVS_INTERRUPTION        "interruption"
+
+#define HYSTERESIS_PERCENT      2       // of threshold, event ends when voltage is back by this margin
+
+static const char* TAG = "power_quality";
+
+static nvs_handle nvs;
+
+static SemaphoreHandle_t mutex;
+
+static uint16_t sag = 207;              // V, 90% of 230V
+
+static uint16_t swell = 253;            // V, 110% of 230V
+
+static uint16_t interruption = 12;      // V, 5% of 230V
+
+// ongoing event per phase, accessed only from energy meter task
+static struct phase_s
+{
+    bool active;
+    power_quality_event_type_t type;
+    int64_t start;
+    time_t time;
+    float voltage;
+} phases_state[3];
+
+static int64_t last_start = 0;     // of previous window
+
+static int64_t last_end = 0;
+
+static power_quality_event_t events[POWER_QUALITY_EVENTS];
+
+static uint8_t event_count = 0;
+
+static uint8_t event_next = 0;
+
+static uint32_t event_id = 0;
+
+void power_quality_init(void)
+{
+    ESP_ERROR_CHECK(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs));
+
+    mutex = xSemaphoreCreateMutex();
+
+    nvs_get_u16(nvs, NVS_SAG, &sag);
+    nvs_get_u16(nvs, NVS_SWELL, &swell);
+    nvs_get_u16(nvs, NVS_INTERRUPTION, &interruption);
+}
+
+uint16_t power_quality_get_sag_threshold(void)
+{
+    return sag;
+}
+
+uint16_t power_quality_get_swell_threshold(void)
+{
+    return swell;
+}
+
+uint16_t power_quality_get_interruption_threshold(void)
+{
+    return interruption;
+}
+
+esp_err_t power_quality_set_thresholds(uint16_t _sag, uint16_t _swell, uint16_t _interruption)
+{
+    if (_interruption >= _sag || _sag >= _swell) {
+        ESP_LOGE(TAG, "Thresholds out of order");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sag = _sag;
+    swell = _swell;
+    interruption = _interruption;
+    nvs_set_u16(nvs, NVS_SAG, sag);
+    nvs_set_u16(nvs, NVS_SWELL, swell);
+    nvs_set_u16(nvs, NVS_INTERRUPTION, interruption);
+
+    nvs_commit(nvs);
+
+    return ESP_OK;
+}
+
+static void start_event(uint8_t p, power_quality_event_type_t type, float voltage, int64_t now)
+{
+    struct phase_s* state = &phases_state[p];
+
+    state->active = true;
+    state->type = type;
+    state->start = now;
+    state->time = time(NULL);
+    state->voltage = voltage;
+
+    ESP_LOGW(TAG, "L%d %s started (%.1fV)", p + 1, power_quality_event_type_to_str(type), voltage);
+}
+
+static void finish_event(uint8_t p, int64_t now)
+{
+    struct phase_s* state = &phases_state[p];
+
+    power_quality_event_t event = {
+        .type = state->type == POWER_QUALITY_EVENT_SAG && state->voltage < interruption ? POWER_QUALITY_EVENT_INTERRUPTION : state->type,
+        .phase = p,
+        .time = state->time,
+        .duration = (now - state->start) / 1000,
+        .voltage = state->voltage
+    };
+    state->active = false;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    event.id = ++event_id;
+    events[event_next] = event;
+    event_next = (event_next + 1) % POWER_QUALITY_EVENTS;
+    event_count = MIN(event_count + 1, POWER_QUALITY_EVENTS);
+    xSemaphoreGive(mutex);
+
+    ESP_LOGW(TAG, "L%d %s finished (%.1fV, %" PRIu32 "ms)", p + 1, power_quality_event_type_to_str(event.type), event.voltage, event.duration);
+}
+
+void power_quality_process(const float* vlt_min, const float* vlt_max, uint8_t phases, int64_t start, int64_t end)
+{
+    // event started after end of previous window, when any cycle is out of threshold
+    int64_t start_edge = last_end > 0 ? (last_end + end) / 2 : start;
+    // event finished after start of previous window, when all cycles are back
+    int64_t end_edge = last_start > 0 ? (last_start + start) / 2 : start;
+
+    for (uint8_t p = 0; p < 3; p++) {
+        struct phase_s* state = &phases_state[p];
+
+        if (p >= phases) {
+            if (state->active) {
+                finish_event(p, last_end);
+            }
+            continue;
+        }
+
+        if (state->active) {
+            if (state->type == POWER_QUALITY_EVENT_SAG) {
+                state->voltage = MIN(state->voltage, vlt_min[p]);
+                if (vlt_min[p] >= sag * (100 + HYSTERESIS_PERCENT) / 100.0f) {
+                    finish_event(p, end_edge);
+                }
+            } else {
+                state->voltage = MAX(state->voltage, vlt_max[p]);
+                // sag during swell finishes swell
+                if (vlt_max[p] <= swell * (100 - HYSTERESIS_PERCENT) / 100.0f || vlt_min[p] < sag) {
+                    finish_event(p, end_edge);
+                }
+            }
+        }
+
+        if (!state->active) {
+            if (vlt_min[p] < sag) {
+                start_event(p, POWER_QUALITY_EVENT_SAG, vlt_min[p], start_edge);
+            } else if (vlt_max[p] > swell) {
+                start_event(p, POWER_QUALITY_EVENT_SWELL, vlt_max[p], start_edge);
+            }
+        }
+    }
+
+    last_start = start;
+    last_end = end;
+}
+
+void power_quality_stop(void)
+{
+    for (uint8_t p = 0; p < 3; p++) {
+        if (phases_state[p].active) {
+            finish_event(p, last_end);
+        }
+    }
+
+    // windows after restart are not continuation of last one
+    last_start = 0;
+    last_end = 0;
+}
+
+uint8_t power_quality_get_events(power_quality_event_t* _events)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint8_t count = event_count;
+    uint8_t first = (event_next + POWER_QUALITY_EVENTS - event_count) % POWER_QUALITY_EVENTS;
+    for (uint8_t i = 0; i < count; i++) {
+        _events[i] = events[(first + i) % POWER_QUALITY_EVENTS];
+    }
+    xSemaphoreGive(mutex);
+
+    return count;
+}
+
+const char* power_quality_event_type_to_str(power_quality_event_type_t type)
+{
+    switch (type)
+    {
+    case POWER_QUALITY_EVENT_SWELL:
+        return "swell";
+    case POWER_QUALITY_EVENT_INTERRUPTION:
+        return "interruption";
+    default:
+        return "sag";
+    }
+}
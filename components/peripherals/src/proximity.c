@@ -6,6 +6,12 @@
 
 static const char* TAG = "proximity";
 
+static int threshold_13;
+
+static int threshold_20;
+
+static int threshold_32;
+
 void proximity_init(void)
 {
     if (board_config.proximity) {
@@ -14,6 +20,10 @@ void proximity_init(void)
             .atten = ADC_ATTEN_DB_12
         };
         ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, board_config.proximity_adc_channel, &config));
+
+        threshold_13 = adc_voltage_to_raw(board_config.proximity_down_threshold_13);
+        threshold_20 = adc_voltage_to_raw(board_config.proximity_down_threshold_20);
+        threshold_32 = adc_voltage_to_raw(board_config.proximity_down_threshold_32);
     }
 }
 
@@ -22,18 +32,16 @@ uint8_t proximity_get_max_current(void)
     uint8_t current = 63;
 
     if (board_config.proximity) {
-        int voltage;
-        adc_oneshot_read(adc_handle, board_config.proximity_adc_channel, &voltage);
-        adc_cali_raw_to_voltage(adc_cali_handle, voltage, &voltage);
+        int raw = 0;
+        adc_read(board_config.proximity_adc_channel, &raw);
 
-        ESP_LOGD(TAG, "Measured: %dmV", voltage);
+        ESP_LOGD(TAG, "Measured: %dmV", adc_raw_to_voltage(raw));
 
-        
-        if (voltage >= board_config.proximity_down_threshold_13) {
+        if (raw >= threshold_13) {
             current = 13;
-        } else if (voltage >= board_config.proximity_down_threshold_20) {
+        } else if (raw >= threshold_20) {
             current = 20;
-        } else if (voltage >= board_config.proximity_down_threshold_32) {
+        } else if (raw >= threshold_32) {
             current = 32;
         }
 
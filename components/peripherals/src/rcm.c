@@ -7,20 +7,10 @@
 #include "board_config.h"
 #include "evse.h"
 
-// static bool do_test = false;
-
-// static bool triggered = false;
-
-// static bool test_triggered = false;
-
-// static void IRAM_ATTR rcm_isr_handler(void* arg)
-// {
-//     if (!do_test) {
-//         triggered = true;
-//     } else {
-//         test_triggered = true;
-//     }
-// }
+static void IRAM_ATTR rcm_isr_handler(void* arg)
+{
+    evse_notify_from_isr();
+}
 
 void rcm_init(void)
 {
@@ -38,10 +28,10 @@ void rcm_init(void)
             io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
         else
             io_conf.pull_down_en = GPIO_PULLDOWN_ENABLE;
-        // io_conf.intr_type = GPIO_INTR_POSEDGE;
+        io_conf.intr_type = board_config.rcm_gpio_inverted ? GPIO_INTR_NEGEDGE : GPIO_INTR_POSEDGE;
         io_conf.pin_bit_mask = BIT64(board_config.rcm_gpio);
         ESP_ERROR_CHECK(gpio_config(&io_conf));
-        //ESP_ERROR_CHECK(gpio_isr_handler_add(board_config.rcm_gpio, rcm_isr_handler, NULL));
+        ESP_ERROR_CHECK(gpio_isr_handler_add(board_config.rcm_gpio, rcm_isr_handler, NULL));
     }
 }
 
@@ -75,7 +75,11 @@ static void thermistor_task_func(void* param)
     while (true) {
         int adc = 0;
         for (int i = 0; i < 10; i++) {
-            adc_oneshot_read(m_handle, adc_channel, &adc);
+            if (m_handle == adc_handle) {
+                adc_read(adc_channel, &adc);
+            } else {
+                adc_oneshot_read(m_handle, adc_channel, &adc);
+            }
             ets_delay_us(20);
         }
         adc /= 8;
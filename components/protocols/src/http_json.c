@@ -13,6 +13,7 @@
 #include "evse.h"
 #include "board_config.h"
 #include "energy_meter.h"
+#include "power_quality.h"
 #include "socket_lock.h"
 #include "serial.h"
 #include "proximity.h"
@@ -52,6 +53,7 @@ cJSON* http_json_get_evse_config(void)
     cJSON_AddNumberToObject(json, "consumptionLimit", evse_get_consumption_limit());
     cJSON_AddNumberToObject(json, "defaultConsumptionLimit", evse_get_default_consumption_limit());
     cJSON_AddNumberToObject(json, "chargingTimeLimit", evse_get_charging_time_limit());
+    cJSON_AddNumberToObject(json, "chargingTimeLimitMs", evse_get_charging_time_limit_ms());
     cJSON_AddNumberToObject(json, "defaultChargingTimeLimit", evse_get_default_charging_time_limit());
     cJSON_AddNumberToObject(json, "underPowerLimit", evse_get_under_power_limit());
     cJSON_AddNumberToObject(json, "defaultUnderPowerLimit", evse_get_default_under_power_limit());
@@ -64,6 +66,10 @@ cJSON* http_json_get_evse_config(void)
     cJSON_AddStringToObject(json, "energyMeterMode", energy_meter_mode_to_str(energy_meter_get_mode()));
     cJSON_AddNumberToObject(json, "energyMeterAcVoltage", energy_meter_get_ac_voltage());
     cJSON_AddNumberToObject(json, "energyMeterThreePhases", energy_meter_is_three_phases());
+    cJSON_AddNumberToObject(json, "energyMeterHarmonicsInterval", energy_meter_get_harmonics_interval());
+    cJSON_AddNumberToObject(json, "powerQualitySagThreshold", power_quality_get_sag_threshold());
+    cJSON_AddNumberToObject(json, "powerQualitySwellThreshold", power_quality_get_swell_threshold());
+    cJSON_AddNumberToObject(json, "powerQualityInterruptionThreshold", power_quality_get_interruption_threshold());
 
     return json;
 }
@@ -92,19 +98,22 @@ esp_err_t http_json_set_evse_config(cJSON* json)
         RETURN_ON_ERROR(evse_set_temp_threshold(cJSON_GetObjectItem(json, "temperatureThreshold")->valuedouble));
     }
     if (cJSON_IsNumber(cJSON_GetObjectItem(json, "consumptionLimit"))) {
-        evse_set_consumption_limit(cJSON_GetObjectItem(json, "consumptionLimit")->valuedouble);
+        RETURN_ON_ERROR(evse_set_consumption_limit(cJSON_GetObjectItem(json, "consumptionLimit")->valuedouble));
     }
     if (cJSON_IsNumber(cJSON_GetObjectItem(json, "defaultConsumptionLimit"))) {
         evse_set_default_consumption_limit(cJSON_GetObjectItem(json, "defaultConsumptionLimit")->valuedouble);
     }
     if (cJSON_IsNumber(cJSON_GetObjectItem(json, "chargingTimeLimit"))) {
-        evse_set_charging_time_limit(cJSON_GetObjectItem(json, "chargingTimeLimit")->valuedouble);
+        RETURN_ON_ERROR(evse_set_charging_time_limit(cJSON_GetObjectItem(json, "chargingTimeLimit")->valuedouble));
+    }
+    if (cJSON_IsNumber(cJSON_GetObjectItem(json, "chargingTimeLimitMs"))) {
+        RETURN_ON_ERROR(evse_set_charging_time_limit_ms(cJSON_GetObjectItem(json, "chargingTimeLimitMs")->valuedouble));
     }
     if (cJSON_IsNumber(cJSON_GetObjectItem(json, "defaultChargingTimeLimit"))) {
         evse_set_default_charging_time_limit(cJSON_GetObjectItem(json, "defaultChargingTimeLimit")->valuedouble);
     }
     if (cJSON_IsNumber(cJSON_GetObjectItem(json, "underPowerLimit"))) {
-        evse_set_under_power_limit(cJSON_GetObjectItem(json, "underPowerLimit")->valuedouble);
+        RETURN_ON_ERROR(evse_set_under_power_limit(cJSON_GetObjectItem(json, "underPowerLimit")->valuedouble));
     }
     if (cJSON_IsNumber(cJSON_GetObjectItem(json, "defaultUnderPowerLimit"))) {
         evse_set_default_under_power_limit(cJSON_GetObjectItem(json, "defaultUnderPowerLimit")->valuedouble);
@@ -132,6 +141,19 @@ esp_err_t http_json_set_evse_config(cJSON* json)
     if (cJSON_IsBool(cJSON_GetObjectItem(json, "energyMeterThreePhases"))) {
         energy_meter_set_three_phases(cJSON_IsTrue(cJSON_GetObjectItem(json, "energyMeterThreePhases")));
     }
+    if (cJSON_IsNumber(cJSON_GetObjectItem(json, "energyMeterHarmonicsInterval"))) {
+        RETURN_ON_ERROR(energy_meter_set_harmonics_interval(cJSON_GetObjectItem(json, "energyMeterHarmonicsInterval")->valuedouble));
+    }
+    // thresholds are validated together
+    cJSON* sag = cJSON_GetObjectItem(json, "powerQualitySagThreshold");
+    cJSON* swell = cJSON_GetObjectItem(json, "powerQualitySwellThreshold");
+    cJSON* interruption = cJSON_GetObjectItem(json, "powerQualityInterruptionThreshold");
+    if (cJSON_IsNumber(sag) || cJSON_IsNumber(swell) || cJSON_IsNumber(interruption)) {
+        RETURN_ON_ERROR(power_quality_set_thresholds(
+            cJSON_IsNumber(sag) ? sag->valuedouble : power_quality_get_sag_threshold(),
+            cJSON_IsNumber(swell) ? swell->valuedouble : power_quality_get_swell_threshold(),
+            cJSON_IsNumber(interruption) ? interruption->valuedouble : power_quality_get_interruption_threshold()));
+    }
 
     return ESP_OK;
 }
@@ -248,6 +270,9 @@ cJSON* http_json_get_serial_config(void)
         }
     }
 
+    cJSON_AddStringToObject(json, "meterProfile", serial_meter_profile_to_str(serial_get_meter_profile()));
+    cJSON_AddNumberToObject(json, "meterAddress", serial_get_meter_address());
+
     return json;
 }
 
@@ -258,8 +283,22 @@ esp_err_t http_json_set_serial_config(cJSON* json)
     char data_bits_name[16];
     char stop_bits_name[16];
     char parity_name[16];
+
+    bool has_meter = cJSON_IsString(cJSON_GetObjectItem(json, "meterProfile"));
+    double meter_address = cJSON_GetNumberValue(cJSON_GetObjectItem(json, "meterAddress"));
+    // checked before reset and conversion, out of range number would wrap to valid address
+    if (has_meter && (!cJSON_IsNumber(cJSON_GetObjectItem(json, "meterAddress")) || meter_address < 1 || meter_address > 247)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
     serial_reset_config();
 
+    if (has_meter) {
+        serial_meter_profile_t profile = serial_str_to_meter_profile(cJSON_GetObjectItem(json, "meterProfile")->valuestring);
+
+        RETURN_ON_ERROR(serial_set_meter_config(profile, meter_address));
+    }
+
     for (serial_id_t id = 0; id < SERIAL_ID_MAX; id++) {
         if (serial_is_available(id)) {
             sprintf(mode_name, "serial%dMode", id + 1);
@@ -504,17 +543,8 @@ esp_err_t http_json_set_time(cJSON* json)
     return ESP_OK;
 }
 
-cJSON* http_json_get_state(void)
+static void add_errors_json(cJSON* json, uint32_t error)
 {
-    cJSON* json = cJSON_CreateObject();
-
-    cJSON_AddStringToObject(json, "state", evse_state_to_str(evse_get_state()));
-    cJSON_AddBoolToObject(json, "available", evse_is_available());
-    cJSON_AddBoolToObject(json, "enabled", evse_is_enabled());
-    cJSON_AddBoolToObject(json, "pendingAuth", evse_is_pending_auth());
-    cJSON_AddBoolToObject(json, "limitReached", evse_is_limit_reached());
-
-    uint32_t error = evse_get_error();
     if (error == 0) {
         cJSON_AddNullToObject(json, "errors_json");
     } else {
@@ -545,20 +575,85 @@ cJSON* http_json_get_state(void)
         }
         cJSON_AddItemToObject(json, "errors_json", errors_json);
     }
+}
+
+cJSON* http_json_get_state(void)
+{
+    cJSON* json = cJSON_CreateObject();
+
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+
+    cJSON_AddStringToObject(json, "state", evse_state_to_str(snapshot.state));
+    cJSON_AddBoolToObject(json, "available", snapshot.available);
+    cJSON_AddBoolToObject(json, "enabled", snapshot.enabled);
+    cJSON_AddBoolToObject(json, "pendingAuth", snapshot.pending_auth);
+    cJSON_AddBoolToObject(json, "limitReached", snapshot.limit_reached);
+    cJSON_AddNumberToObject(json, "offeredCurrent", evse_get_offered_current() / 10.0);
+
+    add_errors_json(json, snapshot.error);
+
+    cJSON_AddNumberToObject(json, "sessionTime", snapshot.session_time);
+    cJSON_AddNumberToObject(json, "chargingTime", snapshot.charging_time);
+    cJSON_AddNumberToObject(json, "consumption", snapshot.consumption);
+    cJSON_AddNumberToObject(json, "preciseConsumption", snapshot.consumption_mwh / 1000.0);
+    cJSON_AddNumberToObject(json, "totalConsumption", snapshot.total_consumption / 1000.0);
+    cJSON_AddNumberToObject(json, "frequency", snapshot.frequency);
+    cJSON_AddNumberToObject(json, "power", snapshot.power);
+    cJSON_AddNumberToObject(json, "apparentPower", snapshot.apparent_power);
+    cJSON_AddNumberToObject(json, "powerFactor", snapshot.power_factor);
+    cJSON_AddItemToObject(json, "voltage", cJSON_CreateFloatArray(snapshot.voltage, 3));
+    cJSON_AddItemToObject(json, "current", cJSON_CreateFloatArray(snapshot.current, 3));
+    cJSON_AddItemToObject(json, "phasePower", cJSON_CreateFloatArray(snapshot.phase_power, 3));
+
+    return json;
+}
+
+cJSON* http_json_get_connector_state(uint8_t connector)
+{
+    evse_snapshot_t snapshot;
+    if (evse_connector_get_snapshot(connector, &snapshot) != ESP_OK) {
+        return NULL;
+    }
+
+    cJSON* json = cJSON_CreateObject();
 
-    cJSON_AddNumberToObject(json, "sessionTime", energy_meter_get_session_time());
-    cJSON_AddNumberToObject(json, "chargingTime", energy_meter_get_charging_time());
-    cJSON_AddNumberToObject(json, "consumption", energy_meter_get_consumption());
-    cJSON_AddNumberToObject(json, "power", energy_meter_get_power());
-    float values[3];
-    energy_meter_get_voltage(values);
-    cJSON_AddItemToObject(json, "voltage", cJSON_CreateFloatArray(values, 3));
-    energy_meter_get_current(values);
-    cJSON_AddItemToObject(json, "current", cJSON_CreateFloatArray(values, 3));
+    cJSON_AddStringToObject(json, "state", evse_state_to_str(snapshot.state));
+    cJSON_AddBoolToObject(json, "available", snapshot.available);
+    cJSON_AddBoolToObject(json, "enabled", snapshot.enabled);
+    cJSON_AddBoolToObject(json, "pendingAuth", snapshot.pending_auth);
+    cJSON_AddBoolToObject(json, "limitReached", snapshot.limit_reached);
+    cJSON_AddNumberToObject(json, "chargingCurrent", snapshot.charging_current / 10.0);
+    cJSON_AddNumberToObject(json, "offeredCurrent", evse_connector_get_offered_current(connector) / 10.0);
+    add_errors_json(json, snapshot.error);
 
     return json;
 }
 
+cJSON* http_json_get_connectors_state(void)
+{
+    cJSON* json = cJSON_CreateArray();
+
+    for (uint8_t i = 0; i < evse_get_connector_count(); i++) {
+        cJSON_AddItemToArray(json, http_json_get_connector_state(i));
+    }
+
+    return json;
+}
+
+esp_err_t http_json_set_connector(uint8_t connector, cJSON* json)
+{
+    if (connector >= evse_get_connector_count()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (cJSON_IsNumber(cJSON_GetObjectItem(json, "chargingCurrent"))) {
+        return evse_connector_set_charging_current(connector, cJSON_GetObjectItem(json, "chargingCurrent")->valuedouble * 10);
+    }
+
+    return ESP_OK;
+}
+
 cJSON* http_json_get_info(void)
 {
     cJSON* json = cJSON_CreateObject();
@@ -597,6 +692,149 @@ cJSON* http_json_get_info(void)
     cJSON_AddNumberToObject(json, "temperatureSensorCount", temp_sensor_get_count());
     cJSON_AddNumberToObject(json, "temperatureLow", temp_sensor_get_low() / 100.0);
     cJSON_AddNumberToObject(json, "temperatureHigh", temp_sensor_get_high() / 100.0);
+    cJSON_AddBoolToObject(json, "energyMeterZeroDrift", energy_meter_is_zero_drift());
+    serial_meter_stats_t meter_stats;
+    serial_get_meter_stats(&meter_stats);
+    cJSON_AddNumberToObject(json, "meterPolls", meter_stats.polls);
+    cJSON_AddNumberToObject(json, "meterErrors", meter_stats.errors);
+    cJSON_AddNumberToObject(json, "meterTimeouts", meter_stats.timeouts);
+    cJSON_AddNumberToObject(json, "meterRequests", meter_stats.requests);
+    cJSON_AddNumberToObject(json, "meterLatency", meter_stats.latency);
+    cJSON_AddNumberToObject(json, "meterMaxLatency", meter_stats.max_latency);
+    return json;
+}
+
+static const char* pilot_voltage_to_str(pilot_voltage_t pilot_voltage)
+{
+    switch (pilot_voltage)
+    {
+    case PILOT_VOLTAGE_12:
+        return "12V";
+    case PILOT_VOLTAGE_9:
+        return "9V";
+    case PILOT_VOLTAGE_6:
+        return "6V";
+    case PILOT_VOLTAGE_3:
+        return "3V";
+    default:
+        return "1V";
+    }
+}
+
+static cJSON* loop_stats_to_json(evse_loop_stats_t* stats)
+{
+    cJSON* json = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(json, "iterations", stats->iterations);
+    cJSON_AddNumberToObject(json, "iterationsPerSec", stats->iterations_per_sec);
+    cJSON_AddNumberToObject(json, "lastTime", stats->last_time);
+    cJSON_AddNumberToObject(json, "maxTime", stats->max_time);
+    cJSON_AddNumberToObject(json, "lastJitter", stats->last_jitter);
+    cJSON_AddNumberToObject(json, "maxJitter", stats->max_jitter);
+
+    return json;
+}
+
+static cJSON* latency_stats_to_json(evse_latency_t latency)
+{
+    cJSON* json = cJSON_CreateObject();
+
+    evse_latency_stats_t stats;
+    evse_get_latency_stats(latency, &stats);
+    cJSON_AddNumberToObject(json, "count", stats.count);
+    cJSON_AddNumberToObject(json, "p50", stats.p50);
+    cJSON_AddNumberToObject(json, "p99", stats.p99);
+    cJSON_AddNumberToObject(json, "max", stats.max);
+    cJSON* buckets = cJSON_CreateArray();
+    for (uint8_t i = 0; i < EVSE_LATENCY_BUCKETS; i++) {
+        cJSON_AddItemToArray(buckets, cJSON_CreateNumber(stats.buckets[i]));
+    }
+    cJSON_AddItemToObject(json, "buckets", buckets);
+
+    return json;
+}
+
+cJSON* http_json_get_harmonics(void)
+{
+    cJSON* json = cJSON_CreateObject();
+
+    float thd[3];
+    float harmonics[3][ENERGY_METER_HARMONICS];
+    energy_meter_get_harmonics(thd, harmonics);
+
+    cJSON_AddNumberToObject(json, "interval", energy_meter_get_harmonics_interval());
+    cJSON_AddItemToObject(json, "thd", cJSON_CreateFloatArray(thd, 3));
+    cJSON* current = cJSON_CreateArray();
+    for (uint8_t p = 0; p < 3; p++) {
+        cJSON_AddItemToArray(current, cJSON_CreateFloatArray(harmonics[p], ENERGY_METER_HARMONICS));
+    }
+    cJSON_AddItemToObject(json, "current", current);
+
+    return json;
+}
+
+cJSON* http_json_get_power_quality(void)
+{
+    cJSON* json = cJSON_CreateObject();
+
+    power_quality_event_t events[POWER_QUALITY_EVENTS];
+    uint8_t count = power_quality_get_events(events);
+
+    cJSON_AddNumberToObject(json, "sagThreshold", power_quality_get_sag_threshold());
+    cJSON_AddNumberToObject(json, "swellThreshold", power_quality_get_swell_threshold());
+    cJSON_AddNumberToObject(json, "interruptionThreshold", power_quality_get_interruption_threshold());
+    cJSON* list = cJSON_CreateArray();
+    for (uint8_t i = 0; i < count; i++) {
+        cJSON* event = cJSON_CreateObject();
+        cJSON_AddNumberToObject(event, "id", events[i].id);
+        cJSON_AddStringToObject(event, "type", power_quality_event_type_to_str(events[i].type));
+        cJSON_AddNumberToObject(event, "phase", events[i].phase + 1);
+        cJSON_AddNumberToObject(event, "time", events[i].time);
+        cJSON_AddNumberToObject(event, "duration", events[i].duration);
+        cJSON_AddNumberToObject(event, "voltage", events[i].voltage);
+        cJSON_AddItemToArray(list, event);
+    }
+    cJSON_AddItemToObject(json, "events", list);
+
+    return json;
+}
+
+cJSON* http_json_get_statistics(void)
+{
+    cJSON* json = cJSON_CreateObject();
+
+    evse_loop_stats_t stats;
+    evse_get_process_stats(&stats);
+    cJSON_AddItemToObject(json, "process", loop_stats_to_json(&stats));
+    evse_get_meter_stats(&stats);
+    cJSON_AddItemToObject(json, "meter", loop_stats_to_json(&stats));
+
+    cJSON* transitions = cJSON_CreateArray();
+    for (evse_state_t state = EVSE_STATE_A; state <= EVSE_STATE_D2; state++) {
+        for (pilot_voltage_t pilot_voltage = PILOT_VOLTAGE_12; pilot_voltage <= PILOT_VOLTAGE_1; pilot_voltage++) {
+            for (uint8_t can_charging = 0; can_charging < 2; can_charging++) {
+                evse_transition_stats_t transition;
+                if (evse_get_transition_stats(state, pilot_voltage, can_charging, &transition) == ESP_OK && transition.count > 0) {
+                    cJSON* item = cJSON_CreateObject();
+                    cJSON_AddStringToObject(item, "from", evse_state_to_str(state));
+                    cJSON_AddStringToObject(item, "pilotVoltage", pilot_voltage_to_str(pilot_voltage));
+                    cJSON_AddBoolToObject(item, "canCharging", can_charging);
+                    cJSON_AddStringToObject(item, "to", evse_state_to_str(transition.next_state));
+                    cJSON_AddNumberToObject(item, "count", transition.count);
+                    cJSON_AddNumberToObject(item, "lastTime", transition.last_time);
+                    cJSON_AddItemToArray(transitions, item);
+                }
+            }
+        }
+    }
+    cJSON_AddItemToObject(json, "transitions", transitions);
+
+    cJSON* latency = cJSON_CreateObject();
+    cJSON_AddItemToObject(latency, "command", latency_stats_to_json(EVSE_LATENCY_COMMAND));
+    cJSON_AddItemToObject(latency, "pilotRelay", latency_stats_to_json(EVSE_LATENCY_PILOT_RELAY));
+    cJSON_AddItemToObject(latency, "disablePilot", latency_stats_to_json(EVSE_LATENCY_DISABLE_PILOT));
+    cJSON_AddItemToObject(json, "latency", latency);
+
     return json;
 }
 
@@ -620,6 +858,7 @@ cJSON* http_json_get_board_config(void)
     cJSON_AddStringToObject(json, "deviceName", board_config.device_name);
     cJSON_AddBoolToObject(json, "socketLock", board_config.socket_lock);
     cJSON_AddBoolToObject(json, "proximity", board_config.proximity);
+    cJSON_AddNumberToObject(json, "connectors", board_config_get_connector_count());
     cJSON_AddNumberToObject(json, "socketLockMinBreakTime", board_config.socket_lock_min_break_time);
     cJSON_AddBoolToObject(json, "rcm", board_config.rcm);
     cJSON_AddBoolToObject(json, "temperatureSensor", board_config.onewire && board_config.onewire_temp_sensor);
@@ -42,8 +42,20 @@ esp_err_t http_json_set_time(cJSON* json);
 
 cJSON* http_json_get_state(void);
 
+cJSON* http_json_get_connector_state(uint8_t connector);
+
+cJSON* http_json_get_connectors_state(void);
+
+esp_err_t http_json_set_connector(uint8_t connector, cJSON* json);
+
 cJSON* http_json_get_info(void);
 
+cJSON* http_json_get_statistics(void);
+
+cJSON* http_json_get_harmonics(void);
+
+cJSON* http_json_get_power_quality(void);
+
 cJSON* http_json_get_board_config(void);
 
 #endif /* HTTP_JSON_UTILS_H */
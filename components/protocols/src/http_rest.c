@@ -15,7 +15,9 @@
 #include "http_rest.h"
 #include "http.h"
 #include "http_json.h"
+#include "board_config.h"
 #include "evse.h"
+#include "pilot.h"
 #include "script.h"
 #include "logger.h"
 
@@ -42,6 +44,27 @@ static void timeout_restart()
     xTaskCreate(restart_func, "restart_task", 2 * 1024, NULL, 10, NULL);
 }
 
+// evse command queue is full, client may retry
+static void send_busy(httpd_req_t* req)
+{
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_sendstr(req, "Busy");
+}
+
+// connector of /connectors/{connector} uri, action points behind it, -1 when missing or not exists
+static int get_uri_connector(httpd_req_t* req, char** action)
+{
+    const char* start = req->uri + strlen(REST_BASE_PATH"/connectors/");
+    long connector = strtol(start, action, 10);
+
+    if (*action == start || connector < 0 || connector >= board_config_get_connector_count()) {
+        return -1;
+    }
+
+    return connector;
+}
+
 cJSON* read_request_json(httpd_req_t* req)
 {
     char content_type[32];
@@ -200,9 +223,28 @@ esp_err_t get_handler(httpd_req_t* req)
         if (strcmp(req->uri, REST_BASE_PATH"/state") == 0) {
             root = http_json_get_state();
         }
+        if (strcmp(req->uri, REST_BASE_PATH"/connectors") == 0) {
+            root = http_json_get_connectors_state();
+        }
+        if (strncmp(req->uri, REST_BASE_PATH"/connectors/", strlen(REST_BASE_PATH"/connectors/")) == 0) {
+            char* action;
+            int connector = get_uri_connector(req, &action);
+            if (connector >= 0 && action[0] == '\0') {
+                root = http_json_get_connector_state(connector);
+            }
+        }
         if (strcmp(req->uri, REST_BASE_PATH"/time") == 0) {
             root = http_json_get_time();
         }
+        if (strcmp(req->uri, REST_BASE_PATH"/statistics") == 0) {
+            root = http_json_get_statistics();
+        }
+        if (strcmp(req->uri, REST_BASE_PATH"/harmonics") == 0) {
+            root = http_json_get_harmonics();
+        }
+        if (strcmp(req->uri, REST_BASE_PATH"/powerQuality") == 0) {
+            root = http_json_get_power_quality();
+        }
         if (strcmp(req->uri, REST_BASE_PATH"/config") == 0) {
             root = cJSON_CreateObject();
             cJSON_AddItemToObject(root, "evse", http_json_get_evse_config());
@@ -279,6 +321,7 @@ esp_err_t post_handler(httpd_req_t* req)
 
         if (strcmp(req->uri, REST_BASE_PATH"/config/evse") == 0) {
             ret = http_json_set_evse_config(root);
+            evse_wait_commands(EVSE_COMMAND_WAIT_MS);
         }
         if (strcmp(req->uri, REST_BASE_PATH"/config/wifi") == 0) {
             ret = http_json_set_wifi_config(root, true);
@@ -313,6 +356,10 @@ esp_err_t post_handler(httpd_req_t* req)
             httpd_resp_sendstr(req, "OK");
 
             return ESP_OK;
+        } else if (ret == ESP_ERR_NO_MEM) {
+            send_busy(req);
+
+            return ESP_FAIL;
         } else {
             httpd_resp_send_err(req, ret == ESP_ERR_INVALID_STATE ? HTTPD_500_INTERNAL_SERVER_ERROR : HTTPD_400_BAD_REQUEST, NULL);
 
@@ -323,6 +370,20 @@ esp_err_t post_handler(httpd_req_t* req)
     }
 }
 
+esp_err_t statistics_reset_post_handler(httpd_req_t* req)
+{
+    if (http_authorize_req(req)) {
+        evse_reset_stats();
+
+        httpd_resp_set_type(req, "text/plain");
+        httpd_resp_sendstr(req, "OK");
+
+        return ESP_OK;
+    } else {
+        return ESP_FAIL;
+    }
+}
+
 esp_err_t restart_post_handler(httpd_req_t* req)
 {
     if (http_authorize_req(req)) {
@@ -340,22 +401,29 @@ esp_err_t restart_post_handler(httpd_req_t* req)
 esp_err_t state_post_handler(httpd_req_t* req)
 {
     if (http_authorize_req(req)) {
-        httpd_resp_set_type(req, "text/plain");
+        esp_err_t ret = ESP_OK;
 
         if (strcmp(req->uri, REST_BASE_PATH"/state/authorize") == 0) {
-            evse_authorize();
+            ret = evse_authorize();
         }
         if (strcmp(req->uri, REST_BASE_PATH"/state/enable") == 0) {
-            evse_set_enabled(true);
+            ret = evse_set_enabled(true);
         }
         if (strcmp(req->uri, REST_BASE_PATH"/state/disable") == 0) {
-            evse_set_enabled(false);
+            ret = evse_set_enabled(false);
         }
         if (strcmp(req->uri, REST_BASE_PATH"/state/available") == 0) {
-            evse_set_available(true);
+            ret = evse_set_available(true);
         }
         if (strcmp(req->uri, REST_BASE_PATH"/state/unavailable") == 0) {
-            evse_set_available(false);
+            ret = evse_set_available(false);
+        }
+        evse_wait_commands(EVSE_COMMAND_WAIT_MS);
+
+        if (ret == ESP_ERR_NO_MEM) {
+            send_busy(req);
+
+            return ESP_FAIL;
         }
 
         httpd_resp_set_type(req, "text/plain");
@@ -367,6 +435,63 @@ esp_err_t state_post_handler(httpd_req_t* req)
     }
 }
 
+esp_err_t connector_post_handler(httpd_req_t* req)
+{
+    if (http_authorize_req(req)) {
+        char* action;
+        int connector = get_uri_connector(req, &action);
+        esp_err_t ret = ESP_ERR_INVALID_ARG;
+
+        if (connector < 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Connector not exists");
+
+            return ESP_FAIL;
+        }
+
+        if (strcmp(action, "/authorize") == 0) {
+            ret = evse_connector_authorize(connector);
+        }
+        if (strcmp(action, "/enable") == 0) {
+            ret = evse_connector_set_enabled(connector, true);
+        }
+        if (strcmp(action, "/disable") == 0) {
+            ret = evse_connector_set_enabled(connector, false);
+        }
+        if (strcmp(action, "/available") == 0) {
+            ret = evse_connector_set_available(connector, true);
+        }
+        if (strcmp(action, "/unavailable") == 0) {
+            ret = evse_connector_set_available(connector, false);
+        }
+        if (action[0] == '\0') {
+            cJSON* root = read_request_json(req);
+            if (root == NULL) {
+                return ESP_FAIL;
+            }
+            ret = http_json_set_connector(connector, root);
+            cJSON_Delete(root);
+        }
+        evse_wait_commands(EVSE_COMMAND_WAIT_MS);
+
+        if (ret == ESP_OK) {
+            httpd_resp_set_type(req, "text/plain");
+            httpd_resp_sendstr(req, "OK");
+
+            return ESP_OK;
+        } else if (ret == ESP_ERR_NO_MEM) {
+            send_busy(req);
+
+            return ESP_FAIL;
+        } else {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+
+            return ESP_FAIL;
+        }
+    } else {
+        return ESP_FAIL;
+    }
+}
+
 esp_err_t firmware_update_post_handler(httpd_req_t* req)
 {
     if (http_authorize_req(req)) {
@@ -588,9 +713,90 @@ esp_err_t script_output_get_handler(httpd_req_t* req)
     }
 }
 
+static const char* pilot_capture_state_str(pilot_capture_state_t state)
+{
+    switch (state)
+    {
+    case PILOT_CAPTURE_STATE_ARMED:
+        return "armed";
+    case PILOT_CAPTURE_STATE_DONE:
+        return "done";
+    default:
+        return "idle";
+    }
+}
+
+esp_err_t pilot_capture_get_handler(httpd_req_t* req)
+{
+    if (http_authorize_req(req)) {
+        httpd_resp_set_hdr(req, "X-State", pilot_capture_state_str(pilot_capture_get_state()));
+
+        uint8_t count = pilot_capture_get_count();
+        if (count == 0) {
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No capture");
+            return ESP_FAIL;
+        }
+
+        pilot_capture_frame_t* frame = (pilot_capture_frame_t*)malloc(sizeof(pilot_capture_frame_t));
+        if (frame == NULL) {
+            ESP_LOGE(TAG, "No memory for capture frame");
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+
+        httpd_resp_set_type(req, "text/csv");
+        httpd_resp_sendstr_chunk(req, "frame,time,raw,voltage,high,low\n");
+
+        char line[64];
+        for (uint8_t i = 0; i < count && pilot_capture_read(i, frame); i++) {
+            for (uint16_t j = 0; j < frame->count; j++) {
+                int64_t time = frame->time + (int64_t)j * 1000000 / frame->sample_freq;
+                int line_len = snprintf(line, sizeof(line), "%d,%lld,%d,%d,%d,%d\n", i, time, frame->raw[j], frame->voltage[j], frame->high, frame->low);
+                if (httpd_resp_send_chunk(req, line, line_len) != ESP_OK) {
+                    ESP_LOGE(TAG, "Sending failed");
+                    free((void*)frame);
+                    httpd_resp_sendstr_chunk(req, NULL);
+                    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+                    return ESP_FAIL;
+                }
+            }
+        }
+
+        free((void*)frame);
+        httpd_resp_send_chunk(req, NULL, 0);
+
+        return ESP_OK;
+    } else {
+        return ESP_FAIL;
+    }
+}
+
+esp_err_t pilot_capture_post_handler(httpd_req_t* req)
+{
+    if (http_authorize_req(req)) {
+        bool on_demand = true;
+        char buf[24];
+        char param[16];
+        if (httpd_req_get_url_query_str(req, buf, sizeof(buf)) == ESP_OK) {
+            if (httpd_query_key_value(buf, "trigger", param, sizeof(param)) == ESP_OK) {
+                on_demand = strcmp(param, "error") != 0;
+            }
+        }
+
+        pilot_capture_arm(on_demand);
+
+        httpd_resp_set_type(req, "text/plain");
+        httpd_resp_sendstr(req, "OK");
+
+        return ESP_OK;
+    } else {
+        return ESP_FAIL;
+    }
+}
+
 size_t http_rest_handlers_count(void)
 {
-    return 9;
+    return 13;
 }
 
 void http_rest_add_handlers(httpd_handle_t server)
@@ -609,6 +815,13 @@ void http_rest_add_handlers(httpd_handle_t server)
     };
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &script_output_get_uri));
 
+    httpd_uri_t pilot_capture_get_uri = {
+        .uri = REST_BASE_PATH"/pilot/capture",
+        .method = HTTP_GET,
+        .handler = pilot_capture_get_handler
+    };
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &pilot_capture_get_uri));
+
     httpd_uri_t get_uri = {
        .uri = REST_BASE_PATH"/*",
        .method = HTTP_GET,
@@ -623,6 +836,20 @@ void http_rest_add_handlers(httpd_handle_t server)
     };
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &state_post_uri));
 
+    httpd_uri_t connector_post_uri = {
+        .uri = REST_BASE_PATH"/connectors/*",
+        .method = HTTP_POST,
+        .handler = connector_post_handler
+    };
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &connector_post_uri));
+
+    httpd_uri_t statistics_reset_post_uri = {
+        .uri = REST_BASE_PATH"/statistics/reset",
+        .method = HTTP_POST,
+        .handler = statistics_reset_post_handler
+    };
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &statistics_reset_post_uri));
+
     httpd_uri_t restart_post_uri = {
         .uri = REST_BASE_PATH"/restart",
         .method = HTTP_POST,
@@ -651,6 +878,13 @@ void http_rest_add_handlers(httpd_handle_t server)
     };
     ESP_ERROR_CHECK(httpd_register_uri_handler(server, &script_reload_post_uri));
 
+    httpd_uri_t pilot_capture_post_uri = {
+        .uri = REST_BASE_PATH"/pilot/capture",
+        .method = HTTP_POST,
+        .handler = pilot_capture_post_handler
+    };
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &pilot_capture_post_uri));
+
     httpd_uri_t post_uri = {
        .uri = REST_BASE_PATH"/*",
        .method = HTTP_POST,
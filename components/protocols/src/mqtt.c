@@ -1,4 +1,5 @@
 #include <string.h>
+#include <sys/param.h>
 #include <math.h>
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
@@ -13,6 +14,7 @@
 #include "evse.h"
 #include "board_config.h"
 #include "energy_meter.h"
+#include "power_quality.h"
 #include "socket_lock.h"
 #include "temp_sensor.h"
 #include "proximity.h"
@@ -28,7 +30,7 @@
 #define ARRAY_SIZE(_x_) (sizeof(_x_)/sizeof((_x_)[0]))
 
 
-typedef void (*mqtt_value_set_handler)(char *data);
+typedef esp_err_t (*mqtt_value_set_handler)(char *data);
 
 struct mqtt_value_set_handlers_funcs
 {
@@ -51,7 +53,7 @@ static char mqtt_lwt_topic[64];
 
 static uint8_t mqtt_value_set_handler_count;
 
-static struct mqtt_value_set_handlers_funcs mqtt_value_set_handlers[18];
+static struct mqtt_value_set_handlers_funcs mqtt_value_set_handlers[20];
 
 static int replacechar(char *str, char orig, char rep)
 {
@@ -392,81 +394,101 @@ static void mqtt_cfg_button(
 }
 
 // Maximum charging current / ama
-static void mqtt_evse_set_max_charging_current(char* data) {
-    evse_set_max_charging_current((uint8_t)(atoi(data)));
+static esp_err_t mqtt_evse_set_max_charging_current(char* data) {
+    return evse_set_max_charging_current((uint8_t)(atoi(data)));
 }
 
 // Charging current / amp
-static void mqtt_evse_set_charging_current(char* data) {
-    evse_set_charging_current((uint16_t)(atoi(data) * 10));
+static esp_err_t mqtt_evse_set_charging_current(char* data) {
+    return evse_set_charging_current((uint16_t)(atoi(data) * 10));
 }
 
 // Temperature threshold / amt
-static void mqtt_evse_set_temp_threshold(char* data) {
-    evse_set_temp_threshold((uint8_t)(atoi(data)));
+static esp_err_t mqtt_evse_set_temp_threshold(char* data) {
+    return evse_set_temp_threshold((uint8_t)(atoi(data)));
 }
 
 // Default consumption limit / ate
-static void mqtt_evse_set_consumption_limit(char* data) {
-    evse_set_consumption_limit((uint32_t)(atoi(data)*1000));
+static esp_err_t mqtt_evse_set_consumption_limit(char* data) {
+    return evse_set_consumption_limit((uint32_t)(atoi(data)*1000));
 }
 
 // Default consumption limit / ate
-static void mqtt_evse_set_default_consumption_limit(char* data) {
+static esp_err_t mqtt_evse_set_default_consumption_limit(char* data) {
     evse_set_default_consumption_limit((uint32_t)(atoi(data)*1000));
+
+    return ESP_OK;
 }
 
 // Charging time limit / att
-static void mqtt_evse_set_charging_time_limit(char* data) {
-    evse_set_charging_time_limit((uint32_t)(atoi(data)*1000));
+static esp_err_t mqtt_evse_set_charging_time_limit(char* data) {
+    return evse_set_charging_time_limit((uint32_t)(atoi(data)*1000));
 }
 
 // Default charging time limit
-static void mqtt_evse_set_default_charging_time_limit(char* data) {
+static esp_err_t mqtt_evse_set_default_charging_time_limit(char* data) {
     evse_set_default_charging_time_limit((uint32_t)(atoi(data)*1000));
+
+    return ESP_OK;
 }
 
 // Under power limit / upl
-static void mqtt_evse_set_under_power_limit(char* data) {
-    evse_set_under_power_limit((uint32_t)(atoi(data)*1000));
+static esp_err_t mqtt_evse_set_under_power_limit(char* data) {
+    return evse_set_under_power_limit((uint32_t)(atoi(data)*1000));
 }
 
 // Default under power limit / upl
-static void mqtt_evse_set_default_under_power_limit(char* data) {
+static esp_err_t mqtt_evse_set_default_under_power_limit(char* data) {
     evse_set_default_under_power_limit((uint32_t)(atoi(data)*1000));
+
+    return ESP_OK;
 }
 
 // AC Voltage /acv
-static void mqtt_evse_set_ac_voltage(char* data) {
-  energy_meter_set_ac_voltage((uint16_t)(atoi(data)));
+static esp_err_t mqtt_evse_set_ac_voltage(char* data) {
+  return energy_meter_set_ac_voltage((uint16_t)(atoi(data)));
 }
   // Energy meter mode / emm
-static void mqtt_evse_set_energy_meter_mode(char* data) {
-    energy_meter_set_mode(energy_meter_str_to_mode_mqtt(data));
+static esp_err_t mqtt_evse_set_energy_meter_mode(char* data) {
+    return energy_meter_set_mode(energy_meter_str_to_mode_mqtt(data));
 }
 
 // Set charger state / scs
-static void mqtt_evse_set_charger_state(char* data) {
-  evse_set_enabled(strcmp(data, "ON")==0 ? true : false);
+static esp_err_t mqtt_evse_set_charger_state(char* data) {
+  return evse_set_enabled(strcmp(data, "ON")==0 ? true : false);
+}
+
+// Second connector charging current / c2amp
+static esp_err_t mqtt_connector_2_set_charging_current(char* data) {
+    return evse_connector_set_charging_current(1, (uint16_t)(atoi(data) * 10));
+}
+
+// Second connector set charger state / c2scs
+static esp_err_t mqtt_connector_2_set_charger_state(char* data) {
+    return evse_connector_set_enabled(1, strcmp(data, "ON")==0 ? true : false);
 }
 
 // Card authorization required / acs
-static void mqtt_evse_set_require_auth(char* data) {
+static esp_err_t mqtt_evse_set_require_auth(char* data) {
     evse_set_require_auth(strcmp(data, "ON")==0 ? true : false);
+
+    return ESP_OK;
 }
 
 // Socket outlet / sol
-static void mqtt_evse_set_socket_outlet(char* data) {
-    evse_set_socket_outlet(strcmp(data, "ON")==0 ? true : false);
+static esp_err_t mqtt_evse_set_socket_outlet(char* data) {
+    return evse_set_socket_outlet(strcmp(data, "ON")==0 ? true : false);
 }
 
 // Aux power outlet / pol
-static void mqtt_aux_set_power_outlet(char* data) {
+static esp_err_t mqtt_aux_set_power_outlet(char* data) {
     power_outlet_set_state(strcmp(data, "ON")==0 ? true : false);
+
+    return ESP_OK;
 }
 
 // Disable/enable buttos / enb
-static void mqtt_enable_disable_buttons(char* data) {
+static esp_err_t mqtt_enable_disable_buttons(char* data) {
     bool enabled = strcmp(data, "ON")==0 ? true : false;
 
     if (board_config.button_evse_enable) {
@@ -475,12 +497,16 @@ static void mqtt_enable_disable_buttons(char* data) {
     if (board_config.button_aux1) {
         button_set_button_state(BUTTON_ID_AUX1, enabled);
     }
+
+    return ESP_OK;
 }
 
 // Restart the device
-static void mqtt_evse_reboot(char* data) {
+static esp_err_t mqtt_evse_reboot(char* data) {
     evse_set_available(false);
     esp_restart();
+
+    return ESP_OK;
 }
 
 static void mqtt_subscribe_send_ha_discovery(esp_mqtt_client_handle_t client)
@@ -504,6 +530,7 @@ static void mqtt_subscribe_send_ha_discovery(esp_mqtt_client_handle_t client)
     mqtt_cfg_sensor(client, 0, "cdi"   , "Charging duration"          , "mdi:timer-outline"           , "s"  , ""                  , "measurement"     , "", false);
     mqtt_cfg_sensor(client, 0, "err"   , "Error code"                 , "mdi:alert-circle-outline"    , ""   , ""                  , ""                , "", false);
     mqtt_cfg_sensor(client, 0, "eto"   , "Total energy"               , ""                            , "Wh" , "energy"            , "total_increasing", "", false);
+    mqtt_cfg_sensor(client, 0, "elt"   , "Lifetime energy"            , ""                            , "kWh", "energy"            , "total_increasing", "", false);
     mqtt_cfg_sensor(client, 0, "lst"   , "Last session time"          , "mdi:counter"                 , "s"  , ""                  , "measurement"     , "", false);
     mqtt_cfg_sensor(client, 1, "nrg"   , "Voltage L1"                 , ""                            , "V"  , "voltage"           , "measurement"     , "", false);
     mqtt_cfg_sensor(client, 2, "nrg"   , "Voltage L2"                 , ""                            , "V"  , "voltage"           , "measurement"     , "", false);
@@ -512,6 +539,18 @@ static void mqtt_subscribe_send_ha_discovery(esp_mqtt_client_handle_t client)
     mqtt_cfg_sensor(client, 5, "nrg"   , "Current L2"                 , ""                            , "A"  , "current"           , "measurement"     , "", false);
     mqtt_cfg_sensor(client, 6, "nrg"   , "Current L3"                 , ""                            , "A"  , "current"           , "measurement"     , "", false);
     mqtt_cfg_sensor(client, 7, "nrg"   , "Current power"              , ""                            , "W"  , "power"             , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 8, "nrg"   , "Apparent power"             , ""                            , "VA" , "apparent_power"    , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 9, "nrg"   , "Power factor"               , ""                            , ""   , "power_factor"      , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 10, "nrg"  , "Power L1"                   , ""                            , "W"  , "power"             , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 11, "nrg"  , "Power L2"                   , ""                            , "W"  , "power"             , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 12, "nrg"  , "Power L3"                   , ""                            , "W"  , "power"             , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 13, "nrg"  , "Frequency"                  , ""                            , "Hz" , "frequency"         , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 1, "hrm"   , "THD L1"                     , "mdi:sine-wave"               , "%"  , ""                  , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 2, "hrm"   , "THD L2"                     , "mdi:sine-wave"               , "%"  , ""                  , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 3, "hrm"   , "THD L3"                     , "mdi:sine-wave"               , "%"  , ""                  , "measurement"     , "", false);
+    mqtt_cfg_sensor(client, 1, "pqe"   , "Voltage event"              , "mdi:flash-alert"             , ""   , ""                  , ""                , "", false);
+    mqtt_cfg_sensor(client, 2, "pqe"   , "Voltage event duration"     , "mdi:timer-outline"           , "ms" , "duration"          , ""                , "", false);
+    mqtt_cfg_sensor(client, 3, "pqe"   , "Voltage event extreme"      , ""                            , "V"  , "voltage"           , ""                , "", false);
     mqtt_cfg_sensor(client, 0, "rcd"   , "Residual current detection" , "mdi:current-dc"              , ""   , ""                  , ""                , "", false);
     mqtt_cfg_sensor(client, 0, "status", "Status"                     , "mdi:heart-pulse"             , ""   , ""                  , ""                , "", false);
     mqtt_cfg_sensor(client, 1, "tma"   , "Temperature sensor error"   , ""                            , ""   , ""                  , ""                , "", false);
@@ -545,7 +584,7 @@ static void mqtt_subscribe_send_ha_discovery(esp_mqtt_client_handle_t client)
     mqtt_cfg_select_range(client, "amp", "Charging current"           , "mdi:current-ac"   , 6  , 32 , 1   , mqtt_evse_set_charging_current);
 
     // Select:              Field | User Friendly Name | Icon                | Options
-    mqtt_cfg_select(client, "emm" , "Energy meter mode", "mdi:meter-electric", "\"Dummy\",\"Current sensing\",\"Current and voltage sensing\"", mqtt_evse_set_energy_meter_mode);
+    mqtt_cfg_select(client, "emm" , "Energy meter mode", "mdi:meter-electric", "\"Dummy\",\"Current sensing\",\"Current and voltage sensing\",\"Modbus meter\"", mqtt_evse_set_energy_meter_mode);
 
     // Switch:              Field| User Friendly Name           | Icon                 | Device Class| Value Set Handler
     mqtt_cfg_switch(client, "scs", "Set charger state"          , "mdi:auto-fix"       , "switch"    , mqtt_evse_set_charger_state);
@@ -557,6 +596,14 @@ static void mqtt_subscribe_send_ha_discovery(esp_mqtt_client_handle_t client)
     // Button:                  Field| User Friendly Name  | Icon| Device Class| Value Set Handler
     mqtt_cfg_button(client, "restart", "Restart the device", ""  , "restart"   , mqtt_evse_reboot);
 
+    // Second connector, metering, limits and socket lock are of first connector
+    if (evse_get_connector_count() > 1) {
+        mqtt_cfg_sensor(client, 0, "c2status", "Connector 2 status"             , "mdi:heart-pulse"         , "", "", "", "", false);
+        mqtt_cfg_sensor(client, 0, "c2err"   , "Connector 2 error code"         , "mdi:alert-circle-outline", "", "", "", "", false);
+        mqtt_cfg_select_range(client, "c2amp", "Connector 2 charging current"   , "mdi:current-ac", 6, 32, 1, mqtt_connector_2_set_charging_current);
+        mqtt_cfg_switch(client, "c2scs"      , "Connector 2 set charger state"  , "mdi:auto-fix", "switch", mqtt_connector_2_set_charger_state);
+    }
+
     for (uint8_t i=0; i < mqtt_value_set_handler_count; i++) {
         ESP_LOGD(TAG,
             "Handler index=%d topic=%s handler=%x",
@@ -635,6 +682,9 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
   char payload[512];
   char tmp[64];
 
+  evse_snapshot_t snapshot;
+  evse_get_snapshot(&snapshot);
+
   // Cable maximum current
   static uint8_t prev_cbl = 0;
   uint8_t cbl = proximity_get_max_current();
@@ -647,7 +697,7 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
 
   // Current charger state
   static bool prev_ccs = 0;
-  bool ccs = evse_is_enabled();
+  bool ccs = snapshot.enabled;
   if (force || (ccs != prev_ccs)) {
       sprintf(topic, "%s/ccs", mqtt_main_topic);
       sprintf(payload, "%s", (ccs? "Charging enabled":"Charging Disabled") );
@@ -657,7 +707,7 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
 
   // Charging duration
   static uint32_t prev_cdi = 0;
-  uint32_t cdi = energy_meter_get_charging_time();
+  uint32_t cdi = snapshot.charging_time;
   if (force || (cdi != prev_cdi)) {
       sprintf(topic, "%s/cdi", mqtt_main_topic);
       sprintf(payload, "%ld", cdi);
@@ -667,7 +717,7 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
 
   // Error code
   static uint32_t prev_err = 0;
-  uint32_t err = evse_get_error();
+  uint32_t err = snapshot.error;
   if (force || (err != prev_err)) {
       sprintf(topic, "%s/err", mqtt_main_topic);
       sprintf(payload, "%s", evse_error_to_str(err));
@@ -676,18 +726,28 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
   }
 
   // Total energy
-  static uint32_t prev_eto = 0;
-  uint32_t eto = energy_meter_get_consumption();
+  static uint64_t prev_eto = 0;
+  uint64_t eto = snapshot.consumption_mwh;
   if (force || (eto != prev_eto)) {
       sprintf(topic, "%s/eto", mqtt_main_topic);
-      sprintf(payload, "%ld", eto);
+      sprintf(payload, "%.3f", eto / 1000.0);
       esp_mqtt_client_publish(client, topic, payload, 0, /*qos*/0, /*retain*/0);
       prev_eto = eto;
   }
 
+  // Lifetime energy
+  static uint64_t prev_elt = 0;
+  uint64_t elt = snapshot.total_consumption / 1000;
+  if (force || (elt != prev_elt)) {
+      sprintf(topic, "%s/elt", mqtt_main_topic);
+      sprintf(payload, "%.3f", elt / 1000.0);
+      esp_mqtt_client_publish(client, topic, payload, 0, /*qos*/0, /*retain*/1);
+      prev_elt = elt;
+  }
+
   // Last session time
   static uint32_t prev_lst = 0;
-  uint32_t lst = energy_meter_get_session_time();
+  uint32_t lst = snapshot.session_time;
   if (force || (lst != prev_lst)) {
       sprintf(topic, "%s/lst", mqtt_main_topic);
       sprintf(payload, "%ld", lst);
@@ -703,17 +763,30 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
   static float prev_l2c = 0.0;
   static float prev_l3c = 0.0;
   static uint16_t prev_pwr = 0;
-  float l1v = energy_meter_get_l1_voltage();
-  float l2v = energy_meter_get_l2_voltage();
-  float l3v = energy_meter_get_l3_voltage();
-  float l1c = energy_meter_get_l1_current();
-  float l2c = energy_meter_get_l2_current();
-  float l3c = energy_meter_get_l3_current();
-  uint16_t pwr = energy_meter_get_power();
+  static uint16_t prev_apwr = 0;
+  static float prev_pf = 0.0;
+  static float prev_l1p = 0.0;
+  static float prev_l2p = 0.0;
+  static float prev_l3p = 0.0;
+  static float prev_frq = 0.0;
+  float l1v = snapshot.voltage[0];
+  float l2v = snapshot.voltage[1];
+  float l3v = snapshot.voltage[2];
+  float l1c = snapshot.current[0];
+  float l2c = snapshot.current[1];
+  float l3c = snapshot.current[2];
+  uint16_t pwr = snapshot.power;
+  uint16_t apwr = snapshot.apparent_power;
+  float pf = snapshot.power_factor;
+  float l1p = snapshot.phase_power[0];
+  float l2p = snapshot.phase_power[1];
+  float l3p = snapshot.phase_power[2];
+  float frq = snapshot.frequency;
   if (force ||
       ((l1v != prev_l1v) || (l2v != prev_l2v) || (l3v != prev_l3v) ||
        (l1c != prev_l1c) || (l2c != prev_l2c) || (l3c != prev_l3c) ||
-       (pwr != prev_pwr))) {
+       (pwr != prev_pwr) || (apwr != prev_apwr) || (pf != prev_pf) ||
+       (l1p != prev_l1p) || (l2p != prev_l2p) || (l3p != prev_l3p) || (frq != prev_frq))) {
       sprintf(topic, "%s/nrg", mqtt_main_topic);
       sprintf(payload, "{");
       // Voltage L1 / L2 / L3
@@ -731,7 +804,22 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
       sprintf(tmp, "\"current_l3\":%f,", l3c);
       strcat(payload, tmp);
       // Current power
-      sprintf(tmp, "\"current_power\":%d}", pwr);
+      sprintf(tmp, "\"current_power\":%d,", pwr);
+      strcat(payload, tmp);
+      // Apparent power / power factor
+      sprintf(tmp, "\"apparent_power\":%d,", apwr);
+      strcat(payload, tmp);
+      sprintf(tmp, "\"power_factor\":%f,", pf);
+      strcat(payload, tmp);
+      // Power L1 / L2 / L3
+      sprintf(tmp, "\"power_l1\":%f,", l1p);
+      strcat(payload, tmp);
+      sprintf(tmp, "\"power_l2\":%f,", l2p);
+      strcat(payload, tmp);
+      sprintf(tmp, "\"power_l3\":%f,", l3p);
+      strcat(payload, tmp);
+      // Frequency
+      sprintf(tmp, "\"frequency\":%f}", frq);
       strcat(payload, tmp);
       esp_mqtt_client_publish(client, topic, payload, 0, /*qos*/0, /*retain*/0);
       prev_l1v = l1v;
@@ -741,6 +829,49 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
       prev_l2c = l2c;
       prev_l3c = l3c;
       prev_pwr = pwr;
+      prev_apwr = apwr;
+      prev_pf = pf;
+      prev_l1p = l1p;
+      prev_l2p = l2p;
+      prev_l3p = l3p;
+      prev_frq = frq;
+  }
+
+  // THD and harmonics L1 / L2 / L3
+  static float prev_thd[3] = { 0, 0, 0 };
+  static float prev_harmonics[3][ENERGY_METER_HARMONICS];
+  float thd[3];
+  float harmonics[3][ENERGY_METER_HARMONICS];
+  energy_meter_get_harmonics(thd, harmonics);
+  if (force || memcmp(thd, prev_thd, sizeof(thd)) || memcmp(harmonics, prev_harmonics, sizeof(harmonics))) {
+      sprintf(topic, "%s/hrm", mqtt_main_topic);
+      sprintf(payload, "{");
+      for (uint8_t p = 0; p < 3; p++) {
+          sprintf(tmp, "\"thd_l%d\":%.2f,\"harmonics_l%d\":[", p + 1, thd[p], p + 1);
+          strcat(payload, tmp);
+          for (uint8_t h = 0; h < ENERGY_METER_HARMONICS; h++) {
+              sprintf(tmp, "%.2f%s", harmonics[p][h], h < ENERGY_METER_HARMONICS - 1 ? "," : "]");
+              strcat(payload, tmp);
+          }
+          strcat(payload, p < 2 ? "," : "}");
+      }
+      esp_mqtt_client_publish(client, topic, payload, 0, /*qos*/0, /*retain*/0);
+      memcpy(prev_thd, thd, sizeof(thd));
+      memcpy(prev_harmonics, harmonics, sizeof(harmonics));
+  }
+
+  // Power quality events, each finished event once
+  static uint32_t prev_pqe_id = 0;
+  static power_quality_event_t events[POWER_QUALITY_EVENTS];
+  uint8_t event_count = power_quality_get_events(events);
+  for (uint8_t i = 0; i < event_count; i++) {
+      if (events[i].id > prev_pqe_id) {
+          sprintf(topic, "%s/pqe", mqtt_main_topic);
+          sprintf(payload, "{\"id\":%" PRIu32 ",\"voltage_event\":\"%s L%d\",\"voltage_event_duration\":%" PRIu32 ",\"voltage_event_extreme\":%.1f,\"time\":%lld}",
+                  events[i].id, power_quality_event_type_to_str(events[i].type), events[i].phase + 1, events[i].duration, events[i].voltage, (long long)events[i].time);
+          esp_mqtt_client_publish(client, topic, payload, 0, /*qos*/1, /*retain*/0);
+          prev_pqe_id = events[i].id;
+      }
   }
 
   // Residual current detection
@@ -755,7 +886,7 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
 
   // Status
   static evse_state_t prev_status = EVSE_STATE_A;
-  evse_state_t status = evse_get_state();
+  evse_state_t status = snapshot.state;
   if (force || (status != prev_status)) {
       sprintf(topic, "%s/status", mqtt_main_topic);
       sprintf(payload, "%s", evse_state_to_str_long(status));
@@ -822,6 +953,54 @@ static void mqtt_publish_evse_sensor_data(esp_mqtt_client_handle_t client, bool
 
 }
 
+static void mqtt_publish_connector_data(esp_mqtt_client_handle_t client, bool force) {
+
+  char topic[64];
+  char payload[512];
+
+  evse_snapshot_t snapshot;
+  if (evse_connector_get_snapshot(1, &snapshot) != ESP_OK) {
+      return;
+  }
+
+  // Second connector status
+  static evse_state_t prev_status = EVSE_STATE_A;
+  if (force || (snapshot.state != prev_status)) {
+      sprintf(topic, "%s/c2status", mqtt_main_topic);
+      sprintf(payload, "%s", evse_state_to_str_long(snapshot.state));
+      esp_mqtt_client_publish(client, topic, payload, 0, /*qos*/1, /*retain*/1);
+      prev_status = snapshot.state;
+  }
+
+  // Second connector error code
+  static uint32_t prev_err = 0;
+  if (force || (snapshot.error != prev_err)) {
+      sprintf(topic, "%s/c2err", mqtt_main_topic);
+      sprintf(payload, "%s", evse_error_to_str(snapshot.error));
+      esp_mqtt_client_publish(client, topic, payload, 0, /*qos*/1, /*retain*/1);
+      prev_err = snapshot.error;
+  }
+
+  // Second connector requested current
+  static uint16_t prev_amp = 0;
+  uint16_t amp = snapshot.charging_current / 10;
+  if (force || (amp != prev_amp)) {
+      sprintf(topic, "%s/c2amp", mqtt_main_topic);
+      sprintf(payload, "%uA", amp);
+      esp_mqtt_client_publish(client, topic, payload, 0, /*qos*/0, /*retain*/0);
+      prev_amp = amp;
+  }
+
+  // Second connector set charger state
+  static bool prev_scs = 0;
+  if (force || (snapshot.enabled != prev_scs)) {
+      sprintf(topic, "%s/c2scs", mqtt_main_topic);
+      sprintf(payload, "%s", snapshot.enabled ? "ON": "OFF");
+      esp_mqtt_client_publish(client, topic, payload, 0, /*qos*/1, /*retain*/0);
+      prev_scs = snapshot.enabled;
+  }
+}
+
 static void mqtt_publish_evse_number_data(esp_mqtt_client_handle_t client, bool force) {
 
   char topic[64];
@@ -1018,6 +1197,7 @@ static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_
         mqtt_publish_static_data(client);
         mqtt_publish_system_data(client, true);
         mqtt_publish_evse_sensor_data(client, true);
+        mqtt_publish_connector_data(client, true);
         mqtt_publish_evse_number_data(client, true);
         mqtt_publish_evse_select_data(client, true);
         mqtt_publish_evse_switch_data(client, true);
@@ -1038,7 +1218,15 @@ static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_
         for (uint8_t i=0; i < mqtt_value_set_handler_count; i++) {
             if (strcmp(topic, mqtt_value_set_handlers[i].command_topic) == 0) {
                 if (mqtt_value_set_handlers[i].handler) {
-                    mqtt_value_set_handlers[i].handler(data);
+                    esp_err_t err = mqtt_value_set_handlers[i].handler(data);
+                    if (err != ESP_OK) {
+                        // error published next to command topic, state topics keep current value
+                        char error_topic[64];
+                        ESP_LOGW(TAG, "MQTT set %s failed: %s", topic, esp_err_to_name(err));
+                        snprintf(error_topic, sizeof(error_topic), "%.*s/error", (int)(strlen(topic) - strlen("/set")), topic);
+                        esp_mqtt_client_publish(client, error_topic, esp_err_to_name(err), 0, /*qos*/1, /*retain*/0);
+                    }
+                    evse_wait_commands(EVSE_COMMAND_WAIT_MS);
                     mqtt_publish_evse_switch_data(client, true);
                 }
                 break;
@@ -1062,6 +1250,11 @@ static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_
     }
 }
 
+static void evse_event_handler(uint8_t connector, uint32_t events, void* arg)
+{
+    xTaskNotifyGive(mqtt_task);
+}
+
 static void mqtt_task_func(void* param)
 {
     mqtt_connected = false;
@@ -1106,10 +1299,24 @@ static void mqtt_task_func(void* param)
     }
     ESP_LOGI(TAG, "MQTT service running");
 
+    evse_subscribe(EVSE_EVENT_ALL_BITS, evse_event_handler, NULL);
+
     uint32_t static_data_publish_counter = 0;
     bool force = false;
+    TickType_t next_publish_time = xTaskGetTickCount() + pdMS_TO_TICKS(1000);
     while (true) {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        int32_t timeout = next_publish_time - xTaskGetTickCount();
+        if (ulTaskNotifyTake(pdTRUE, MAX(timeout, 0)) && mqtt_connected) {
+            // publish only changed values, immediately
+            mqtt_publish_evse_sensor_data(client, false);
+            mqtt_publish_connector_data(client, false);
+            mqtt_publish_evse_number_data(client, false);
+            mqtt_publish_evse_switch_data(client, false);
+        }
+        if ((int32_t)(next_publish_time - xTaskGetTickCount()) > 0) {
+            continue;
+        }
+        next_publish_time += pdMS_TO_TICKS(1000);
 
         if (!mqtt_connected) {
             // Wait until MQTT is connected correctly
@@ -1126,6 +1333,7 @@ static void mqtt_task_func(void* param)
         if ((static_data_publish_counter % 10) == 0) {
             mqtt_publish_system_data(client, force);
             mqtt_publish_evse_sensor_data(client, force);
+            mqtt_publish_connector_data(client, force);
             mqtt_publish_evse_number_data(client, force);
             mqtt_publish_evse_select_data(client, force);
             mqtt_publish_evse_switch_data(client, force);
@@ -7,7 +7,6 @@
 
 #include "l_evse_lib.h"
 #include "evse.h"
-#include "energy_meter.h"
 #include "temp_sensor.h"
 
 #include "esp_log.h"
@@ -23,41 +22,66 @@ typedef struct
 
 static int userdata_ref = LUA_NOREF;
 
+static uint32_t pending_events = 0;
+
+static bool subscribed = false;
+
+static void evse_event_handler(uint8_t connector, uint32_t events, void* arg)
+{
+    if (connector == 0) {
+        __atomic_fetch_or(&pending_events, events, __ATOMIC_RELAXED);
+    }
+}
+
 static int l_get_state(lua_State* L)
 {
-    lua_pushinteger(L, evse_get_state());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushinteger(L, snapshot.state);
     return 1;
 }
 
 static int l_get_error(lua_State* L)
 {
-    lua_pushinteger(L, evse_get_error());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushinteger(L, snapshot.error);
     return 1;
 }
 
 static int l_get_enabled(lua_State* L)
 {
-    lua_pushboolean(L, evse_is_enabled());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushboolean(L, snapshot.enabled);
     return 1;
 }
 
 static int l_set_enabled(lua_State* L)
 {
     luaL_argcheck(L, lua_isboolean(L, 1), 1, "Must be boolean");
-    evse_set_enabled(lua_toboolean(L, 1));
+    if (evse_set_enabled(lua_toboolean(L, 1)) != ESP_OK) {
+        luaL_error(L, "command queue full");
+    }
+    evse_wait_commands(EVSE_COMMAND_WAIT_MS);
     return 0;
 }
 
 static int l_get_available(lua_State* L)
 {
-    lua_pushboolean(L, evse_is_available());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushboolean(L, snapshot.available);
     return 1;
 }
 
 static int l_set_available(lua_State* L)
 {
     luaL_argcheck(L, lua_isboolean(L, 1), 1, "Must be boolean");
-    evse_set_available(lua_toboolean(L, 1));
+    if (evse_set_available(lua_toboolean(L, 1)) != ESP_OK) {
+        luaL_error(L, "command queue full");
+    }
+    evse_wait_commands(EVSE_COMMAND_WAIT_MS);
     return 0;
 }
 
@@ -69,7 +93,9 @@ static int l_get_max_charging_current(lua_State* L)
 
 static int l_get_charging_current(lua_State* L)
 {
-    lua_pushnumber(L, evse_get_charging_current() / 10.0f);
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushnumber(L, snapshot.charging_current / 10.0f);
     return 1;
 }
 
@@ -77,12 +103,22 @@ static int l_set_charging_current(lua_State* L)
 {
     luaL_argcheck(L, lua_isnumber(L, 1), 1, "Must be number");
     uint16_t value = round(lua_tonumber(L, 1) * 10);
-    if (evse_set_charging_current(value) != ESP_OK) {
+    esp_err_t err = evse_set_charging_current(value);
+    if (err == ESP_ERR_NO_MEM) {
+        luaL_error(L, "command queue full");
+    } else if (err != ESP_OK) {
         luaL_argerror(L, 1, "Invalid value");
     }
+    evse_wait_commands(EVSE_COMMAND_WAIT_MS);
     return 0;
 }
 
+static int l_get_offered_current(lua_State* L)
+{
+    lua_pushnumber(L, evse_get_offered_current() / 10.0f);
+    return 1;
+}
+
 static int l_get_default_charging_current(lua_State* L)
 {
     lua_pushnumber(L, evse_get_default_charging_current() / 10.0f);
@@ -101,41 +137,53 @@ static int l_set_default_charging_current(lua_State* L)
 
 static int l_get_power(lua_State* L)
 {
-    lua_pushinteger(L, energy_meter_get_power());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushinteger(L, snapshot.power);
     return 1;
 }
 
 static int l_get_charging_time(lua_State* L)
 {
-    lua_pushinteger(L, energy_meter_get_charging_time());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushinteger(L, snapshot.charging_time);
     return 1;
 }
 
 static int l_get_session_time(lua_State* L)
 {
-    lua_pushinteger(L, energy_meter_get_session_time());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushinteger(L, snapshot.session_time);
     return 1;
 }
 
 static int l_get_consumption(lua_State* L)
 {
-    lua_pushinteger(L, energy_meter_get_consumption());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushinteger(L, snapshot.consumption);
     return 1;
 }
 
 static int l_get_voltage(lua_State* L)
 {
-    lua_pushnumber(L, energy_meter_get_l1_voltage());
-    lua_pushnumber(L, energy_meter_get_l2_voltage());
-    lua_pushnumber(L, energy_meter_get_l3_voltage());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushnumber(L, snapshot.voltage[0]);
+    lua_pushnumber(L, snapshot.voltage[1]);
+    lua_pushnumber(L, snapshot.voltage[2]);
     return 3;
 }
 
 static int l_get_current(lua_State* L)
 {
-    lua_pushnumber(L, energy_meter_get_l1_current());
-    lua_pushnumber(L, energy_meter_get_l2_current());
-    lua_pushnumber(L, energy_meter_get_l3_current());
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    lua_pushnumber(L, snapshot.current[0]);
+    lua_pushnumber(L, snapshot.current[1]);
+    lua_pushnumber(L, snapshot.current[2]);
     return 3;
 }
 
@@ -212,6 +260,8 @@ void l_evse_process(lua_State* L)
         every_10s = true;
     }
 
+    bool changed = __atomic_exchange_n(&pending_events, 0, __ATOMIC_RELAXED) != 0;
+
     lua_rawgeti(L, LUA_REGISTRYINDEX, userdata->drivers_ref);
 
     int len = lua_rawlen(L, -1);
@@ -219,6 +269,9 @@ void l_evse_process(lua_State* L)
         lua_rawgeti(L, -1, i);
 
         call_field_event(L, "loop");
+        if (changed) {
+            call_field_event(L, "changed");
+        }
         if (every_100ms) {
             call_field_event(L, "every100ms");
         }
@@ -296,6 +349,7 @@ static const luaL_Reg lib[] = {
     {"getmaxchargingcurrent", l_get_max_charging_current},
     {"getchargingcurrent",  l_get_charging_current},
     {"setchargingcurrent",  l_set_charging_current},
+    {"getofferedcurrent",   l_get_offered_current},
     {"getdefaultchargingcurrent", l_get_default_charging_current},
     {"setdefaultchargingcurrent", l_set_default_charging_current},
     {"getpower",            l_get_power},
@@ -374,6 +428,11 @@ int luaopen_evse(lua_State* L)
     userdata->tick_1s = now;
     userdata->tick_10s = now;
 
+    if (!subscribed) {
+        subscribed = evse_subscribe(EVSE_EVENT_ALL_BITS, evse_event_handler, NULL) == ESP_OK;
+    }
+    __atomic_store_n(&pending_events, 0, __ATOMIC_RELAXED);
+
     lua_newtable(L);
     userdata->drivers_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
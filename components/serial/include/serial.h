@@ -28,9 +28,37 @@ typedef enum
     SERIAL_MODE_LOG,
     SERIAL_MODE_MODBUS,
     SERIAL_MODE_NEXTION,
+    SERIAL_MODE_METER,
     SERIAL_MODE_MAX
 } serial_mode_t;
 
+/**
+ * @brief Register map profiles of external energy meters, used in SERIAL_MODE_METER
+ *
+ */
+typedef enum
+{
+    SERIAL_METER_PROFILE_SDM630,
+    SERIAL_METER_PROFILE_SDM120,
+    SERIAL_METER_PROFILE_ABB,
+    SERIAL_METER_PROFILE_EM340,
+    SERIAL_METER_PROFILE_MAX
+} serial_meter_profile_t;
+
+/**
+ * @brief External energy meter polling statistics
+ *
+ */
+typedef struct
+{
+    uint32_t polls;
+    uint32_t errors;                // failed polls, including timeouts
+    uint32_t timeouts;
+    uint32_t requests;              // per poll
+    uint32_t latency;               // ms, last successful poll
+    uint32_t max_latency;           // ms
+} serial_meter_stats_t;
+
 /**
  * @brief Initialize serial
  *
@@ -106,6 +134,36 @@ void serial_reset_config(void);
 
 esp_err_t serial_set_config(serial_id_t id, serial_mode_t mode, int baud_rate, uart_word_length_t data_bits, uart_stop_bits_t stop_bits, uart_parity_t parity);
 
+/**
+ * @brief Get external energy meter profile, stored in NVS
+ *
+ * @return serial_meter_profile_t
+ */
+serial_meter_profile_t serial_get_meter_profile(void);
+
+/**
+ * @brief Get external energy meter Modbus address, stored in NVS
+ *
+ * @return uint8_t
+ */
+uint8_t serial_get_meter_address(void);
+
+/**
+ * @brief Set external energy meter config, stored in NVS, applied on next serial_set_config
+ *
+ * @param profile
+ * @param address Modbus address 1 - 247
+ * @return esp_err_t
+ */
+esp_err_t serial_set_meter_config(serial_meter_profile_t profile, uint8_t address);
+
+/**
+ * @brief Get external energy meter polling statistics
+ *
+ * @param stats
+ */
+void serial_get_meter_stats(serial_meter_stats_t* stats);
+
 /**
  * @brief Format to string value
  *
@@ -122,6 +180,22 @@ const char* serial_mode_to_str(serial_mode_t mode);
  */
 serial_mode_t serial_str_to_mode(const char* str);
 
+/**
+ * @brief Format to string value
+ *
+ * @param profile
+ * @return const char*
+ */
+const char* serial_meter_profile_to_str(serial_meter_profile_t profile);
+
+/**
+ * @brief Parse from string value
+ *
+ * @param str
+ * @return serial_meter_profile_t
+ */
+serial_meter_profile_t serial_str_to_meter_profile(const char* str);
+
 /**
  * @brief Format to string value
  *
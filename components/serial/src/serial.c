@@ -7,6 +7,7 @@
 #include "board_config.h"
 #include "serial.h"
 #include "serial_logger.h"
+#include "serial_meter.h"
 #include "serial_modbus.h"
 #include "serial_nextion.h"
 
@@ -19,6 +20,8 @@
 #define NVS_DATA_BITS           "data_bits_%x"
 #define NVS_STOP_BITS           "stop_bits_%x"
 #define NVS_PARITY              "parity_%x"
+#define NVS_METER_PROFILE       "meter_profile"
+#define NVS_METER_ADDRESS       "meter_address"
 
 static const char* TAG = "serial";
 
@@ -40,6 +43,9 @@ static void serial_start(serial_id_t id, uint32_t baud_rate, uart_word_length_t
     case SERIAL_MODE_NEXTION:
         serial_nextion_start(id, baud_rate, data_bits, stop_bits, parity, serial_board_config[id] == BOARD_CONFIG_SERIAL_RS485);
         break;
+    case SERIAL_MODE_METER:
+        serial_meter_start(id, baud_rate, data_bits, stop_bits, parity, serial_board_config[id] == BOARD_CONFIG_SERIAL_RS485, serial_get_meter_profile(), serial_get_meter_address());
+        break;
     default:
         break;
     }
@@ -57,6 +63,9 @@ static void serial_stop(serial_id_t id)
     case SERIAL_MODE_NEXTION:
         serial_nextion_stop();
         break;
+    case SERIAL_MODE_METER:
+        serial_meter_stop();
+        break;
     default:
         break;
     }
@@ -248,6 +257,45 @@ esp_err_t serial_set_config(serial_id_t id, serial_mode_t mode, int baud_rate, u
     return ESP_OK;
 }
 
+serial_meter_profile_t serial_get_meter_profile(void)
+{
+    uint8_t value = SERIAL_METER_PROFILE_SDM630;
+    nvs_get_u8(nvs, NVS_METER_PROFILE, &value);
+    return value;
+}
+
+uint8_t serial_get_meter_address(void)
+{
+    uint8_t value = 1;
+    nvs_get_u8(nvs, NVS_METER_ADDRESS, &value);
+    return value;
+}
+
+esp_err_t serial_set_meter_config(serial_meter_profile_t profile, uint8_t address)
+{
+    if (profile < 0 || profile >= SERIAL_METER_PROFILE_MAX) {
+        ESP_LOGE(TAG, "Meter profile out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (address < 1 || address > 247) {
+        ESP_LOGE(TAG, "Meter address out of range");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_set_u8(nvs, NVS_METER_PROFILE, profile);
+    nvs_set_u8(nvs, NVS_METER_ADDRESS, address);
+
+    nvs_commit(nvs);
+
+    return ESP_OK;
+}
+
+void serial_get_meter_stats(serial_meter_stats_t* stats)
+{
+    serial_meter_get_stats(stats);
+}
+
 const char* serial_mode_to_str(serial_mode_t mode)
 {
     switch (mode)
@@ -258,6 +306,8 @@ const char* serial_mode_to_str(serial_mode_t mode)
         return "modbus";
     case SERIAL_MODE_NEXTION:
         return "nextion";
+    case SERIAL_MODE_METER:
+        return "meter";
     default:
         return "none";
     }
@@ -274,9 +324,43 @@ serial_mode_t serial_str_to_mode(const char* str)
     if (!strcmp(str, "nextion")) {
         return SERIAL_MODE_NEXTION;
     }
+    if (!strcmp(str, "meter")) {
+        return SERIAL_MODE_METER;
+    }
     return SERIAL_MODE_NONE;
 }
 
+const char* serial_meter_profile_to_str(serial_meter_profile_t profile)
+{
+    switch (profile)
+    {
+    case SERIAL_METER_PROFILE_SDM630:
+        return "sdm630";
+    case SERIAL_METER_PROFILE_SDM120:
+        return "sdm120";
+    case SERIAL_METER_PROFILE_ABB:
+        return "abb";
+    case SERIAL_METER_PROFILE_EM340:
+        return "em340";
+    default:
+        return "";
+    }
+}
+
+serial_meter_profile_t serial_str_to_meter_profile(const char* str)
+{
+    if (!strcmp(str, "sdm120")) {
+        return SERIAL_METER_PROFILE_SDM120;
+    }
+    if (!strcmp(str, "abb")) {
+        return SERIAL_METER_PROFILE_ABB;
+    }
+    if (!strcmp(str, "em340")) {
+        return SERIAL_METER_PROFILE_EM340;
+    }
+    return SERIAL_METER_PROFILE_SDM630;
+}
+
 const char* serial_data_bits_to_str(uart_word_length_t bits)
 {
     switch (bits)
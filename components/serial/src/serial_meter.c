@@ -0,0 +1,377 @@
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "serial_meter.h"
+#include "serial_modbus.h"
+#include "modbus.h"
+#include "energy_meter.h"
+
+#define BUF_SIZE                256
+#define POLL_PERIOD_MS          1000
+#define RESPONSE_TIMEOUT_MS     200
+#define STATS_LOG_POLLS         60
+#define MAX_BLOCKS              8
+#define MAX_BLOCK_REGS          125     // Modbus limit of read request
+#define MAX_BLOCK_GAP           8       // unused registers read rather than issuing another request
+
+#define LOG_LVL_DATA            ESP_LOG_VERBOSE
+
+typedef enum
+{
+    REG_TYPE_FLOAT32,       // IEEE 754, high word first
+    REG_TYPE_UINT32,        // high word first
+    REG_TYPE_INT32,         // high word first
+    REG_TYPE_INT32_SWAP,    // low word first
+    REG_TYPE_UINT64         // high word first
+} reg_type_t;
+
+typedef enum
+{
+    QUANTITY_VOLTAGE,       // V
+    QUANTITY_CURRENT,       // A
+    QUANTITY_POWER,         // W
+    QUANTITY_ENERGY         // Wh
+} quantity_t;
+
+typedef struct
+{
+    uint16_t reg;
+    reg_type_t type;
+    quantity_t quantity;
+    uint8_t phase;
+    double scale;           // register value to quantity unit
+} reg_field_t;
+
+typedef struct
+{
+    uint8_t function;
+    const reg_field_t* fields;  // sorted by register
+    uint8_t field_count;
+} meter_profile_t;
+
+typedef struct
+{
+    uint16_t reg;
+    uint16_t count;
+} reg_block_t;
+
+static const reg_field_t sdm630_fields[] = {
+    { 0x0000, REG_TYPE_FLOAT32, QUANTITY_VOLTAGE, 0, 1 },
+    { 0x0002, REG_TYPE_FLOAT32, QUANTITY_VOLTAGE, 1, 1 },
+    { 0x0004, REG_TYPE_FLOAT32, QUANTITY_VOLTAGE, 2, 1 },
+    { 0x0006, REG_TYPE_FLOAT32, QUANTITY_CURRENT, 0, 1 },
+    { 0x0008, REG_TYPE_FLOAT32, QUANTITY_CURRENT, 1, 1 },
+    { 0x000A, REG_TYPE_FLOAT32, QUANTITY_CURRENT, 2, 1 },
+    { 0x000C, REG_TYPE_FLOAT32, QUANTITY_POWER, 0, 1 },
+    { 0x000E, REG_TYPE_FLOAT32, QUANTITY_POWER, 1, 1 },
+    { 0x0010, REG_TYPE_FLOAT32, QUANTITY_POWER, 2, 1 },
+    { 0x0048, REG_TYPE_FLOAT32, QUANTITY_ENERGY, 0, 1000 },
+};
+
+static const reg_field_t sdm120_fields[] = {
+    { 0x0000, REG_TYPE_FLOAT32, QUANTITY_VOLTAGE, 0, 1 },
+    { 0x0006, REG_TYPE_FLOAT32, QUANTITY_CURRENT, 0, 1 },
+    { 0x000C, REG_TYPE_FLOAT32, QUANTITY_POWER, 0, 1 },
+    { 0x0048, REG_TYPE_FLOAT32, QUANTITY_ENERGY, 0, 1000 },
+};
+
+static const reg_field_t abb_fields[] = {
+    { 0x5000, REG_TYPE_UINT64, QUANTITY_ENERGY, 0, 10 },
+    { 0x5B00, REG_TYPE_UINT32, QUANTITY_VOLTAGE, 0, 0.1 },
+    { 0x5B02, REG_TYPE_UINT32, QUANTITY_VOLTAGE, 1, 0.1 },
+    { 0x5B04, REG_TYPE_UINT32, QUANTITY_VOLTAGE, 2, 0.1 },
+    { 0x5B0C, REG_TYPE_UINT32, QUANTITY_CURRENT, 0, 0.01 },
+    { 0x5B0E, REG_TYPE_UINT32, QUANTITY_CURRENT, 1, 0.01 },
+    { 0x5B10, REG_TYPE_UINT32, QUANTITY_CURRENT, 2, 0.01 },
+    { 0x5B16, REG_TYPE_INT32, QUANTITY_POWER, 0, 0.01 },
+    { 0x5B18, REG_TYPE_INT32, QUANTITY_POWER, 1, 0.01 },
+    { 0x5B1A, REG_TYPE_INT32, QUANTITY_POWER, 2, 0.01 },
+};
+
+static const reg_field_t em340_fields[] = {
+    { 0x0000, REG_TYPE_INT32_SWAP, QUANTITY_VOLTAGE, 0, 0.1 },
+    { 0x0002, REG_TYPE_INT32_SWAP, QUANTITY_VOLTAGE, 1, 0.1 },
+    { 0x0004, REG_TYPE_INT32_SWAP, QUANTITY_VOLTAGE, 2, 0.1 },
+    { 0x000C, REG_TYPE_INT32_SWAP, QUANTITY_CURRENT, 0, 0.001 },
+    { 0x000E, REG_TYPE_INT32_SWAP, QUANTITY_CURRENT, 1, 0.001 },
+    { 0x0010, REG_TYPE_INT32_SWAP, QUANTITY_CURRENT, 2, 0.001 },
+    { 0x0012, REG_TYPE_INT32_SWAP, QUANTITY_POWER, 0, 0.1 },
+    { 0x0014, REG_TYPE_INT32_SWAP, QUANTITY_POWER, 1, 0.1 },
+    { 0x0016, REG_TYPE_INT32_SWAP, QUANTITY_POWER, 2, 0.1 },
+    { 0x0034, REG_TYPE_INT32_SWAP, QUANTITY_ENERGY, 0, 100 },
+};
+
+static const meter_profile_t profiles[SERIAL_METER_PROFILE_MAX] = {
+    [SERIAL_METER_PROFILE_SDM630] = { 0x04, sdm630_fields, sizeof(sdm630_fields) / sizeof(reg_field_t) },
+    [SERIAL_METER_PROFILE_SDM120] = { 0x04, sdm120_fields, sizeof(sdm120_fields) / sizeof(reg_field_t) },
+    [SERIAL_METER_PROFILE_ABB] = { 0x03, abb_fields, sizeof(abb_fields) / sizeof(reg_field_t) },
+    [SERIAL_METER_PROFILE_EM340] = { 0x04, em340_fields, sizeof(em340_fields) / sizeof(reg_field_t) },
+};
+
+static const char* TAG = "serial_meter";
+
+static uart_port_t port = -1;
+
+static TaskHandle_t serial_meter_task = NULL;
+
+static const meter_profile_t* profile;
+
+static uint8_t address;
+
+static TickType_t response_timeout;
+
+static reg_block_t blocks[MAX_BLOCKS];
+
+static uint8_t block_count = 0;
+
+static serial_meter_stats_t stats;
+
+static uint8_t get_reg_count(reg_type_t type)
+{
+    return type == REG_TYPE_UINT64 ? 4 : 2;
+}
+
+// merge registers of profile into as few read requests as possible
+static void build_blocks(void)
+{
+    block_count = 0;
+
+    for (uint8_t i = 0; i < profile->field_count; i++) {
+        const reg_field_t* field = &profile->fields[i];
+        uint16_t end = field->reg + get_reg_count(field->type);
+        reg_block_t* block = block_count > 0 ? &blocks[block_count - 1] : NULL;
+
+        if (block && field->reg <= block->reg + block->count + MAX_BLOCK_GAP && end - block->reg <= MAX_BLOCK_REGS) {
+            block->count = MAX(block->count, end - block->reg);
+        } else if (block_count < MAX_BLOCKS) {
+            blocks[block_count].reg = field->reg;
+            blocks[block_count].count = end - field->reg;
+            block_count++;
+        }
+    }
+
+    stats.requests = block_count;
+}
+
+static double decode_field(const reg_field_t* field, const uint8_t* data)
+{
+    uint32_t hi = MODBUS_READ_UINT16(data, 0);
+    uint32_t lo = MODBUS_READ_UINT16(data, 2);
+    uint32_t u32;
+
+    switch (field->type) {
+    case REG_TYPE_FLOAT32: {
+        float f;
+        u32 = hi << 16 | lo;
+        memcpy(&f, &u32, sizeof(f));
+        return f;
+    }
+    case REG_TYPE_UINT32:
+        return hi << 16 | lo;
+    case REG_TYPE_INT32:
+        return (int32_t)(hi << 16 | lo);
+    case REG_TYPE_INT32_SWAP:
+        return (int32_t)(lo << 16 | hi);
+    case REG_TYPE_UINT64:
+        return (uint64_t)(hi << 16 | lo) << 32 | ((uint32_t)MODBUS_READ_UINT16(data, 4) << 16 | MODBUS_READ_UINT16(data, 6));
+    default:
+        return 0;
+    }
+}
+
+static void decode_block(const reg_block_t* block, const uint8_t* data, energy_meter_external_t* values)
+{
+    for (uint8_t i = 0; i < profile->field_count; i++) {
+        const reg_field_t* field = &profile->fields[i];
+
+        if (field->reg >= block->reg && field->reg + get_reg_count(field->type) <= block->reg + block->count) {
+            double value = decode_field(field, &data[(field->reg - block->reg) * 2]) * field->scale;
+
+            switch (field->quantity) {
+            case QUANTITY_VOLTAGE:
+                values->voltage[field->phase] = value;
+                break;
+            case QUANTITY_CURRENT:
+                values->current[field->phase] = value;
+                break;
+            case QUANTITY_POWER:
+                values->power[field->phase] = value;
+                break;
+            case QUANTITY_ENERGY:
+                values->energy = llround(MAX(value, 0) * 1000);
+                values->has_energy = true;
+                break;
+            }
+        }
+    }
+}
+
+static esp_err_t read_block(const reg_block_t* block, uint8_t* buf)
+{
+    uint8_t req[8];
+    uint16_t len = block->count * 2 + 3;
+
+    req[0] = address;
+    req[1] = profile->function;
+    MODBUS_WRITE_UINT16(req, 2, block->reg);
+    MODBUS_WRITE_UINT16(req, 4, block->count);
+    MODBUS_WRITE_UINT16(req, 6, compute_crc(req, 6));
+
+    ESP_LOG_LEVEL(LOG_LVL_DATA, TAG, "Write buffer length %d", (int)sizeof(req));
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, req, sizeof(req), LOG_LVL_DATA);
+
+    uart_flush_input(port);
+    uart_write_bytes(port, req, sizeof(req));
+    uart_wait_tx_done(port, response_timeout);
+    // transceivers with receiver always enabled echo the request
+    uart_flush_input(port);
+
+    if (uart_read_bytes(port, buf, 3, response_timeout) < 3) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    if (buf[0] != address || (buf[1] & 0x7F) != profile->function) {
+        ESP_LOGW(TAG, "Unexpected response %02x %02x", buf[0], buf[1]);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    if (buf[1] & 0x80) {
+        ESP_LOGW(TAG, "Exception %d reading register 0x%04x", buf[2], block->reg);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    if (buf[2] != block->count * 2) {
+        ESP_LOGW(TAG, "Invalid response data length");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (uart_read_bytes(port, &buf[3], len - 1, response_timeout) < len - 1) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ESP_LOG_LEVEL(LOG_LVL_DATA, TAG, "Received buffer length %d", len + 2);
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, buf, len + 2, LOG_LVL_DATA);
+
+    if (compute_crc(buf, len) != MODBUS_READ_UINT16(buf, len)) {
+        ESP_LOGW(TAG, "Invalid packet CRC");
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    return ESP_OK;
+}
+
+static void poll(void)
+{
+    uint8_t buf[BUF_SIZE];
+    energy_meter_external_t values = { 0 };
+    int64_t start = esp_timer_get_time();
+
+    stats.polls++;
+
+    for (uint8_t i = 0; i < block_count; i++) {
+        esp_err_t err = read_block(&blocks[i], buf);
+        if (err != ESP_OK) {
+            stats.errors++;
+            if (err == ESP_ERR_TIMEOUT) {
+                stats.timeouts++;
+            }
+            ESP_LOGD(TAG, "Read register 0x%04x failed: %s", blocks[i].reg, esp_err_to_name(err));
+            return;
+        }
+        decode_block(&blocks[i], &buf[3], &values);
+    }
+
+    stats.latency = (esp_timer_get_time() - start) / 1000;
+    stats.max_latency = MAX(stats.max_latency, stats.latency);
+
+    energy_meter_set_external(&values);
+}
+
+static void serial_meter_task_func(void* param)
+{
+    TickType_t wake_time = xTaskGetTickCount();
+
+    while (true) {
+        poll();
+
+        if (stats.polls % STATS_LOG_POLLS == 0) {
+            ESP_LOGI(TAG, "Polls %" PRIu32 ", errors %" PRIu32 " (%.1f%%), timeouts %" PRIu32 ", latency %" PRIu32 "ms, max %" PRIu32 "ms",
+                stats.polls, stats.errors, stats.errors * 100.0f / stats.polls, stats.timeouts, stats.latency, stats.max_latency);
+        }
+
+        vTaskDelayUntil(&wake_time, pdMS_TO_TICKS(POLL_PERIOD_MS));
+    }
+}
+
+void serial_meter_start(uart_port_t uart_num, uint32_t baud_rate, uart_word_length_t data_bits, uart_stop_bits_t stop_bit, uart_parity_t parity, bool rs485, serial_meter_profile_t _profile, uint8_t _address)
+{
+    ESP_LOGI(TAG, "Starting on uart %d", uart_num);
+
+    uart_config_t uart_config = {
+        .baud_rate = baud_rate,
+        .data_bits = data_bits,
+        .parity = parity,
+        .stop_bits = stop_bit,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = 2,
+        .source_clk = UART_SCLK_APB
+    };
+
+    esp_err_t err = uart_param_config(uart_num, &uart_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "uart_param_config() returned 0x%x", err);
+        return;
+    }
+
+    err = uart_driver_install(uart_num, BUF_SIZE, 0, 0, NULL, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "uart_driver_install() returned 0x%x", err);
+        return;
+    }
+    port = uart_num;
+
+    if (rs485) {
+        err = uart_set_mode(uart_num, UART_MODE_RS485_HALF_DUPLEX);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "uart_set_mode() returned 0x%x", err);
+            return;
+        }
+    }
+
+    profile = &profiles[_profile];
+    address = _address;
+    // transfer time of largest response at 11 bits per character
+    response_timeout = pdMS_TO_TICKS(RESPONSE_TIMEOUT_MS + (MAX_BLOCK_REGS * 2 + 5) * 11 * 1000 / baud_rate);
+
+    memset(&stats, 0, sizeof(stats));
+    build_blocks();
+    ESP_LOGI(TAG, "Profile %s, address %d, %d requests per poll", serial_meter_profile_to_str(_profile), address, block_count);
+
+    xTaskCreate(serial_meter_task_func, "serial_meter_task", 3 * 1024, NULL, 5, &serial_meter_task);
+}
+
+void serial_meter_stop(void)
+{
+    ESP_LOGI(TAG, "Stopping");
+
+    if (serial_meter_task) {
+        vTaskDelete(serial_meter_task);
+        serial_meter_task = NULL;
+    }
+
+    if (port != -1) {
+        uart_driver_delete(port);
+        port = -1;
+    }
+}
+
+void serial_meter_get_stats(serial_meter_stats_t* _stats)
+{
+    *_stats = stats;
+}
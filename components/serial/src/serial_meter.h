@@ -0,0 +1,35 @@
+#ifndef SERIAL_METER_H_
+#define SERIAL_METER_H_
+
+#include "driver/uart.h"
+
+#include "serial.h"
+
+/**
+ * @brief Start serial energy meter polling
+ *
+ * @param uart_num
+ * @param baud_rate
+ * @param data_bits
+ * @param stop_bit
+ * @param parity
+ * @param rs485
+ * @param profile register map of meter
+ * @param address Modbus address of meter
+ */
+void serial_meter_start(uart_port_t uart_num, uint32_t baud_rate, uart_word_length_t data_bits, uart_stop_bits_t stop_bit, uart_parity_t parity, bool rs485, serial_meter_profile_t profile, uint8_t address);
+
+/**
+ * @brief Stop serial energy meter polling
+ *
+ */
+void serial_meter_stop(void);
+
+/**
+ * @brief Get polling statistics
+ *
+ * @param stats
+ */
+void serial_meter_get_stats(serial_meter_stats_t* stats);
+
+#endif /* SERIAL_METER_H_ */
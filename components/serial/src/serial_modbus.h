@@ -15,6 +15,15 @@
  */
 void serial_modbus_start(uart_port_t uart_num, uint32_t baud_rate, uart_word_length_t data_bits, uart_stop_bits_t stop_bit, uart_parity_t parity, bool rs485);
 
+/**
+ * @brief Compute Modbus RTU CRC, to be written with MODBUS_WRITE_UINT16
+ *
+ * @param buf
+ * @param len
+ * @return uint16_t
+ */
+uint16_t compute_crc(uint8_t* buf, uint16_t len);
+
 /**
  * @brief Stop serial Modbus
  * 
@@ -273,29 +273,32 @@ static void tx_vars(context_t* ctx)
 {
     char tx_cmd[64];
 
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+
     if (ctx->var_sub.state) {
-        sprintf(tx_cmd, VAR_FMT_STATE, evse_state_to_str(evse_get_state()));
+        sprintf(tx_cmd, VAR_FMT_STATE, evse_state_to_str(snapshot.state));
         tx_str(tx_cmd);
     }
-    if (ctx->var_sub.enabled && ctx->enabled != evse_is_enabled()) {
-        ctx->enabled = evse_is_enabled();
+    if (ctx->var_sub.enabled && ctx->enabled != snapshot.enabled) {
+        ctx->enabled = snapshot.enabled;
         sprintf(tx_cmd, VAR_FMT_ENABLED, ctx->enabled);
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.error) {
-        sprintf(tx_cmd, VAR_FMT_ERROR, evse_get_error());
+        sprintf(tx_cmd, VAR_FMT_ERROR, snapshot.error);
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.pending_auth) {
-        sprintf(tx_cmd, VAR_FMT_PENDING_AUTH, evse_is_pending_auth());
+        sprintf(tx_cmd, VAR_FMT_PENDING_AUTH, snapshot.pending_auth);
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.limit_reached) {
-        sprintf(tx_cmd, VAR_FMT_LIMIT_REACHED, evse_is_limit_reached());
+        sprintf(tx_cmd, VAR_FMT_LIMIT_REACHED, snapshot.limit_reached);
         tx_str(tx_cmd);
     }
-    if (ctx->var_sub.charging_current && ctx->charging_current != evse_get_charging_current()) {
-        ctx->charging_current = evse_get_charging_current();
+    if (ctx->var_sub.charging_current && ctx->charging_current != snapshot.charging_current) {
+        ctx->charging_current = snapshot.charging_current;
         sprintf(tx_cmd, VAR_FMT_CHARGING_CURRENT, ctx->charging_current);
         tx_str(tx_cmd);
     }
@@ -305,57 +308,57 @@ static void tx_vars(context_t* ctx)
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.session_time) {
-        sprintf(tx_cmd, VAR_FMT_SESSION_TIME, energy_meter_get_session_time());
+        sprintf(tx_cmd, VAR_FMT_SESSION_TIME, snapshot.session_time);
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.charging_time) {
-        sprintf(tx_cmd, VAR_FMT_CHARGING_TIME, energy_meter_get_charging_time());
+        sprintf(tx_cmd, VAR_FMT_CHARGING_TIME, snapshot.charging_time);
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.power) {
-        sprintf(tx_cmd, VAR_FMT_POWER, energy_meter_get_power());
+        sprintf(tx_cmd, VAR_FMT_POWER, snapshot.power);
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.consumption) {
-        sprintf(tx_cmd, VAR_FMT_CONSUMPTION, energy_meter_get_consumption());
+        sprintf(tx_cmd, VAR_FMT_CONSUMPTION, snapshot.consumption);
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.voltage_l1) {
-        sprintf(tx_cmd, VAR_FMT_VOLTAGE_L1, (uint16_t)(energy_meter_get_l1_voltage() * 100));
+        sprintf(tx_cmd, VAR_FMT_VOLTAGE_L1, (uint16_t)(snapshot.voltage[0] * 100));
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.voltage_l2) {
-        sprintf(tx_cmd, VAR_FMT_VOLTAGE_L2, (uint16_t)(energy_meter_get_l2_voltage() * 100));
+        sprintf(tx_cmd, VAR_FMT_VOLTAGE_L2, (uint16_t)(snapshot.voltage[1] * 100));
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.voltage_l3) {
-        sprintf(tx_cmd, VAR_FMT_VOLTAGE_L3, (uint16_t)(energy_meter_get_l3_voltage() * 100));
+        sprintf(tx_cmd, VAR_FMT_VOLTAGE_L3, (uint16_t)(snapshot.voltage[2] * 100));
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.current_l1) {
-        sprintf(tx_cmd, VAR_FMT_CURRENT_L1, (uint16_t)(energy_meter_get_l1_current() * 100));
+        sprintf(tx_cmd, VAR_FMT_CURRENT_L1, (uint16_t)(snapshot.current[0] * 100));
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.current_l2) {
-        sprintf(tx_cmd, VAR_FMT_CURRENT_L2, (uint16_t)(energy_meter_get_l2_current() * 100));
+        sprintf(tx_cmd, VAR_FMT_CURRENT_L2, (uint16_t)(snapshot.current[1] * 100));
         tx_str(tx_cmd);
     }
     if (ctx->var_sub.current_l3) {
-        sprintf(tx_cmd, VAR_FMT_CURRENT_L3, (uint16_t)(energy_meter_get_l3_current() * 100));
+        sprintf(tx_cmd, VAR_FMT_CURRENT_L3, (uint16_t)(snapshot.current[2] * 100));
         tx_str(tx_cmd);
     }
-    if (ctx->var_sub.consumption_limit && ctx->consumption_limit != evse_get_consumption_limit()) {
-        ctx->consumption_limit = evse_get_consumption_limit();
+    if (ctx->var_sub.consumption_limit && ctx->consumption_limit != snapshot.consumption_limit) {
+        ctx->consumption_limit = snapshot.consumption_limit;
         sprintf(tx_cmd, VAR_FMT_CONSUMPTION_LIMIT, ctx->consumption_limit);
         tx_str(tx_cmd);
     }
-    if (ctx->var_sub.charging_time_limit && ctx->charging_time_limit != evse_get_charging_time_limit()) {
-        ctx->charging_time_limit = evse_get_charging_time_limit();
+    if (ctx->var_sub.charging_time_limit && ctx->charging_time_limit != snapshot.charging_time_limit) {
+        ctx->charging_time_limit = snapshot.charging_time_limit;
         sprintf(tx_cmd, VAR_FMT_CHARGING_TIME_LIMIT, ctx->charging_time_limit);
         tx_str(tx_cmd);
     }
-    if (ctx->var_sub.under_power_limit && ctx->under_power_limit != evse_get_under_power_limit()) {
-        ctx->under_power_limit = evse_get_under_power_limit();
+    if (ctx->var_sub.under_power_limit && ctx->under_power_limit != snapshot.under_power_limit) {
+        ctx->under_power_limit = snapshot.under_power_limit;
         sprintf(tx_cmd, VAR_FMT_UNDER_POWER_LIMIT, ctx->under_power_limit);
         tx_str(tx_cmd);
     }
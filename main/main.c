@@ -38,6 +38,8 @@ static evse_state_t led_state = -1;
 
 static bool evse_enabled = false;
 
+static TaskHandle_t main_task;
+
 static void reset_and_reboot(void)
 {
     ESP_LOGW(TAG, "All settings will be erased...");
@@ -215,6 +217,13 @@ static void update_leds(void)
     }
 }
 
+static void evse_event_handler(uint8_t connector, uint32_t events, void* arg)
+{
+    if (connector == 0) {
+        xTaskNotifyGive(main_task);
+    }
+}
+
 void app_main(void)
 {
     logger_init();
@@ -274,10 +283,12 @@ void app_main(void)
 
     xTaskCreate(wifi_event_task_func, "wifi_event_task", 4 * 1024, NULL, 5, NULL);
 
+    main_task = xTaskGetCurrentTaskHandle();
+    evse_subscribe(EVSE_EVENT_STATE_BIT | EVSE_EVENT_ENABLED_BIT, evse_event_handler, NULL);
+
     while (true) {
-        evse_process();
         update_leds();
 
-        vTaskDelay(pdMS_TO_TICKS(50));
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
 }
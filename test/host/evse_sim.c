@@ -0,0 +1,682 @@
+#include <stdlib.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "sim.h"
+#include "scenario.h"
+#include "board.h"
+#include "board_config.h"
+#include "evse.h"
+#include "energy_meter.h"
+#include "power_quality.h"
+#include "modbus.h"
+#include "scheduler.h"
+#include "adc.h"
+
+#define BENCH_CYCLES            20
+#define BENCH_CHARGE_MS         60000
+#define BENCH_ITERATIONS        (BENCH_CYCLES * (BENCH_CHARGE_MS + 3 * 1000) / 50)
+#define JITTER_CURRENT          16      // A
+#define JITTER_CUR_SCALE        0.0909f // A/mV
+#define JITTER_CUR_BIAS         1650    // mV
+
+static evse_state_t target_state;
+
+static bool is_target_state(void)
+{
+    return evse_get_state() == target_state;
+}
+
+static bool run_until_state(evse_state_t state, uint32_t timeout_ms)
+{
+    target_state = state;
+    return sim_run_until(is_target_state, timeout_ms);
+}
+
+static bool is_not_charging(void)
+{
+    return !evse_state_is_charging(evse_get_state());
+}
+
+static bool is_ac_relay_off(void)
+{
+    return !sim_board.ac_relay;
+}
+
+static bool is_enabled(void)
+{
+    return evse_is_enabled();
+}
+
+static bool is_disabled(void)
+{
+    return !evse_is_enabled();
+}
+
+static uint32_t events;
+
+static void on_event(uint8_t connector, uint32_t _events, void* arg)
+{
+    if (connector == 0) {
+        events |= _events;
+    }
+}
+
+static void nvs_preset_u8(const char* namespace, const char* key, uint8_t value)
+{
+    nvs_handle_t nvs;
+    nvs_open(namespace, NVS_READWRITE, &nvs);
+    nvs_set_u8(nvs, key, value);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+static void boot(TickType_t start_tick)
+{
+    sim_init(start_tick);
+    adc_init();
+    power_quality_init();
+    energy_meter_init();
+    evse_init();
+    modbus_init();
+    scheduler_init();
+}
+
+// single register write as received by serial or tcp modbus, returns when response is ready
+static bool modbus_write(uint16_t addr, uint16_t value)
+{
+    uint8_t buf[MODBUS_PACKET_SIZE] = { modbus_get_unit_id(), 6 };
+    MODBUS_WRITE_UINT16(buf, 2, addr);
+    MODBUS_WRITE_UINT16(buf, 4, value);
+
+    return modbus_request_exec(buf, 6) == 6 && buf[1] == 6;
+}
+
+static uint16_t modbus_read(uint16_t addr)
+{
+    uint8_t buf[MODBUS_PACKET_SIZE] = { modbus_get_unit_id(), 3 };
+    MODBUS_WRITE_UINT16(buf, 2, addr);
+    MODBUS_WRITE_UINT16(buf, 4, 1);
+
+    if (modbus_request_exec(buf, 6) != 5 || buf[1] != 3) {
+        return UINT16_MAX;
+    }
+    return MODBUS_READ_UINT16(buf, 3);
+}
+
+static void plug_and_charge(void)
+{
+    sim_board.vehicle = SIM_VEHICLE_B;
+    CHECK(run_until_state(EVSE_STATE_B2, 1000));
+    CHECK(sim_board.pilot_pwm);
+    sim_board.vehicle = SIM_VEHICLE_C;
+    CHECK(run_until_state(EVSE_STATE_C2, 1000));
+    CHECK(sim_board.ac_relay);
+}
+
+static void unplug(void)
+{
+    sim_board.vehicle = SIM_VEHICLE_A;
+    CHECK(run_until_state(EVSE_STATE_A, 1000));
+    CHECK(!sim_board.ac_relay);
+}
+
+static void scenario_charge(void)
+{
+    boot(0);
+    CHECK(run_until_state(EVSE_STATE_A, 1000));
+    CHECK(sim_board.pilot_level && !sim_board.pilot_pwm);
+
+    // idle pilot is polled at lower rate
+    uint32_t pilot_measures = sim_board.pilot_measures;
+    sim_run(10000);
+    CHECK(sim_board.pilot_measures - pilot_measures >= 49 && sim_board.pilot_measures - pilot_measures <= 51);
+
+    plug_and_charge();
+    CHECK(sim_board.pilot_amps == 320);
+
+    sim_run(600000);
+
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    CHECK(snapshot.state == EVSE_STATE_C2);
+    CHECK(snapshot.power == 8000);
+    double expected = snapshot.power * (snapshot.charging_time * 1000.0) / 3600;
+    CHECK(snapshot.charging_time >= 599 && snapshot.charging_time <= 601);
+    CHECK(snapshot.consumption_mwh > expected * 0.99 && snapshot.consumption_mwh < expected * 1.01);
+    CHECK(modbus_read(200) == 8000);
+
+    unplug();
+    CHECK(sim_board.ac_relay_switches == 2);
+
+    // meter task saves lifetime consumption after session end
+    sim_run(1000);
+    evse_get_snapshot(&snapshot);
+    CHECK(snapshot.total_consumption >= 1320000);
+    nvs_handle_t nvs;
+    uint64_t saved = 0;
+    nvs_open("evse_emeter", NVS_READONLY, &nvs);
+    CHECK(nvs_get_u64(nvs, "total_cons", &saved) == ESP_OK);
+    CHECK(saved == snapshot.total_consumption);
+    nvs_close(nvs);
+
+    evse_transition_stats_t transition;
+    CHECK(evse_get_transition_stats(EVSE_STATE_B2, PILOT_VOLTAGE_6, true, &transition) == ESP_OK);
+    CHECK(transition.next_state == EVSE_STATE_C2 && transition.count == 1);
+    CHECK(evse_get_transition_stats(EVSE_STATE_C2, PILOT_VOLTAGE_12, true, &transition) == ESP_OK);
+    CHECK(transition.next_state == EVSE_STATE_A && transition.count == 1);
+    CHECK(evse_get_transition_stats(EVSE_STATE_C2, PILOT_VOLTAGE_9, true, &transition) == ESP_OK);
+    CHECK(transition.count == 0);
+    // errors and availability states are not driven by table
+    CHECK(evse_get_transition_stats(EVSE_STATE_E, PILOT_VOLTAGE_12, true, &transition) == ESP_ERR_INVALID_ARG);
+    CHECK(evse_get_transition_stats(EVSE_STATE_A, PILOT_VOLTAGE_1 + 1, true, &transition) == ESP_ERR_INVALID_ARG);
+
+    evse_latency_stats_t latency;
+    evse_get_latency_stats(EVSE_LATENCY_PILOT_RELAY, &latency);
+    CHECK(latency.count == 2);
+    CHECK(latency.max <= 60000);
+
+    evse_loop_stats_t stats;
+    evse_get_meter_stats(&stats);
+    CHECK(stats.iterations_per_sec == 10);
+    CHECK(stats.max_jitter < 10000);
+    evse_get_process_stats(&stats);
+    CHECK(stats.max_jitter < 10000);
+}
+
+static void scenario_disable(void)
+{
+    boot(0);
+    plug_and_charge();
+
+    // state is held in C1 while disabled, ac relay is forced off after wait time
+    CHECK(evse_subscribe(EVSE_EVENT_ENABLED_BIT | EVSE_EVENT_STATE_BIT | EVSE_EVENT_ERROR_BIT, on_event, NULL) == ESP_OK);
+    events = 0;
+    CHECK(modbus_write(103, 0));
+    CHECK(sim_run_until(is_disabled, 50));
+    int64_t disabled = sim_time();
+    CHECK(run_until_state(EVSE_STATE_C1, 100));
+    CHECK(modbus_read(103) == 0);
+    CHECK(events == (EVSE_EVENT_ENABLED_BIT | EVSE_EVENT_STATE_BIT));
+    CHECK(!sim_board.pilot_pwm);
+    CHECK(sim_run_until(is_ac_relay_off, 7000));
+    CHECK(sim_board.ac_relay_time - disabled >= 6000000 && sim_board.ac_relay_time - disabled <= 6100000);
+    sim_run(1000);
+    CHECK(evse_get_state() == EVSE_STATE_C1);
+
+    evse_latency_stats_t latency;
+    evse_get_latency_stats(EVSE_LATENCY_DISABLE_PILOT, &latency);
+    CHECK(latency.count == 1);
+    CHECK(latency.max <= 50000);
+
+    CHECK(modbus_write(103, 1));
+    CHECK(run_until_state(EVSE_STATE_C2, 1000));
+    CHECK(sim_board.ac_relay);
+
+    // unavailable goes to F after ac relay is forced off
+    evse_set_available(false);
+    CHECK(run_until_state(EVSE_STATE_F, 7000));
+    CHECK(!sim_board.ac_relay && !sim_board.pilot_level);
+    sim_board.vehicle = SIM_VEHICLE_A;
+    evse_set_available(true);
+    CHECK(run_until_state(EVSE_STATE_A, 1000));
+}
+
+static void scenario_limit(void)
+{
+    boot(0);
+
+    evse_set_consumption_limit(100);
+    plug_and_charge();
+    int64_t start = sim_time();
+    // 100Wh at 8000W, first meter period after charging starts counts up to one period before it
+    CHECK(sim_run_until(is_not_charging, 60000));
+    CHECK(sim_time() - start >= 44900000 && sim_time() - start <= 45100000);
+    CHECK(evse_is_limit_reached());
+    CHECK(run_until_state(EVSE_STATE_B1, 200));
+    CHECK(!sim_board.ac_relay);
+
+    evse_snapshot_t snapshot;
+    evse_get_snapshot(&snapshot);
+    CHECK(snapshot.consumption_mwh >= 100000 && snapshot.consumption_mwh <= 100300);
+
+    unplug();
+    CHECK(!evse_is_limit_reached());
+
+    evse_set_consumption_limit(0);
+    evse_set_charging_time_limit_ms(1500);
+    plug_and_charge();
+    // whole seconds on modbus, rounded up
+    CHECK(modbus_read(110) == 2);
+    CHECK(evse_get_charging_time_limit_ms() == 1500);
+    start = sim_time();
+    CHECK(sim_run_until(is_not_charging, 3000));
+    CHECK(sim_time() - start >= 1400000 && sim_time() - start <= 1600000);
+    CHECK(run_until_state(EVSE_STATE_B1, 200));
+    CHECK(!sim_board.ac_relay);
+    unplug();
+
+    evse_set_charging_time_limit_ms(0);
+    evse_set_under_power_limit(9000);
+    plug_and_charge();
+    start = sim_time();
+    CHECK(sim_run_until(is_not_charging, 70000));
+    CHECK(sim_time() - start >= 60000000 && sim_time() - start <= 60200000);
+    unplug();
+
+    // limit lowered below session consumption stops charging at once
+    evse_set_under_power_limit(0);
+    plug_and_charge();
+    sim_run(20000);
+    evse_get_snapshot(&snapshot);
+    CHECK(snapshot.consumption_mwh > 40000);
+    evse_set_consumption_limit(10);
+    start = sim_time();
+    CHECK(sim_run_until(is_not_charging, 1000));
+    CHECK(sim_time() - start <= 100000);
+    CHECK(evse_is_limit_reached());
+    CHECK(run_until_state(EVSE_STATE_B1, 200));
+    CHECK(!sim_board.ac_relay);
+    unplug();
+}
+
+static void scenario_fault(void)
+{
+    boot(0);
+    plug_and_charge();
+
+    sim_board.pilot_short = true;
+    CHECK(run_until_state(EVSE_STATE_E, 100));
+    int64_t fault = sim_time();
+    CHECK(!sim_board.ac_relay && !sim_board.pilot_level);
+    CHECK(evse_get_error() & EVSE_ERR_PILOT_FAULT_BIT);
+
+    sim_board.pilot_short = false;
+    sim_board.vehicle = SIM_VEHICLE_A;
+    sim_run(59000);
+    CHECK(evse_get_state() == EVSE_STATE_E);
+    CHECK(run_until_state(EVSE_STATE_A, 2000));
+    CHECK(sim_time() - fault >= 60000000 && sim_time() - fault <= 60100000);
+    CHECK(evse_get_error() == 0);
+
+    sim_board.vehicle = SIM_VEHICLE_B;
+    CHECK(run_until_state(EVSE_STATE_B2, 1000));
+    sim_board.diode_short = true;
+    CHECK(run_until_state(EVSE_STATE_E, 100));
+    CHECK(evse_get_error() & EVSE_ERR_DIODE_SHORT_BIT);
+    CHECK(!sim_board.pilot_pwm);
+    sim_board.diode_short = false;
+    sim_board.vehicle = SIM_VEHICLE_A;
+    CHECK(run_until_state(EVSE_STATE_A, 61000));
+
+    // temperature is not a auto clear error, clears when temperature drops
+    board_config.onewire = true;
+    board_config.onewire_temp_sensor = true;
+    sim_board.temp_high = 7000;
+    CHECK(run_until_state(EVSE_STATE_E, 300));
+    CHECK(evse_get_error() & EVSE_ERR_TEMPERATURE_HIGH_BIT);
+    sim_board.temp_high = 2500;
+    CHECK(run_until_state(EVSE_STATE_A, 300));
+}
+
+static void scenario_rcm(void)
+{
+    board_config.rcm = true;
+    board_config.rcm_test = true;
+    nvs_preset_u8("evse", "rcm", 1);
+    boot(0);
+    CHECK(evse_is_rcm());
+    CHECK(evse_get_error() == 0);
+
+    plug_and_charge();
+    sim_board.rcm_triggered = true;
+    CHECK(run_until_state(EVSE_STATE_E, 60));
+    CHECK(!sim_board.ac_relay);
+    CHECK(evse_get_error() & EVSE_ERR_RCM_TRIGGERED_BIT);
+
+    sim_board.rcm_triggered = false;
+    sim_board.vehicle = SIM_VEHICLE_A;
+    CHECK(run_until_state(EVSE_STATE_A, 61000));
+}
+
+static void scenario_auth(void)
+{
+    nvs_preset_u8("evse", "require_auth", 1);
+    boot(0);
+    CHECK(evse_is_require_auth());
+
+    sim_board.vehicle = SIM_VEHICLE_B;
+    CHECK(run_until_state(EVSE_STATE_B1, 1000));
+    sim_run(2000);
+    CHECK(evse_get_state() == EVSE_STATE_B1);
+    CHECK(evse_is_pending_auth());
+    CHECK(modbus_read(105) == 1);
+
+    CHECK(modbus_write(112, 1));
+    CHECK(run_until_state(EVSE_STATE_B2, 200));
+    CHECK(!evse_is_pending_auth());
+    sim_board.vehicle = SIM_VEHICLE_C;
+    CHECK(run_until_state(EVSE_STATE_C2, 200));
+    unplug();
+
+    // grant expires when vehicle does not connect
+    evse_authorize();
+    sim_run(61000);
+    sim_board.vehicle = SIM_VEHICLE_B;
+    CHECK(run_until_state(EVSE_STATE_B1, 1000));
+    sim_run(1000);
+    CHECK(evse_get_state() == EVSE_STATE_B1);
+}
+
+static void scenario_commands(void)
+{
+    boot(0);
+    sim_run(100);
+
+    // setters queue without running evse task, full queue rejects command instead of dropping it
+    uint8_t posted = 0;
+    while (evse_set_charging_current(100 + posted) == ESP_OK) {
+        posted++;
+    }
+    CHECK(posted == 16);
+    CHECK(evse_set_enabled(false) == ESP_ERR_NO_MEM);
+    CHECK(evse_set_consumption_limit(100) == ESP_ERR_NO_MEM);
+    CHECK(evse_connector_authorize(0) == ESP_ERR_NO_MEM);
+
+    // modbus answers server busy exception
+    uint8_t buf[MODBUS_PACKET_SIZE] = { modbus_get_unit_id(), 6 };
+    MODBUS_WRITE_UINT16(buf, 2, 103);
+    MODBUS_WRITE_UINT16(buf, 4, 0);
+    CHECK(modbus_request_exec(buf, 6) == 3 && buf[2] == 0x06);
+
+    // queued commands are applied in order, rejected are not
+    sim_run(100);
+    CHECK(evse_get_charging_current() == 100 + posted - 1);
+    CHECK(evse_is_enabled());
+    CHECK(evse_get_consumption_limit() == 0);
+    CHECK(evse_set_enabled(false) == ESP_OK);
+    CHECK(sim_run_until(is_disabled, 50));
+
+    // waits for own command only, done bits left from previous commands do not wake it
+    CHECK(evse_set_charging_current(160) == ESP_OK);
+    int64_t start = sim_time();
+    CHECK(evse_wait_commands(EVSE_COMMAND_WAIT_MS) == ESP_OK);
+    CHECK(evse_get_charging_current() == 160);
+    CHECK(sim_time() - start < 50000);
+    start = sim_time();
+    CHECK(evse_wait_commands(EVSE_COMMAND_WAIT_MS) == ESP_OK);
+    CHECK(sim_time() == start);
+}
+
+static void scenario_scheduler(void)
+{
+    boot(0);
+    evse_set_enabled(false);
+
+    scheduler_schedule_t schedule = {
+        .action = SCHEDULER_ACTION_ENABLE
+    };
+    for (int i = 0; i < 7; i++) {
+        schedule.days.order[i] = 0x00ffffff;
+    }
+    sim_run(1500);
+    scheduler_set_schedule_config(&schedule, 1);
+    CHECK(sim_run_until(is_enabled, 100));
+
+    for (int i = 0; i < 7; i++) {
+        schedule.days.order[i] = 0;
+    }
+    scheduler_set_schedule_config(&schedule, 1);
+    CHECK(sim_run_until(is_disabled, 100));
+    CHECK(scheduler_get_schedule_count() == 1);
+}
+
+// tick count wraps 5 sec after boot, authorization granted before wrap is used after
+static void scenario_tick_wrap(void)
+{
+    nvs_preset_u8("evse", "require_auth", 1);
+    boot(UINT32_MAX - pdMS_TO_TICKS(5000));
+
+    evse_authorize();
+    sim_board.vehicle = SIM_VEHICLE_B;
+    CHECK(run_until_state(EVSE_STATE_B2, 1000));
+    sim_board.vehicle = SIM_VEHICLE_C;
+    CHECK(run_until_state(EVSE_STATE_C2, 1000));
+
+    evse_loop_stats_t process;
+    evse_loop_stats_t meter;
+    evse_get_process_stats(&process);
+    evse_get_meter_stats(&meter);
+    uint32_t process_iterations = process.iterations;
+    uint32_t meter_iterations = meter.iterations;
+
+    sim_run(10000);
+    evse_get_process_stats(&process);
+    evse_get_meter_stats(&meter);
+    CHECK(process.iterations - process_iterations >= 199 && process.iterations - process_iterations <= 201);
+    CHECK(meter.iterations - meter_iterations >= 99 && meter.iterations - meter_iterations <= 101);
+    CHECK(process.max_jitter < 10000);
+}
+
+// error wait deadline set before wrap, due after
+static void scenario_tick_wrap_error(void)
+{
+    boot(UINT32_MAX - pdMS_TO_TICKS(30000));
+    plug_and_charge();
+
+    sim_board.pilot_short = true;
+    CHECK(run_until_state(EVSE_STATE_E, 100));
+    int64_t fault = sim_time();
+    sim_board.pilot_short = false;
+    sim_board.vehicle = SIM_VEHICLE_A;
+    sim_run(1000);
+    CHECK(evse_get_state() == EVSE_STATE_E);
+    CHECK(run_until_state(EVSE_STATE_A, 61000));
+    CHECK(sim_time() - fault >= 60000000 && sim_time() - fault <= 60100000);
+}
+
+// under power start before wrap, limit reached after
+static void scenario_tick_wrap_under_power(void)
+{
+    boot(UINT32_MAX - pdMS_TO_TICKS(30000));
+    evse_set_under_power_limit(9000);
+    plug_and_charge();
+
+    int64_t start = sim_time();
+    CHECK(sim_run_until(is_not_charging, 70000));
+    CHECK(sim_time() - start >= 60000000 && sim_time() - start <= 60200000);
+}
+
+// ac relay wait deadline set before wrap, due after
+static void scenario_tick_wrap_relay(void)
+{
+    boot(UINT32_MAX - pdMS_TO_TICKS(3000));
+    plug_and_charge();
+
+    evse_set_enabled(false);
+    int64_t disabled = sim_time();
+    CHECK(sim_run_until(is_ac_relay_off, 7000));
+    CHECK(sim_board.ac_relay_time - disabled >= 6000000 && sim_board.ac_relay_time - disabled <= 6100000);
+}
+
+// current sensor at JITTER_CURRENT on energy meter channel, pilot at 9V plateau
+static float jitter_source(adc_channel_t channel, int64_t time, void* arg)
+{
+    if (channel == board_config.energy_meter_l1_cur_adc_channel) {
+        return JITTER_CUR_BIAS + JITTER_CURRENT / JITTER_CUR_SCALE * M_SQRT2 * sinf(2 * M_PI * 50 * time / 1e6);
+    }
+    return 2000;
+}
+
+// pilot captures share ADC with back to back energy meter windows of 40ms, evse task period holds
+static void scenario_adc_jitter(void)
+{
+    board_config.energy_meter = BOARD_CONFIG_ENERGY_METER_CUR;
+    board_config.pilot_adc_channel = ADC_CHANNEL_0;
+    board_config.energy_meter_l1_cur_adc_channel = ADC_CHANNEL_3;
+    board_config.energy_meter_cur_scale = JITTER_CUR_SCALE;
+    nvs_preset_u8("evse_emeter", "mode", ENERGY_METER_MODE_CUR);
+    sim_adc_set_source(jitter_source, NULL);
+    sim_board.pilot_adc = true;
+    boot(0);
+
+    plug_and_charge();
+    sim_run(1000);
+    evse_reset_stats();
+    sim_board.pilot_capture_max_us = 0;
+    sim_run(10000);
+
+    evse_loop_stats_t stats;
+    evse_get_process_stats(&stats);
+    printf("pilot capture max %lldus, failed %lu, process max jitter %luus, meter current %.2fA\n",
+        (long long)sim_board.pilot_capture_max_us, (unsigned long)sim_board.pilot_capture_fails, (unsigned long)stats.max_jitter, energy_meter_get_l1_current());
+    CHECK(stats.iterations >= 199 && stats.iterations <= 201);
+    CHECK(stats.max_jitter < 10000);
+    CHECK(sim_board.pilot_capture_fails == 0);
+    // 256 samples at 128kHz and a frame of stopped meter window at most
+    CHECK(sim_board.pilot_capture_max_us < 5000);
+    // meter windows restarted after pilot captures still complete
+    CHECK(fabsf(energy_meter_get_l1_current() - JITTER_CURRENT) < 0.2f);
+}
+
+static bool is_connector_2_state(void)
+{
+    evse_snapshot_t snapshot;
+    return evse_connector_get_snapshot(1, &snapshot) == ESP_OK && snapshot.state == target_state;
+}
+
+static bool run_until_connector_2_state(evse_state_t state, uint32_t timeout_ms)
+{
+    target_state = state;
+    return sim_run_until(is_connector_2_state, timeout_ms);
+}
+
+static void scenario_connectors(void)
+{
+    board_config.connector_2 = true;
+    boot(0);
+    CHECK(evse_get_connector_count() == 2);
+    CHECK(run_until_connector_2_state(EVSE_STATE_A, 1000));
+    CHECK(sim_board.connector_2.pilot_level && !sim_board.connector_2.pilot_pwm);
+
+    // second connector charges while first stays unplugged
+    sim_board.connector_2.vehicle = SIM_VEHICLE_B;
+    CHECK(run_until_connector_2_state(EVSE_STATE_B2, 1000));
+    CHECK(sim_board.connector_2.pilot_pwm && sim_board.connector_2.pilot_amps == 320);
+    sim_board.connector_2.vehicle = SIM_VEHICLE_C;
+    CHECK(run_until_connector_2_state(EVSE_STATE_C2, 1000));
+    CHECK(sim_board.connector_2.ac_relay);
+    CHECK(evse_get_state() == EVSE_STATE_A && !sim_board.ac_relay && !sim_board.pilot_pwm);
+
+    // connector block of modbus registers
+    CHECK(modbus_read(1100) == ('C' << 8 | '2'));
+    CHECK(modbus_read(1103) == 1);
+    CHECK(modbus_write(1106, 160));
+    sim_run(100);
+    CHECK(modbus_read(1106) == 160);
+    CHECK(sim_board.connector_2.pilot_amps == 160);
+    CHECK(evse_connector_get_offered_current(1) == 160);
+    CHECK(modbus_read(1200) == UINT16_MAX);
+    CHECK(!modbus_write(1203, 0));
+
+    CHECK(modbus_write(1103, 0));
+    CHECK(run_until_connector_2_state(EVSE_STATE_C1, 100));
+    CHECK(!sim_board.connector_2.pilot_pwm);
+    CHECK(evse_is_enabled());
+
+    evse_snapshot_t snapshot;
+    CHECK(evse_connector_get_snapshot(1, &snapshot) == ESP_OK);
+    CHECK(!snapshot.enabled && snapshot.charging_current == 160);
+    CHECK(evse_connector_get_snapshot(2, &snapshot) == ESP_ERR_INVALID_ARG);
+
+    CHECK(evse_connector_set_enabled(1, true) == ESP_OK);
+    CHECK(run_until_connector_2_state(EVSE_STATE_C2, 1000));
+    sim_board.connector_2.vehicle = SIM_VEHICLE_A;
+    CHECK(run_until_connector_2_state(EVSE_STATE_A, 1000));
+    CHECK(!sim_board.connector_2.ac_relay);
+
+    // first connector is not affected by second
+    plug_and_charge();
+    CHECK(sim_board.pilot_amps == 320);
+    unplug();
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double diff = *(const double*)a - *(const double*)b;
+    return (diff > 0) - (diff < 0);
+}
+
+// cost of evse_process on host over plug, charge and unplug cycles, called between simulated task runs
+// worst case includes host preemption, p99 is the stable figure
+static void scenario_bench(void)
+{
+    static double times[BENCH_ITERATIONS];
+    boot(0);
+
+    uint64_t iterations = 0;
+    double total = 0;
+    double worst = 0;
+    uint64_t worst_iteration = 0;
+    evse_state_t worst_state = EVSE_STATE_A;
+    uint32_t phases[] = { SIM_VEHICLE_B, SIM_VEHICLE_C, SIM_VEHICLE_B, SIM_VEHICLE_A };
+
+    for (int cycle = 0; cycle < BENCH_CYCLES; cycle++) {
+        for (int phase = 0; phase < 4; phase++) {
+            sim_board.vehicle = phases[phase];
+            uint32_t duration = phases[phase] == SIM_VEHICLE_C ? BENCH_CHARGE_MS : 1000;
+
+            for (uint32_t elapsed = 0; elapsed < duration; elapsed += 50) {
+                double start = scenario_host_time();
+                evse_process();
+                double time = scenario_host_time() - start;
+
+                times[iterations] = time;
+                total += time;
+                if (time > worst) {
+                    worst = time;
+                    worst_iteration = iterations;
+                    worst_state = evse_get_state();
+                }
+                iterations++;
+
+                sim_run(50);
+            }
+        }
+    }
+
+    CHECK(iterations == BENCH_ITERATIONS);
+    CHECK(evse_get_state() == EVSE_STATE_A);
+    CHECK(sim_board.ac_relay_switches == BENCH_CYCLES * 2);
+
+    qsort(times, iterations, sizeof(double), compare_double);
+
+    printf("evse_process: %llu iterations, %.0f iterations/s, mean %.2f us, p99 %.2f us, worst %.2f us at iteration %llu in state %s\n",
+        (unsigned long long)iterations, iterations / total, total / iterations * 1e6, times[iterations * 99 / 100] * 1e6,
+        worst * 1e6, (unsigned long long)worst_iteration, evse_state_to_str(worst_state));
+}
+
+static const scenario_t scenarios[] = {
+    { "charge", scenario_charge },
+    { "disable", scenario_disable },
+    { "limit", scenario_limit },
+    { "fault", scenario_fault },
+    { "rcm", scenario_rcm },
+    { "auth", scenario_auth },
+    { "commands", scenario_commands },
+    { "scheduler", scenario_scheduler },
+    { "tick_wrap", scenario_tick_wrap },
+    { "tick_wrap_error", scenario_tick_wrap_error },
+    { "tick_wrap_under_power", scenario_tick_wrap_under_power },
+    { "tick_wrap_relay", scenario_tick_wrap_relay },
+    { "adc_jitter", scenario_adc_jitter },
+    { "connectors", scenario_connectors },
+    { "bench", scenario_bench }
+};
+
+int main(int argc, char** argv)
+{
+    return scenario_main(scenarios, sizeof(scenarios) / sizeof(scenarios[0]), argc, argv);
+}
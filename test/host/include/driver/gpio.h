@@ -0,0 +1,7 @@
+#ifndef DRIVER_GPIO_H_
+#define DRIVER_GPIO_H_
+
+#include "esp_err.h"
+#include "hal/gpio_types.h"
+
+#endif /* DRIVER_GPIO_H_ */
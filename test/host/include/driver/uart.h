@@ -0,0 +1,76 @@
+#ifndef DRIVER_UART_H_
+#define DRIVER_UART_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int uart_port_t;
+
+typedef enum
+{
+    UART_DATA_5_BITS,
+    UART_DATA_6_BITS,
+    UART_DATA_7_BITS,
+    UART_DATA_8_BITS
+} uart_word_length_t;
+
+typedef enum
+{
+    UART_STOP_BITS_1 = 1,
+    UART_STOP_BITS_1_5,
+    UART_STOP_BITS_2
+} uart_stop_bits_t;
+
+typedef enum
+{
+    UART_PARITY_DISABLE,
+    UART_PARITY_EVEN = 2,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+typedef enum
+{
+    UART_HW_FLOWCTRL_DISABLE
+} uart_hw_flowcontrol_t;
+
+typedef enum
+{
+    UART_SCLK_APB
+} uart_sclk_t;
+
+typedef enum
+{
+    UART_MODE_UART,
+    UART_MODE_RS485_HALF_DUPLEX
+} uart_mode_t;
+
+typedef struct
+{
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    uart_sclk_t source_clk;
+} uart_config_t;
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t* uart_config);
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t* uart_queue, int intr_alloc_flags);
+
+esp_err_t uart_driver_delete(uart_port_t uart_num);
+
+esp_err_t uart_set_mode(uart_port_t uart_num, uart_mode_t mode);
+
+esp_err_t uart_flush_input(uart_port_t uart_num);
+
+int uart_write_bytes(uart_port_t uart_num, const void* src, size_t size);
+
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait);
+
+int uart_read_bytes(uart_port_t uart_num, void* buf, uint32_t length, TickType_t ticks_to_wait);
+
+#endif /* DRIVER_UART_H_ */
@@ -0,0 +1,11 @@
+#ifndef ESP_ADC_ADC_CALI_H_
+#define ESP_ADC_ADC_CALI_H_
+
+#include "esp_err.h"
+#include "hal/adc_types.h"
+
+typedef struct adc_cali_scheme_t* adc_cali_handle_t;
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int* voltage);
+
+#endif /* ESP_ADC_ADC_CALI_H_ */
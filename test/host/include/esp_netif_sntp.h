@@ -0,0 +1,35 @@
+#ifndef ESP_NETIF_SNTP_H_
+#define ESP_NETIF_SNTP_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_sntp.h"
+
+typedef struct
+{
+    bool smooth_sync;
+    bool server_from_dhcp;
+    bool wait_for_sync;
+    bool start;
+    bool renew_servers_after_new_IP;
+    esp_sntp_time_cb_t sync_cb;
+    size_t num_of_servers;
+    const char* servers[1];
+} esp_sntp_config_t;
+
+#define ESP_NETIF_SNTP_DEFAULT_CONFIG(server) {     \
+        .smooth_sync = false,                       \
+        .server_from_dhcp = false,                  \
+        .wait_for_sync = true,                      \
+        .start = true,                              \
+        .renew_servers_after_new_IP = false,        \
+        .sync_cb = NULL,                            \
+        .num_of_servers = 1,                        \
+        .servers = { server }                       \
+    }
+
+// network is not simulated, time is never synchronized
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t* config);
+void esp_netif_sntp_deinit(void);
+
+#endif /* ESP_NETIF_SNTP_H_ */
@@ -0,0 +1,21 @@
+#ifndef ESP_OTA_OPS_H_
+#define ESP_OTA_OPS_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_system.h"
+
+typedef struct
+{
+    uint32_t magic_word;
+    uint32_t secure_version;
+    char version[32];
+    char project_name[32];
+    char time[16];
+    char date[16];
+    char idf_ver[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t* esp_app_get_description(void);
+
+#endif /* ESP_OTA_OPS_H_ */
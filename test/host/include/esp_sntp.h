@@ -0,0 +1,13 @@
+#ifndef ESP_SNTP_H_
+#define ESP_SNTP_H_
+
+#include <string.h>
+#include <sys/time.h>
+// as lwip and esp_netif headers pulled in by IDF
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+typedef void (*esp_sntp_time_cb_t)(struct timeval* tv);
+
+#endif /* ESP_SNTP_H_ */
@@ -0,0 +1,6 @@
+#ifndef ESP_SYSTEM_H_
+#define ESP_SYSTEM_H_
+
+void esp_restart(void) __attribute__((noreturn));
+
+#endif /* ESP_SYSTEM_H_ */
@@ -0,0 +1,92 @@
+#ifndef FREERTOS_H_
+#define FREERTOS_H_
+
+// host shim of FreeRTOS API used by firmware, tasks are run cooperatively on virtual clock by sim/rtos.c
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_bit_defs.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE                         0
+#define pdTRUE                          1
+#define pdPASS                          pdTRUE
+#define pdFAIL                          pdFALSE
+
+#define portMAX_DELAY                   ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ              CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS              (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)               ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(ticks)            ((TickType_t)(((uint64_t)(ticks) * 1000) / configTICK_RATE_HZ))
+
+// single host thread, critical sections have nothing to exclude
+typedef struct
+{
+    int owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)     ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)      ((void)(mux))
+#define portYIELD_FROM_ISR(woken)       ((void)(woken))
+
+typedef struct sim_task* TaskHandle_t;
+typedef struct sim_queue* QueueHandle_t;
+typedef struct sim_queue* SemaphoreHandle_t;
+typedef struct sim_event_group* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+typedef enum
+{
+    eNoAction,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite
+} eNotifyAction;
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack_depth, void* arg, UBaseType_t priority, TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskDelayUntil(TickType_t* prev_wake_time, TickType_t increment);
+#define vTaskDelayUntil(prev_wake_time, increment) ((void)xTaskDelayUntil(prev_wake_time, increment))
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* higher_task_woken);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_task_woken);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t timeout);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout);
+#define ulTaskNotifyTakeIndexed(index, clear_on_exit, timeout) ulTaskNotifyTake(clear_on_exit, timeout)
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t timeout);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t timeout);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+void vQueueDelete(QueueHandle_t queue);
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_task_woken);
+#define vSemaphoreDelete(semaphore)     vQueueDelete(semaphore)
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t timeout);
+
+#endif /* FREERTOS_H_ */
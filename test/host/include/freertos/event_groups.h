@@ -0,0 +1,6 @@
+#ifndef FREERTOS_EVENT_GROUPS_H_
+#define FREERTOS_EVENT_GROUPS_H_
+
+#include "freertos/FreeRTOS.h"
+
+#endif /* FREERTOS_EVENT_GROUPS_H_ */
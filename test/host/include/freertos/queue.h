@@ -0,0 +1,6 @@
+#ifndef FREERTOS_QUEUE_H_
+#define FREERTOS_QUEUE_H_
+
+#include "freertos/FreeRTOS.h"
+
+#endif /* FREERTOS_QUEUE_H_ */
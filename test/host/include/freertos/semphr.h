@@ -0,0 +1,6 @@
+#ifndef FREERTOS_SEMPHR_H_
+#define FREERTOS_SEMPHR_H_
+
+#include "freertos/FreeRTOS.h"
+
+#endif /* FREERTOS_SEMPHR_H_ */
@@ -0,0 +1,6 @@
+#ifndef FREERTOS_TASK_H_
+#define FREERTOS_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+#endif /* FREERTOS_TASK_H_ */
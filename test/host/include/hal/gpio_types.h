@@ -0,0 +1,8 @@
+#ifndef HAL_GPIO_TYPES_H_
+#define HAL_GPIO_TYPES_H_
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_NC     -1
+
+#endif /* HAL_GPIO_TYPES_H_ */
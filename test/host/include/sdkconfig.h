@@ -0,0 +1,10 @@
+#ifndef SDKCONFIG_H_
+#define SDKCONFIG_H_
+
+// host build simulates ESP32 with default tick rate
+
+#define CONFIG_IDF_TARGET               "esp32"
+#define CONFIG_IDF_TARGET_ESP32         1
+#define CONFIG_FREERTOS_HZ              100
+
+#endif /* SDKCONFIG_H_ */
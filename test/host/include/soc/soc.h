@@ -0,0 +1,8 @@
+#ifndef SOC_SOC_H_
+#define SOC_SOC_H_
+
+// ESP32
+
+#define APB_CLK_FREQ                    (80 * 1000000)
+
+#endif /* SOC_SOC_H_ */
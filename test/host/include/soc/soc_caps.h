@@ -0,0 +1,14 @@
+#ifndef SOC_CAPS_H_
+#define SOC_CAPS_H_
+
+// ESP32
+
+#define SOC_ADC_RTC_MAX_BITWIDTH        12
+#define SOC_ADC_DIGI_MAX_BITWIDTH       12
+#define SOC_ADC_DIGI_RESULT_BYTES       2
+#define SOC_ADC_MAX_CHANNEL_NUM         10
+#define SOC_ADC_SAMPLE_FREQ_THRES_HIGH  2000000
+#define SOC_LEDC_TIMER_BIT_WIDTH        20
+#define SOC_UART_NUM                    3
+
+#endif /* SOC_CAPS_H_ */
@@ -0,0 +1,652 @@
+#include <stdlib.h>
+#include <math.h>
+#include "esp_adc/adc_cali.h"
+
+#include "sim.h"
+#include "scenario.h"
+#include "board_config.h"
+#include "adc.h"
+#include "power_quality.h"
+
+// static kernels are benchmarked in place
+#include "energy_meter.c"
+
+#define BENCH_SAMPLES           4096
+#define BENCH_ROUNDS            2000
+#define RMS_ROUNDS              20000
+#define RMS_BIAS                1650    // mV, current sensor output at zero current
+#define RMS_LINE_FREQ           50      // Hz
+#define HARMONICS_ROUNDS        2000
+#define SWEEP_VOLTAGE           230     // V
+#define SWEEP_PHASES            36      // start phase offsets per frequency
+#define FIXED_WINDOW_MS         20      // window of firmware before frequency measurement
+#define RANGE_WINDOWS           20      // windows of different start phase per current and attenuation
+#define PQ_START_US             1000000 // first window
+#define PQ_CASE_WINDOWS         40      // per case, event starts in 10th window
+#define PQ_EVENT_OFFSET         (9 * WINDOW_MS * 1000 + 13000)  // us, off window boundary and off zero crossing
+#define PQ_RESUME_GAP_MS        10000   // not measured after stop
+#define PQ_DURATION_TOLERANCE   WINDOW_MS       // ms, start and end are placed between windows
+
+extern adc_cali_handle_t adc_cali_handle;
+
+static uint16_t samples[BENCH_SAMPLES];
+
+// pilot up voltage levels of esp32devkitc board
+static const int pilot_thresholds[] = { 2405, 2099, 1792, 1484 };
+
+#define PILOT_LEVELS            (sizeof(pilot_thresholds) / sizeof(pilot_thresholds[0]))
+
+static void fill_pilot_samples(void)
+{
+    // pwm at 9V and 6V plateaus over -12V, a few LSB of noise
+    const int levels[] = { 2250, 1950, 300 };
+
+    srand(1);
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        int mv = levels[(i / 64) % 3] + rand() % 16 - 8;
+        samples[i] = mv * 4096 / sim_adc_get_full_scale(ADC_ATTEN_DB_12);
+    }
+}
+
+static uint32_t classify_voltage(void)
+{
+    uint32_t sum = 0;
+
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        int mv;
+        adc_cali_raw_to_voltage(adc_cali_handle, samples[i], &mv);
+        uint32_t level = 0;
+        while (level < PILOT_LEVELS && mv < pilot_thresholds[level]) {
+            level++;
+        }
+        sum += level;
+    }
+
+    return sum;
+}
+
+static uint32_t classify_raw(const int* raw_thresholds)
+{
+    uint32_t sum = 0;
+
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        uint32_t level = 0;
+        while (level < PILOT_LEVELS && samples[i] < raw_thresholds[level]) {
+            level++;
+        }
+        sum += level;
+    }
+
+    return sum;
+}
+
+// raw thresholds classify every raw code as its LUT voltage, classified samples per second per calibration call and on raw codes
+static void scenario_threshold(void)
+{
+    sim_init(0);
+    adc_init();
+
+    uint32_t mismatches = 0;
+    for (int mv = 0; mv <= adc_atten_get_max_voltage(ADC_ATTEN_DB_12); mv++) {
+        int threshold = adc_voltage_to_raw(mv);
+        for (int raw = 0; raw <= ADC_RAW_MAX; raw++) {
+            mismatches += (raw >= threshold) != (adc_raw_to_voltage(raw) >= mv);
+        }
+    }
+    CHECK(mismatches == 0);
+
+    int raw_thresholds[PILOT_LEVELS];
+    for (int i = 0; i < PILOT_LEVELS; i++) {
+        raw_thresholds[i] = adc_voltage_to_raw(pilot_thresholds[i]);
+    }
+    fill_pilot_samples();
+
+    volatile uint32_t sink = 0;
+    double start = scenario_host_time();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        sink += classify_voltage();
+    }
+    double voltage_time = scenario_host_time() - start;
+
+    start = scenario_host_time();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        sink += classify_raw(raw_thresholds);
+    }
+    double raw_time = scenario_host_time() - start;
+
+    CHECK(classify_voltage() == classify_raw(raw_thresholds));
+
+    double total = (double)BENCH_SAMPLES * BENCH_ROUNDS;
+    printf("pilot classification: calibration call %.1f Msamples/s, raw thresholds %.1f Msamples/s, %.1fx\n",
+        total / voltage_time / 1e6, total / raw_time / 1e6, voltage_time / raw_time);
+}
+
+// captured raw of voltage in mV, with up to 1 LSB of noise
+static uint16_t get_sample(float mv, adc_atten_t atten)
+{
+    float noise = (rand() % 1024 + rand() % 1024) / 1024.0f - 1;
+
+    return MIN(MAX(lroundf(mv / sim_adc_get_full_scale(atten) * (ADC_RAW_MAX + 1) + noise), 0), ADC_CAPTURE_RAW_MAX);
+}
+
+// current sensor window, raw at ADC_ATTEN_DB_12 with 1 LSB of noise
+static void fill_current_samples(float current, size_t count, float sample_freq)
+{
+    srand(2);
+    for (size_t i = 0; i < count; i++) {
+        float mv = RMS_BIAS + current / board_config.energy_meter_cur_scale * M_SQRT2 * sinf(2 * M_PI * RMS_LINE_FREQ * i / sample_freq);
+        samples[i] = get_sample(mv, ADC_ATTEN_DB_12);
+    }
+}
+
+// rms of firmware before integer accumulation: calibration call, zero filter and float square per sample
+static float get_rms_reference(const uint16_t* samples, size_t count, float* zero)
+{
+    float sum = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        int mv;
+        adc_cali_raw_to_voltage(adc_cali_handle, samples[i], &mv);
+        *zero += (mv - *zero) / ZERO_FIX;
+        float filtered = mv - *zero;
+        sum += filtered * filtered;
+    }
+
+    return sqrtf(sum / count);
+}
+
+// same rms as get_rms in double precision, for error of its integer accumulation and float correction
+static double get_rms_exact(const uint16_t* samples, size_t count, int32_t zero)
+{
+    double z = zero / 65536.0;
+    double sum = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        sum += (samples[i] - z) * (samples[i] - z);
+    }
+
+    return sqrt(sum / count);
+}
+
+// get_rms against double precision of the same formula, against ideal rms and per sample float reference, samples per second
+static void scenario_rms(void)
+{
+    // window per channel with current and voltage of one phase, and of three phases
+    const size_t counts[] = { WINDOW_SAMPLES / 2, WINDOW_SAMPLES / 6 };
+    const float currents[] = { 0.5f, 6, 16, 32 };
+
+    sim_init(0);
+    adc_init();
+    board_config.energy_meter_cur_scale = 0.0909f;
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        size_t count = counts[c];
+        float sample_freq = (float)SAMPLE_FREQ * count / WINDOW_SAMPLES;
+
+        for (size_t i = 0; i < sizeof(currents) / sizeof(currents[0]); i++) {
+            fill_current_samples(currents[i], count, sample_freq);
+
+            int32_t zero = get_zero(samples, count);
+            int32_t kernel_zero = zero;
+            float slope;
+            float rms = get_rms(samples, count, ADC_ATTEN_DB_12, &kernel_zero, &slope);
+
+            float reference_zero = zero_to_voltage(zero);
+            float reference = get_rms_reference(samples, count, &reference_zero);
+            double exact = get_rms_exact(samples, count, zero) * slope;
+
+            float ideal = currents[i] / board_config.energy_meter_cur_scale;
+
+            double exact_error = fabs(rms - exact) / exact * 100;
+            double error = fabs(rms - ideal) / ideal * 100;
+            double reference_error = fabs(reference - ideal) / ideal * 100;
+            printf("%zu samples %4.1fA: rms %.3fmV (%.3f%%, exact %.5f%%), float reference %.3fmV (%.3f%%), ideal %.3fmV\n",
+                count, currents[i], rms, error, exact_error, reference, reference_error, ideal);
+
+            CHECK(exact_error < 0.001);
+            // whole mV calibration of each sample adds error of reference at low current
+            CHECK(error < (currents[i] < 1 ? 2 : 0.2));
+        }
+
+        volatile float sink = 0;
+        double start = scenario_host_time();
+        for (int r = 0; r < RMS_ROUNDS; r++) {
+            int32_t zero = get_zero(samples, count);
+            float slope;
+            sink += get_rms(samples, count, ADC_ATTEN_DB_12, &zero, &slope);
+        }
+        double kernel_time = scenario_host_time() - start;
+
+        start = scenario_host_time();
+        for (int r = 0; r < RMS_ROUNDS; r++) {
+            float zero = RMS_BIAS;
+            sink += get_rms_reference(samples, count, &zero);
+        }
+        double reference_time = scenario_host_time() - start;
+
+        double total = (double)count * RMS_ROUNDS;
+        printf("%zu samples: get_rms %.1f Msamples/s, float reference %.1f Msamples/s, %.1fx\n",
+            count, total / kernel_time / 1e6, total / reference_time / 1e6, reference_time / kernel_time);
+    }
+}
+
+// odd harmonics of a rectifier load, relative to fundamental
+static const float harmonic_ratios[ENERGY_METER_HARMONICS] = { [0] = 1, [2] = 0.3f, [4] = 0.1f, [6] = 0.05f };
+
+static void fill_harmonic_samples(float current, float line_freq, size_t count, float sample_freq)
+{
+    srand(3);
+    for (size_t i = 0; i < count; i++) {
+        float mv = RMS_BIAS;
+        for (uint8_t h = 0; h < ENERGY_METER_HARMONICS; h++) {
+            mv += current * harmonic_ratios[h] / board_config.energy_meter_cur_scale * M_SQRT2 * sinf(2 * M_PI * (h + 1) * line_freq * i / sample_freq + h * 0.3f);
+        }
+        samples[i] = get_sample(mv, ADC_ATTEN_DB_12);
+    }
+}
+
+// harmonics and THD over period span as in sampler task, cost of get_harmonics per phase
+static void scenario_harmonics(void)
+{
+    const size_t counts[] = { WINDOW_SAMPLES / 2, WINDOW_SAMPLES / 6 };
+    const float line_freqs[] = { 50, 60 };
+    const float current = 16;
+
+    sim_init(0);
+    adc_init();
+    board_config.energy_meter_cur_scale = 0.0909f;
+
+    float expected_thd = 0;
+    for (uint8_t h = 1; h < ENERGY_METER_HARMONICS; h++) {
+        expected_thd += harmonic_ratios[h] * harmonic_ratios[h];
+    }
+    expected_thd = sqrtf(expected_thd) * 100;
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        size_t count = counts[c];
+        float sample_freq = (float)SAMPLE_FREQ * count / WINDOW_SAMPLES;
+        float harmonics[ENERGY_METER_HARMONICS];
+
+        for (size_t f = 0; f < sizeof(line_freqs) / sizeof(line_freqs[0]); f++) {
+            fill_harmonic_samples(current, line_freqs[f], count, sample_freq);
+
+            int32_t zero = get_zero(samples, count);
+            size_t start;
+            size_t span;
+            float freq = get_period_span(samples, count, zero, sample_freq, &start, &span);
+            get_harmonics(&samples[start], span, zero, sample_freq, freq, harmonics);
+            float slope;
+            get_rms(&samples[start], span, ADC_ATTEN_DB_12, &zero, &slope);
+
+            float max_error = 0;
+            for (uint8_t h = 0; h < ENERGY_METER_HARMONICS; h++) {
+                harmonics[h] *= slope * board_config.energy_meter_cur_scale;
+                max_error = MAX(max_error, fabsf(harmonics[h] - current * harmonic_ratios[h]) / current * 100);
+            }
+            float thd = get_thd(harmonics);
+
+            printf("%zu samples %.0fHz: H1 %.3fA, H3 %.3fA, H5 %.3fA, H7 %.3fA, max error %.3f%% of fundamental, THD %.2f%% (expected %.2f%%)\n",
+                count, line_freqs[f], harmonics[0], harmonics[2], harmonics[4], harmonics[6], max_error, thd, expected_thd);
+
+            // span of whole samples misses up to one sample of period, leaking at 60Hz with few samples per period
+            CHECK(max_error < 1);
+            CHECK(fabsf(thd - expected_thd) < 0.5f);
+        }
+
+        // bound of cost, span is at most whole window
+        int32_t zero = get_zero(samples, count);
+        volatile float sink = 0;
+        double start = scenario_host_time();
+        for (int r = 0; r < HARMONICS_ROUNDS; r++) {
+            get_harmonics(samples, count, zero, sample_freq, LINE_FREQ, harmonics);
+            sink += harmonics[0];
+        }
+        double time = scenario_host_time() - start;
+
+        printf("%zu samples: get_harmonics %.1fus per phase\n", count, time / HARMONICS_ROUNDS * 1e6);
+    }
+}
+
+static void fill_voltage_samples(float voltage, float line_freq, float phase, size_t count, float sample_freq)
+{
+    srand(4);
+    for (size_t i = 0; i < count; i++) {
+        float mv = RMS_BIAS + voltage / board_config.energy_meter_vlt_scale * M_SQRT2 * sinf(2 * M_PI * line_freq * i / sample_freq + phase);
+        samples[i] = get_sample(mv, ADC_ATTEN_DB_12);
+    }
+}
+
+// worst rms error over start phases of window aligned to period span and of fixed 20ms window, 49-61Hz
+static void scenario_frequency(void)
+{
+    const size_t counts[] = { WINDOW_SAMPLES / 2, WINDOW_SAMPLES / 6 };
+
+    sim_init(0);
+    adc_init();
+    board_config.energy_meter_vlt_scale = 0.47f;
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        size_t count = counts[c];
+        float sample_freq = (float)SAMPLE_FREQ * count / WINDOW_SAMPLES;
+        size_t fixed_count = sample_freq * FIXED_WINDOW_MS / 1000;
+
+        for (int line_freq = 49; line_freq <= 61; line_freq++) {
+            float aligned_error = 0;
+            float fixed_error = 0;
+            float freq_error = 0;
+
+            for (int i = 0; i < SWEEP_PHASES; i++) {
+                fill_voltage_samples(SWEEP_VOLTAGE, line_freq, 2 * M_PI * i / SWEEP_PHASES, count, sample_freq);
+
+                int32_t zero = get_zero(samples, count);
+                size_t start;
+                size_t span;
+                float freq = get_period_span(samples, count, zero, sample_freq, &start, &span);
+
+                // zero as tracked over whole periods, not biased by either window
+                int32_t aligned_zero = get_zero(&samples[start], span);
+                int32_t fixed_zero = aligned_zero;
+                float slope;
+                float aligned = get_rms(&samples[start], span, ADC_ATTEN_DB_12, &aligned_zero, &slope) * board_config.energy_meter_vlt_scale;
+                float fixed = get_rms(samples, fixed_count, ADC_ATTEN_DB_12, &fixed_zero, &slope) * board_config.energy_meter_vlt_scale;
+
+                aligned_error = MAX(aligned_error, fabsf(aligned - SWEEP_VOLTAGE) / SWEEP_VOLTAGE * 100);
+                fixed_error = MAX(fixed_error, fabsf(fixed - SWEEP_VOLTAGE) / SWEEP_VOLTAGE * 100);
+                freq_error = MAX(freq_error, fabsf(freq - line_freq));
+            }
+
+            printf("%zu samples %dHz: rms error aligned %.3f%%, fixed %dms %.3f%%, frequency error %.4fHz\n",
+                count, line_freq, aligned_error, FIXED_WINDOW_MS, fixed_error, freq_error);
+
+            CHECK(aligned_error < 0.5f);
+            CHECK(line_freq == 50 || aligned_error < fixed_error);
+            // crossings interpolated between noisy samples
+            CHECK(freq_error < 0.05f);
+        }
+    }
+}
+
+// voltage ratio of nominal during event, time in us
+static struct
+{
+    int64_t start;
+    int64_t end;
+    float ratio;
+} pq_event;
+
+static int64_t pq_time = PQ_START_US;
+
+static double pq_cost = 0;     // s, of cycle rms range and detector
+
+static uint32_t pq_windows = 0;
+
+static void fill_pq_window(size_t count, float sample_freq, float line_freq, int64_t start)
+{
+    for (size_t i = 0; i < count; i++) {
+        int64_t time = start + (int64_t)(i * 1000000 / sample_freq);
+        float ratio = time >= pq_event.start && time < pq_event.end ? pq_event.ratio : 1;
+        float mv = RMS_BIAS + SWEEP_VOLTAGE * ratio / board_config.energy_meter_vlt_scale * M_SQRT2 * sin(2 * M_PI * line_freq * time / 1e6);
+        samples[i] = get_sample(mv, ADC_ATTEN_DB_12);
+    }
+}
+
+// one window of one phase through power quality path of sampler task
+static void process_pq_window(size_t count, float sample_freq, int32_t zero)
+{
+    size_t start;
+    size_t span;
+    float freq = get_period_span(samples, count, zero, sample_freq, &start, &span);
+    size_t cycle = lroundf(sample_freq / (freq > 0 ? freq : LINE_FREQ));
+    int32_t slope_zero = zero;
+    float slope;
+    get_rms(&samples[start], span, ADC_ATTEN_DB_12, &slope_zero, &slope);
+
+    double begin = scenario_host_time();
+    float vlt_min;
+    float vlt_max;
+    get_cycle_rms_range(samples, count, zero, cycle, &vlt_min, &vlt_max);
+    vlt_min *= slope * board_config.energy_meter_vlt_scale;
+    vlt_max *= slope * board_config.energy_meter_vlt_scale;
+    power_quality_process(&vlt_min, &vlt_max, 1, pq_time, pq_time + WINDOW_MS * 1000);
+    pq_cost += scenario_host_time() - begin;
+    pq_windows++;
+}
+
+// events detected for one disturbance of ratio of nominal voltage starting offset us after first window, type -1 expects none
+static void run_pq_case_at(size_t count, float line_freq, float ratio, uint32_t duration, int type, int64_t offset)
+{
+    float sample_freq = (float)SAMPLE_FREQ * count / WINDOW_SAMPLES;
+    power_quality_event_t events[POWER_QUALITY_EVENTS];
+
+    uint8_t event_count = power_quality_get_events(events);
+    uint32_t last_id = event_count > 0 ? events[event_count - 1].id : 0;
+
+    pq_event.start = pq_time + offset;
+    pq_event.end = pq_event.start + duration * 1000;
+    pq_event.ratio = ratio;
+
+    // zero over whole periods as measured by firmware
+    size_t start;
+    size_t span;
+    fill_pq_window(count, sample_freq, line_freq, pq_time);
+    get_period_span(samples, count, get_zero(samples, count), sample_freq, &start, &span);
+    int32_t zero = get_zero(&samples[start], span);
+
+    for (int w = 0; w < PQ_CASE_WINDOWS; w++) {
+        fill_pq_window(count, sample_freq, line_freq, pq_time);
+        process_pq_window(count, sample_freq, zero);
+        pq_time += WINDOW_MS * 1000;
+    }
+
+    uint8_t detected = 0;
+    event_count = power_quality_get_events(events);
+    for (uint8_t i = 0; i < event_count; i++) {
+        if (events[i].id <= last_id) {
+            continue;
+        }
+        detected++;
+        printf("%zu samples %.0fHz %3.0f%% %3" PRIu32 "ms: %s %" PRIu32 "ms %.1fV\n", count, line_freq, ratio * 100, duration,
+            power_quality_event_type_to_str(events[i].type), events[i].duration, events[i].voltage);
+
+        CHECK(events[i].type == type);
+        CHECK(abs((int)events[i].duration - (int)duration) <= PQ_DURATION_TOLERANCE);
+        // shorter event is not a whole cycle
+        if (duration >= 60) {
+            CHECK(fabsf(events[i].voltage - SWEEP_VOLTAGE * ratio) < SWEEP_VOLTAGE * 0.02f);
+        }
+    }
+
+    if (type < 0) {
+        printf("%zu samples %.0fHz %3.0f%%: no event\n", count, line_freq, ratio * 100);
+    }
+    CHECK(detected == (type < 0 ? 0 : 1));
+}
+
+static void run_pq_case(size_t count, float line_freq, float ratio, uint32_t duration, int type)
+{
+    run_pq_case_at(count, line_freq, ratio, duration, type, PQ_EVENT_OFFSET);
+}
+
+// sags, interruptions and swells found with duration within about one window, none at 93% and 107%, cost per window
+static void scenario_power_quality(void)
+{
+    const size_t counts[] = { WINDOW_SAMPLES / 2, WINDOW_SAMPLES / 6 };
+    const float line_freqs[] = { 50, 60 };
+
+    sim_init(0);
+    adc_init();
+    power_quality_init();
+    board_config.energy_meter_vlt_scale = 0.47f;
+    srand(5);
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        for (size_t f = 0; f < sizeof(line_freqs) / sizeof(line_freqs[0]); f++) {
+            run_pq_case(counts[c], line_freqs[f], 0.7f, 20, POWER_QUALITY_EVENT_SAG);
+            run_pq_case(counts[c], line_freqs[f], 0.7f, 60, POWER_QUALITY_EVENT_SAG);
+            run_pq_case(counts[c], line_freqs[f], 0.7f, 200, POWER_QUALITY_EVENT_SAG);
+            run_pq_case(counts[c], line_freqs[f], 0, 60, POWER_QUALITY_EVENT_INTERRUPTION);
+            run_pq_case(counts[c], line_freqs[f], 0, 500, POWER_QUALITY_EVENT_INTERRUPTION);
+            run_pq_case(counts[c], line_freqs[f], 1.2f, 100, POWER_QUALITY_EVENT_SWELL);
+            run_pq_case(counts[c], line_freqs[f], 0.93f, 1000, -1);
+            run_pq_case(counts[c], line_freqs[f], 1.07f, 1000, -1);
+        }
+    }
+
+    // event in first window after measuring resumes does not start in window before stop
+    power_quality_stop();
+    pq_time += PQ_RESUME_GAP_MS * 1000;
+    run_pq_case_at(counts[0], LINE_FREQ, 0.7f, 200, POWER_QUALITY_EVENT_SAG, 13000);
+
+    printf("cycle rms range and detector: %.2fus per window and phase\n", pq_cost / pq_windows * 1e6);
+}
+
+static void fill_range_samples(float bias, float current, float phase, adc_atten_t atten, size_t count, float sample_freq)
+{
+    for (size_t i = 0; i < count; i++) {
+        float mv = bias + current / board_config.energy_meter_cur_scale * M_SQRT2 * sinf(2 * M_PI * RMS_LINE_FREQ * i / sample_freq + phase);
+        samples[i] = get_sample(mv, atten);
+    }
+}
+
+// rms error over windows of different start phase, in % of ideal
+static float get_range_error(float bias, float current, adc_atten_t atten, size_t count, float sample_freq, float* lsb)
+{
+    float ideal = current / board_config.energy_meter_cur_scale;
+    float sum_sq = 0;
+
+    for (int w = 0; w < RANGE_WINDOWS; w++) {
+        fill_range_samples(bias, current, 2 * M_PI * w / RANGE_WINDOWS, atten, count, sample_freq);
+
+        size_t start;
+        size_t span;
+        get_period_span(samples, count, get_zero(samples, count), sample_freq, &start, &span);
+        int32_t zero = get_zero(&samples[start], span);
+        float slope;
+        float error = (get_rms(&samples[start], span, atten, &zero, &slope) - ideal) / ideal * 100;
+        sum_sq += error * error;
+        *lsb = slope;
+    }
+
+    return sqrtf(sum_sq / RANGE_WINDOWS);
+}
+
+// current ramp through range switching of sampler task after range settled at start current, windows clipped and worst rms error from 1A
+static void run_range_ramp(float bias, float from, float to, int windows, size_t count, float sample_freq)
+{
+    const int settle = RANGE_DOWN_WINDOWS * 2;
+    uint32_t clipped = 0;
+    uint32_t switches = 0;
+    float max_error = 0;
+
+    reset_cur_ranges();
+    fill_range_samples(bias, from, 0, ADC_ATTEN_DB_12, count, sample_freq);
+    cur_sens_zero[0] = get_zero(samples, count);
+
+    for (int w = -settle; w < windows; w++) {
+        float current = w < 0 ? from : from + (to - from) * w / (windows - 1);
+        adc_atten_t atten = cur_atten[0];
+        fill_range_samples(bias, current, 2 * M_PI * w / 7, atten, count, sample_freq);
+
+        uint16_t min_raw = ADC_CAPTURE_RAW_MAX;
+        for (size_t i = 0; i < count; i++) {
+            min_raw = MIN(min_raw, samples[i]);
+        }
+        uint16_t max_raw = get_max(samples, count);
+        if (min_raw == 0 || max_raw >= ADC_CAPTURE_RAW_MAX) {
+            clipped++;
+        }
+
+        // as sampler task for current L1 alone
+        size_t start;
+        size_t span;
+        float freq = get_period_span(samples, count, cur_sens_zero[0], sample_freq, &start, &span);
+        if (cur_rezero[0] && freq > 0) {
+            cur_sens_zero[0] = get_zero(&samples[start], span);
+            cur_rezero[0] = false;
+        }
+        float slope;
+        float rms = get_rms(&samples[start], span, atten, &cur_sens_zero[0], &slope) * board_config.energy_meter_cur_scale;
+        if (current >= 1) {
+            max_error = MAX(max_error, fabsf(rms - current) / current * 100);
+        }
+        update_cur_range(0, max_raw);
+        switches += cur_atten[0] != atten;
+    }
+
+    printf("%zu samples bias %.0fmV %.2f-%.2fA in %d windows: %" PRIu32 " switches, %" PRIu32 " clipped, max error %.2f%%\n",
+        count, bias, from, to, windows, switches, clipped, max_error);
+
+    CHECK(clipped == 0);
+    CHECK(switches > 0);
+    CHECK(max_error < 1);
+}
+
+// rms error of low currents at attenuation selected by ranging against ADC_ATTEN_DB_12, ramps without clipping
+static void scenario_auto_range(void)
+{
+    const size_t counts[] = { WINDOW_SAMPLES / 2, WINDOW_SAMPLES / 6 };
+    const float biases[] = { 400, 800 };
+    const float currents[] = { 0.25f, 0.5f, 2, 6 };
+
+    sim_init(0);
+    adc_init();
+    board_config.energy_meter_cur_scale = 0.0909f;
+    srand(6);
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        size_t count = counts[c];
+        float sample_freq = (float)SAMPLE_FREQ * count / WINDOW_SAMPLES;
+
+        for (size_t b = 0; b < sizeof(biases) / sizeof(biases[0]); b++) {
+            for (size_t i = 0; i < sizeof(currents) / sizeof(currents[0]); i++) {
+                int peak = biases[b] + currents[i] / board_config.energy_meter_cur_scale * M_SQRT2;
+                adc_atten_t atten = get_fitting_atten(ADC_ATTEN_DB_0, peak);
+                float db12_lsb;
+                float lsb;
+                float db12_error = get_range_error(biases[b], currents[i], ADC_ATTEN_DB_12, count, sample_freq, &db12_lsb);
+                float error = get_range_error(biases[b], currents[i], atten, count, sample_freq, &lsb);
+
+                printf("%zu samples bias %.0fmV %4.2fA: 12dB %.3fmV/LSB error %.3f%%, atten %d %.3fmV/LSB error %.3f%%, gain %.1fx\n",
+                    count, biases[b], currents[i], db12_lsb, db12_error, atten, lsb, error, db12_lsb / lsb);
+
+                CHECK(atten < ADC_ATTEN_DB_12);
+                CHECK(error < 1);
+                // above few amperes quantization is no longer main error
+                CHECK(currents[i] > 2 || error < db12_error);
+            }
+        }
+
+        run_range_ramp(400, 0.25f, 20, 200, count, sample_freq);
+        run_range_ramp(400, 20, 0.25f, 200, count, sample_freq);
+        run_range_ramp(800, 0.25f, 32, 25, count, sample_freq);
+        run_range_ramp(800, 32, 0.25f, 200, count, sample_freq);
+    }
+}
+
+// pilot kernels, in kernel_bench_pilot.c as pilot.c statics collide with energy_meter.c
+void scenario_pilot_duty(void);
+void scenario_pilot_diode(void);
+void scenario_pilot_plateaus(void);
+
+// serial meter register map kernels, in kernel_bench_meter.c
+void scenario_meter_blocks(void);
+void scenario_meter_decode(void);
+
+static const scenario_t scenarios[] = {
+    { "threshold", scenario_threshold },
+    { "rms", scenario_rms },
+    { "harmonics", scenario_harmonics },
+    { "frequency", scenario_frequency },
+    { "power_quality", scenario_power_quality },
+    { "auto_range", scenario_auto_range },
+    { "pilot_duty", scenario_pilot_duty },
+    { "pilot_diode", scenario_pilot_diode },
+    { "pilot_plateaus", scenario_pilot_plateaus },
+    { "meter_blocks", scenario_meter_blocks },
+    { "meter_decode", scenario_meter_decode }
+};
+
+int main(int argc, char** argv)
+{
+    return scenario_main(scenarios, sizeof(scenarios) / sizeof(scenarios[0]), argc, argv);
+}
@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "sim.h"
+#include "scenario.h"
+
+// static kernels are tested in place
+#include "serial_meter.c"
+
+void scenario_meter_blocks(void);
+void scenario_meter_decode(void);
+
+// polls are not exercised, serial_modbus.c and serial.c are not built
+uint16_t compute_crc(uint8_t* buf, uint16_t len)
+{
+    return 0;
+}
+
+const char* serial_meter_profile_to_str(serial_meter_profile_t profile)
+{
+    return "meter";
+}
+
+// every field is read by exactly one block, blocks within request limit
+static bool check_blocks(const meter_profile_t* meter_profile)
+{
+    bool ok = block_count > 0 && block_count <= MAX_BLOCKS && stats.requests == block_count;
+
+    for (uint8_t b = 0; b < block_count; b++) {
+        ok &= blocks[b].count > 0 && blocks[b].count <= MAX_BLOCK_REGS;
+        if (b > 0) {
+            ok &= blocks[b].reg >= blocks[b - 1].reg + blocks[b - 1].count;
+        }
+    }
+
+    for (uint8_t i = 0; i < meter_profile->field_count; i++) {
+        const reg_field_t* field = &meter_profile->fields[i];
+        uint8_t covered = 0;
+        for (uint8_t b = 0; b < block_count; b++) {
+            if (field->reg >= blocks[b].reg && field->reg + get_reg_count(field->type) <= blocks[b].reg + blocks[b].count) {
+                covered++;
+            }
+        }
+        ok &= covered == 1;
+    }
+
+    return ok;
+}
+
+// register merge of every profile and of gap and request size limits
+void scenario_meter_blocks(void)
+{
+    for (serial_meter_profile_t p = 0; p < SERIAL_METER_PROFILE_MAX; p++) {
+        profile = &profiles[p];
+        build_blocks();
+        CHECK(check_blocks(profile));
+        CHECK(block_count == 2);
+    }
+
+    profile = &profiles[SERIAL_METER_PROFILE_ABB];
+    build_blocks();
+    CHECK(blocks[0].reg == 0x5000 && blocks[0].count == 4);
+    CHECK(blocks[1].reg == 0x5B00 && blocks[1].count == 0x1C);
+
+    profile = &profiles[SERIAL_METER_PROFILE_EM340];
+    build_blocks();
+    CHECK(blocks[0].reg == 0x0000 && blocks[0].count == 0x18);
+    CHECK(blocks[1].reg == 0x0034 && blocks[1].count == 2);
+
+    // gap of MAX_BLOCK_GAP is read over, one more starts new block
+    static const reg_field_t gap_fields[] = {
+        { 0, REG_TYPE_INT32, QUANTITY_POWER, 0, 1 },
+        { 2 + MAX_BLOCK_GAP, REG_TYPE_UINT64, QUANTITY_ENERGY, 0, 1 },
+        { 6 + MAX_BLOCK_GAP + MAX_BLOCK_GAP + 1, REG_TYPE_INT32_SWAP, QUANTITY_POWER, 1, 1 }
+    };
+    meter_profile_t gap_profile = { 0x03, gap_fields, sizeof(gap_fields) / sizeof(gap_fields[0]) };
+    profile = &gap_profile;
+    build_blocks();
+    CHECK(check_blocks(profile));
+    CHECK(block_count == 2);
+    CHECK(blocks[0].reg == 0 && blocks[0].count == 6 + MAX_BLOCK_GAP);
+    CHECK(blocks[1].reg == gap_fields[2].reg && blocks[1].count == 2);
+
+    // contiguous fields are split at request limit
+    reg_field_t long_fields[100];
+    for (uint8_t i = 0; i < 100; i++) {
+        long_fields[i] = (reg_field_t){ 0x1000 + i * 2, REG_TYPE_FLOAT32, QUANTITY_VOLTAGE, 0, 1 };
+    }
+    meter_profile_t long_profile = { 0x04, long_fields, 100 };
+    profile = &long_profile;
+    build_blocks();
+    CHECK(check_blocks(profile));
+    CHECK(block_count == 2);
+    CHECK(blocks[0].count == MAX_BLOCK_REGS - MAX_BLOCK_REGS % 2);
+    CHECK(blocks[0].count + blocks[1].count == 200);
+}
+
+// register words to value of every type, and scale of block fields to quantities
+void scenario_meter_decode(void)
+{
+    static const struct
+    {
+        reg_type_t type;
+        uint8_t data[8];
+        double value;
+    } cases[] = {
+        { REG_TYPE_FLOAT32, { 0x43, 0x66, 0x80, 0x00 }, 230.5 },
+        { REG_TYPE_FLOAT32, { 0xC1, 0x20, 0x00, 0x00 }, -10 },
+        { REG_TYPE_UINT32, { 0x00, 0x01, 0x23, 0x45 }, 0x12345 },
+        { REG_TYPE_UINT32, { 0xFF, 0xFF, 0xFF, 0xFE }, 4294967294.0 },
+        { REG_TYPE_INT32, { 0xFF, 0xFF, 0xFB, 0x2E }, -1234 },
+        { REG_TYPE_INT32, { 0x00, 0x01, 0x00, 0x00 }, 65536 },
+        { REG_TYPE_INT32_SWAP, { 0x09, 0x01, 0x00, 0x00 }, 2305 },
+        { REG_TYPE_INT32_SWAP, { 0xFB, 0x2E, 0xFF, 0xFF }, -1234 },
+        { REG_TYPE_INT32_SWAP, { 0x00, 0x00, 0x00, 0x01 }, 65536 },
+        { REG_TYPE_UINT64, { 0x00, 0x00, 0x00, 0x01, 0x23, 0x45, 0x67, 0x89 }, 0x123456789 },
+        { REG_TYPE_UINT64, { 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02 }, 0x1000000000002 },
+        { REG_TYPE_UINT64, { 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00 }, 0x800000000000 }
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        reg_field_t field = { 0, cases[i].type, QUANTITY_POWER, 0, 1 };
+        double value = decode_field(&field, cases[i].data);
+        if (value != cases[i].value) {
+            printf("case %d type %d decoded %f expected %f\n", (int)i, cases[i].type, value, cases[i].value);
+        }
+        CHECK(value == cases[i].value);
+    }
+
+    // abb energy in 0.01kWh, em340 voltage in 0.1V low word first
+    energy_meter_external_t values = { 0 };
+    uint8_t data[MAX_BLOCK_REGS * 2] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xE2, 0x40 };
+    profile = &profiles[SERIAL_METER_PROFILE_ABB];
+    build_blocks();
+    decode_block(&blocks[0], data, &values);
+    CHECK(values.has_energy);
+    CHECK(values.energy == 123456ULL * 10 * 1000);
+
+    memset(data, 0, sizeof(data));
+    data[0] = 0x09;
+    data[1] = 0x01;
+    data[0x0C * 2] = 0x80;
+    data[0x0C * 2 + 2] = 0xFF;
+    data[0x0C * 2 + 3] = 0xFF;
+    profile = &profiles[SERIAL_METER_PROFILE_EM340];
+    build_blocks();
+    memset(&values, 0, sizeof(values));
+    decode_block(&blocks[0], data, &values);
+    CHECK(fabs(values.voltage[0] - 230.5) < 1e-4);
+    CHECK(fabs(values.current[0] - (int32_t)0xFFFF8000 * 0.001) < 1e-4);
+    CHECK(!values.has_energy);
+}
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "sim.h"
+#include "scenario.h"
+#include "board_config.h"
+#include "adc.h"
+
+// static kernels are benchmarked in place
+#include "pilot.c"
+
+#define MEASURES                20      // per case, at different pwm phase
+#define MEASURE_STEP_US         1370    // between measures, not multiple of pwm period
+#define PLATEAU_ROUNDS          20000
+#define EDGE_RINGING_US         12      // overshoot after edge
+#define EDGE_RINGING_MV         400
+
+// pilot levels on adc pin of esp32devkitc board, down thresholds are between them
+#define LEVEL_12                2558    // mV
+#define LEVEL_9                 2251
+#define LEVEL_6                 1944
+#define LEVEL_3                 1637
+#define LEVEL_N12               102
+#define LEVEL_DIODE_SHORT       1024    // negative half not reaching -12V threshold
+
+void scenario_pilot_duty(void);
+void scenario_pilot_diode(void);
+void scenario_pilot_plateaus(void);
+
+struct pilot_input_s
+{
+    float high;                 // mV
+    float low;                  // mV
+    bool ringing;
+};
+
+static const struct
+{
+    float level;
+    pilot_voltage_t up_voltage;
+} levels[] = {
+    { LEVEL_12, PILOT_VOLTAGE_12 },
+    { LEVEL_9, PILOT_VOLTAGE_9 },
+    { LEVEL_6, PILOT_VOLTAGE_6 },
+    { LEVEL_3, PILOT_VOLTAGE_3 }
+};
+
+#define LEVELS                  (sizeof(levels) / sizeof(levels[0]))
+
+// pwm of first ledc channel at 1kHz, periods start at whole ms
+static float pilot_source(adc_channel_t channel, int64_t time, void* arg)
+{
+    const struct pilot_input_s* input = arg;
+    float duty = sim_ledc_get_duty(LEDC_CHANNEL_0);
+    int64_t phase = time % 1000;
+    int64_t high_time = lroundf(duty * 1000);
+    // constant level has no edges to ring
+    bool ringing = input->ringing && high_time > 0 && high_time < 1000;
+
+    if (phase < high_time) {
+        return input->high + (ringing && phase < EDGE_RINGING_US ? EDGE_RINGING_MV : 0);
+    } else {
+        return input->low - (ringing && phase - high_time < EDGE_RINGING_US ? EDGE_RINGING_MV : 0);
+    }
+}
+
+static void pilot_bench_init(void)
+{
+    sim_init(0);
+    board_config.pilot_adc_channel = ADC_CHANNEL_0;
+    board_config.pilot_down_threshold_12 = 2405;
+    board_config.pilot_down_threshold_9 = 2099;
+    board_config.pilot_down_threshold_6 = 1792;
+    board_config.pilot_down_threshold_3 = 1484;
+    board_config.pilot_down_threshold_n12 = 728;
+    adc_init();
+    pilot_init();
+    sim_adc_set_noise(2);
+}
+
+// every measure of case classifies as expected, measures start at different pwm phases
+static bool measure_case(struct pilot_input_s* input, pilot_voltage_t up_voltage, bool down_voltage_n12)
+{
+    bool ok = true;
+
+    sim_adc_set_source(pilot_source, input);
+    for (int i = 0; i < MEASURES; i++) {
+        pilot_voltage_t up;
+        bool n12;
+        pilot_measure(0, &up, &n12);
+        ok &= up == up_voltage && n12 == down_voltage_n12;
+        sim_delay_us(MEASURE_STEP_US);
+    }
+
+    return ok;
+}
+
+// pilot_measure on sim adc with ledc output at 100%, 50% and 10% duty on every up level
+void scenario_pilot_duty(void)
+{
+    const uint16_t amps[] = { 300, 60 };  // 50% and 10% duty
+
+    pilot_bench_init();
+
+    for (size_t l = 0; l < LEVELS; l++) {
+        struct pilot_input_s input = { .high = levels[l].level, .low = LEVEL_N12, .ringing = true };
+
+        // constant level, low plateau is high level
+        pilot_set_level(0, true);
+        CHECK(measure_case(&input, levels[l].up_voltage, false));
+
+        for (size_t a = 0; a < sizeof(amps) / sizeof(amps[0]); a++) {
+            pilot_set_amps(0, amps[a]);
+            CHECK(pilot_get_duty(0) == amps[a] * 100 / 6);
+            CHECK(measure_case(&input, levels[l].up_voltage, true));
+        }
+    }
+
+    // -12V output
+    struct pilot_input_s input = { .high = LEVEL_12, .low = LEVEL_N12 };
+    pilot_set_level(0, false);
+    CHECK(measure_case(&input, PILOT_VOLTAGE_1, true));
+}
+
+// shorted vehicle diode does not reach -12V on low plateau
+void scenario_pilot_diode(void)
+{
+    pilot_bench_init();
+
+    struct pilot_input_s input = { .high = LEVEL_6, .low = LEVEL_N12 };
+    pilot_set_amps(0, 160);
+    CHECK(measure_case(&input, PILOT_VOLTAGE_6, true));
+
+    input.low = LEVEL_DIODE_SHORT;
+    CHECK(measure_case(&input, PILOT_VOLTAGE_6, false));
+
+    pilot_set_amps(0, 60);
+    CHECK(measure_case(&input, PILOT_VOLTAGE_6, false));
+}
+
+// samples of 10% duty pwm with ringing after edges and single sample glitches on plateaus, without noise
+static void fill_plateau_samples(int high, int low, int ringing, bool glitches)
+{
+    for (size_t i = 0; i < PILOT_SAMPLES; i++) {
+        size_t phase = i % (PILOT_SAMPLE_FREQ / PILOT_PWM_FREQ);
+        int value = phase < PILOT_SAMPLE_FREQ / PILOT_PWM_FREQ / 10 ? high : low;
+        if (phase == 0) {
+            value += ringing;
+        }
+        if (phase == PILOT_SAMPLE_FREQ / PILOT_PWM_FREQ / 10) {
+            value -= ringing;
+        }
+        samples[i] = MAX(0, MIN(ADC_CAPTURE_RAW_MAX, value));
+    }
+    if (glitches) {
+        // inside high and low plateau, not crossing threshold
+        samples[6] = high - ringing;
+        samples[100] = low + ringing;
+    }
+}
+
+// median of plateaus rejects glitches, edge guard skips samples around every edge, plateaus per second
+void scenario_pilot_plateaus(void)
+{
+    const size_t period = PILOT_SAMPLE_FREQ / PILOT_PWM_FREQ;
+    const int ringing = 300;
+
+    sim_init(0);
+    adc_init();
+
+    const int high = adc_voltage_to_raw(LEVEL_6);
+    const int low = adc_voltage_to_raw(LEVEL_N12);
+
+    // edge guard covers both sides of every pwm edge
+    fill_plateau_samples(high, low, ringing, false);
+    int threshold = (high + low) / 2;
+    size_t guarded = 0;
+    size_t edges = 0;
+    for (size_t i = 0; i < PILOT_SAMPLES; i++) {
+        if (i > 0 && (samples[i] >= threshold) != (samples[i - 1] >= threshold)) {
+            edges++;
+        }
+        guarded += near_edge(i, PILOT_SAMPLES, threshold);
+    }
+    CHECK(edges == 2 * PILOT_SAMPLES / period - 1);
+    CHECK(guarded == edges * 2 * PILOT_EDGE_GUARD);
+    CHECK(near_edge(period / 10 - PILOT_EDGE_GUARD, PILOT_SAMPLES, threshold));
+    CHECK(!near_edge(period / 10 - PILOT_EDGE_GUARD - 1, PILOT_SAMPLES, threshold));
+    CHECK(near_edge(period / 10 + PILOT_EDGE_GUARD - 1, PILOT_SAMPLES, threshold));
+    CHECK(!near_edge(period / 10 + PILOT_EDGE_GUARD, PILOT_SAMPLES, threshold));
+
+    int measured_high, measured_low;
+    get_plateaus(PILOT_SAMPLES, &measured_high, &measured_low);
+    CHECK(measured_high == high);
+    CHECK(measured_low == low);
+
+    // mean of high samples is moved by glitches and ringing, median is not
+    fill_plateau_samples(high, low, ringing, true);
+    int64_t high_sum = 0;
+    size_t high_count = 0;
+    for (size_t i = 0; i < PILOT_SAMPLES; i++) {
+        if (samples[i] >= threshold) {
+            high_sum += samples[i];
+            high_count++;
+        }
+    }
+    get_plateaus(PILOT_SAMPLES, &measured_high, &measured_low);
+    CHECK(measured_high == high);
+    CHECK(measured_low == low);
+
+    // constant level has no edges, median of all samples
+    for (size_t i = 0; i < PILOT_SAMPLES; i++) {
+        samples[i] = high + (i % 2 ? 1 : -1) * (i % 7);
+    }
+    samples[10] = high - PILOT_EDGE_MIN_RAW / 2;
+    get_plateaus(PILOT_SAMPLES, &measured_high, &measured_low);
+    CHECK(measured_high == measured_low);
+    CHECK(abs(measured_high - high) <= 1);
+
+    volatile int sink = 0;
+    double start = scenario_host_time();
+    for (int r = 0; r < PLATEAU_ROUNDS; r++) {
+        fill_plateau_samples(high, low, ringing, true);
+        get_plateaus(PILOT_SAMPLES, &measured_high, &measured_low);
+        sink += measured_high;
+    }
+    double time = scenario_host_time() - start;
+
+    printf("pilot plateaus: median %d raw, mean %.1f raw of high %d raw, %.2f us per capture of %d samples\n",
+        measured_high, (double)high_sum / high_count, high, time / PLATEAU_ROUNDS * 1e6, PILOT_SAMPLES);
+}
@@ -0,0 +1,36 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scenario.h"
+
+bool scenario_failed = false;
+
+int scenario_main(const scenario_t* scenarios, size_t count, int argc, char** argv)
+{
+    if (argc != 2) {
+        printf("usage: %s <scenario>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(argv[1], scenarios[i].name) == 0) {
+            scenarios[i].run();
+            printf("%s: %s\n", scenarios[i].name, scenario_failed ? "FAILED" : "passed");
+            return scenario_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+    }
+
+    printf("unknown scenario %s\n", argv[1]);
+    return EXIT_FAILURE;
+}
+
+double scenario_host_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
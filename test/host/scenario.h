@@ -0,0 +1,49 @@
+#ifndef SCENARIO_H_
+#define SCENARIO_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#include "sim.h"
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            printf("%s:%d: %.3fs check failed: %s\n", __FILE__, __LINE__,           \
+                sim_time() / 1000000.0, #cond);                                     \
+            scenario_failed = true;                                                 \
+        }                                                                           \
+    } while (0)
+
+/**
+ * @brief Scripted scenario, run in its own process by ctest
+ *
+ */
+typedef struct
+{
+    const char* name;
+    void (*run)(void);
+} scenario_t;
+
+extern bool scenario_failed;
+
+/**
+ * @brief Run scenario named by first argument
+ *
+ * @param scenarios
+ * @param count
+ * @param argc
+ * @param argv
+ * @return int process exit code, failure when any check failed
+ */
+int scenario_main(const scenario_t* scenarios, size_t count, int argc, char** argv);
+
+/**
+ * @brief Get monotonic host time, for benchmarks
+ *
+ * @return double s
+ */
+double scenario_host_time(void);
+
+#endif /* SCENARIO_H_ */
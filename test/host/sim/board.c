@@ -0,0 +1,226 @@
+#include "esp_timer.h"
+
+#include "board.h"
+#include "board_config.h"
+#include "pilot.h"
+#include "proximity.h"
+#include "ac_relay.h"
+#include "socket_lock.h"
+#include "rcm.h"
+#include "temp_sensor.h"
+#include "adc.h"
+
+
+board_config_t board_config;
+
+sim_board_t sim_board = {
+    .vehicle = SIM_VEHICLE_A,
+    .temp_high = 2500,
+    .cable_max_current = 32,
+    .pilot_level = true
+};
+
+static uint16_t lock_operating_time = 300;
+
+static uint16_t lock_break_time = 1000;
+
+static uint8_t lock_retry_count = 5;
+
+static bool lock_detection_high = false;
+
+uint8_t board_config_get_connector_count(void)
+{
+    return board_config.connector_2 ? 2 : 1;
+}
+
+// pilot driver itself is built instead by benchmarks of its kernels
+#ifndef SIM_PILOT_DRIVER
+
+#define PILOT_SAMPLE_FREQ       128000  // as pilot driver
+
+void pilot_set_level(uint8_t connector, bool level)
+{
+    if (connector == 0) {
+        sim_board.pilot_level = level;
+        sim_board.pilot_pwm = false;
+        sim_board.pilot_amps = 0;
+    } else {
+        sim_board.connector_2.pilot_level = level;
+        sim_board.connector_2.pilot_pwm = false;
+        sim_board.connector_2.pilot_amps = 0;
+    }
+}
+
+void pilot_set_amps(uint8_t connector, uint16_t amps)
+{
+    if (connector == 0) {
+        sim_board.pilot_pwm = true;
+        sim_board.pilot_amps = amps;
+    } else {
+        sim_board.connector_2.pilot_pwm = true;
+        sim_board.connector_2.pilot_amps = amps;
+    }
+}
+
+uint16_t pilot_get_amps(uint8_t connector)
+{
+    return connector == 0 ? sim_board.pilot_amps : sim_board.connector_2.pilot_amps;
+}
+
+uint16_t pilot_get_duty(uint8_t connector)
+{
+    return pilot_get_amps(connector) * 100 / 6;
+}
+
+static pilot_voltage_t get_up_voltage(sim_vehicle_t vehicle, bool pilot_short, bool level, bool pwm)
+{
+    if (pilot_short || (!pwm && !level)) {
+        return PILOT_VOLTAGE_1;
+    }
+
+    switch (vehicle) {
+    case SIM_VEHICLE_A:
+        return PILOT_VOLTAGE_12;
+    case SIM_VEHICLE_B:
+        return PILOT_VOLTAGE_9;
+    case SIM_VEHICLE_C:
+        return pwm ? PILOT_VOLTAGE_6 : PILOT_VOLTAGE_9;
+    default:
+        return pwm ? PILOT_VOLTAGE_3 : PILOT_VOLTAGE_9;
+    }
+}
+
+// pilot and diode shorts are simulated on first connector only
+void pilot_measure(uint8_t connector, pilot_voltage_t* up_voltage, bool* down_voltage_n12)
+{
+    if (sim_board.pilot_adc) {
+        static uint16_t samples[PILOT_CAPTURE_SAMPLES];
+        adc_channel_t channel = connector == 0 ? board_config.pilot_adc_channel : board_config.connector_2_pilot_adc_channel;
+        int64_t start = esp_timer_get_time();
+        if (adc_capture(&channel, NULL, 1, PILOT_SAMPLE_FREQ, samples, PILOT_CAPTURE_SAMPLES) != ESP_OK) {
+            sim_board.pilot_capture_fails++;
+        }
+        if (esp_timer_get_time() - start > sim_board.pilot_capture_max_us) {
+            sim_board.pilot_capture_max_us = esp_timer_get_time() - start;
+        }
+    }
+
+    if (connector == 0) {
+        sim_board.pilot_measures++;
+        *up_voltage = get_up_voltage(sim_board.vehicle, sim_board.pilot_short, sim_board.pilot_level, sim_board.pilot_pwm);
+        *down_voltage_n12 = sim_board.pilot_pwm && !sim_board.diode_short;
+    } else {
+        *up_voltage = get_up_voltage(sim_board.connector_2.vehicle, false, sim_board.connector_2.pilot_level, sim_board.connector_2.pilot_pwm);
+        *down_voltage_n12 = sim_board.connector_2.pilot_pwm;
+    }
+}
+
+void pilot_capture_trigger(void)
+{
+}
+
+#endif /* SIM_PILOT_DRIVER */
+
+uint8_t proximity_get_max_current(void)
+{
+    return sim_board.cable_max_current;
+}
+
+void ac_relay_set_state(uint8_t connector, bool state)
+{
+    if (connector != 0) {
+        sim_board.connector_2.ac_relay = state;
+        return;
+    }
+
+    if (sim_board.ac_relay != state) {
+        sim_board.ac_relay = state;
+        sim_board.ac_relay_switches++;
+        sim_board.ac_relay_time = esp_timer_get_time();
+    }
+}
+
+void socket_lock_set_locked(bool locked)
+{
+    sim_board.socket_locked = locked;
+}
+
+socket_lock_status_t socket_lock_get_status(void)
+{
+    if (sim_board.socket_lock_fail) {
+        return sim_board.socket_locked ? SOCKED_LOCK_STATUS_LOCKING_FAIL : SOCKED_LOCK_STATUS_UNLOCKING_FAIL;
+    }
+    return SOCKED_LOCK_STATUS_IDLE;
+}
+
+bool socket_lock_is_detection_high(void)
+{
+    return lock_detection_high;
+}
+
+void socket_lock_set_detection_high(bool detection_high)
+{
+    lock_detection_high = detection_high;
+}
+
+uint16_t socket_lock_get_operating_time(void)
+{
+    return lock_operating_time;
+}
+
+esp_err_t socket_lock_set_operating_time(uint16_t operating_time)
+{
+    lock_operating_time = operating_time;
+    return ESP_OK;
+}
+
+uint8_t socket_lock_get_retry_count(void)
+{
+    return lock_retry_count;
+}
+
+void socket_lock_set_retry_count(uint8_t retry_count)
+{
+    lock_retry_count = retry_count;
+}
+
+uint16_t socket_lock_get_break_time(void)
+{
+    return lock_break_time;
+}
+
+esp_err_t socket_lock_set_break_time(uint16_t break_time)
+{
+    lock_break_time = break_time;
+    return ESP_OK;
+}
+
+bool rcm_test(void)
+{
+    return !sim_board.rcm_test_fail;
+}
+
+bool rcm_is_triggered(void)
+{
+    return sim_board.rcm_triggered;
+}
+
+uint8_t temp_sensor_get_count(void)
+{
+    return 1;
+}
+
+int16_t temp_sensor_get_low(void)
+{
+    return sim_board.temp_high;
+}
+
+int16_t temp_sensor_get_high(void)
+{
+    return sim_board.temp_high;
+}
+
+bool temp_sensor_is_error(void)
+{
+    return false;
+}
@@ -0,0 +1,60 @@
+#ifndef SIM_BOARD_H_
+#define SIM_BOARD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "socket_lock.h"
+
+/**
+ * @brief Vehicle state by J1772 resistance on pilot
+ *
+ */
+typedef enum
+{
+    SIM_VEHICLE_A,                  // not connected
+    SIM_VEHICLE_B,                  // connected
+    SIM_VEHICLE_C,                  // charging requested, pilot at 6V only while pwm
+    SIM_VEHICLE_D                   // charging with ventilation requested, pilot at 3V only while pwm
+} sim_vehicle_t;
+
+/**
+ * @brief Simulated pilot, ac relay, socket lock, rcm, temperature sensor and proximity, stand in for their drivers
+ *
+ */
+typedef struct
+{
+    // inputs, set by scenario
+    sim_vehicle_t vehicle;
+    bool pilot_short;               // pilot measured below 3V
+    bool diode_short;               // down voltage not -12V
+    bool rcm_triggered;
+    bool rcm_test_fail;
+    bool socket_lock_fail;
+    int16_t temp_high;              // C*100
+    uint8_t cable_max_current;      // A
+    bool pilot_adc;                 // pilot measure captures pilot channel as pilot driver does, sharing ADC with energy meter
+    // outputs, set by firmware
+    bool pilot_level;
+    bool pilot_pwm;
+    uint16_t pilot_amps;            // A*10
+    bool ac_relay;
+    uint32_t ac_relay_switches;
+    int64_t ac_relay_time;          // us, last switch
+    bool socket_locked;
+    uint32_t pilot_measures;
+    uint32_t pilot_capture_fails;   // with pilot_adc, classification is then kept from previous measure
+    int64_t pilot_capture_max_us;   // with pilot_adc, longest capture including wait for ADC
+    // second connector when board_config.connector_2, inputs and outputs as above
+    struct
+    {
+        sim_vehicle_t vehicle;
+        bool pilot_level;
+        bool pilot_pwm;
+        uint16_t pilot_amps;        // A*10
+        bool ac_relay;
+    } connector_2;
+} sim_board_t;
+
+extern sim_board_t sim_board;
+
+#endif /* SIM_BOARD_H_ */
@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "soc/soc_caps.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali_scheme.h"
+
+#include "sim.h"
+
+#define RAW_MAX                 ((1 << SOC_ADC_RTC_MAX_BITWIDTH) - 1)
+#define CONTINUOUS_SHIFT        (SOC_ADC_RTC_MAX_BITWIDTH - SOC_ADC_DIGI_MAX_BITWIDTH)
+#define MAX_PATTERNS            8
+
+#define LIN_COEFF_A_SCALE       65536
+
+// ESP32 like linear transfer, calibration is in whole mV as line fitting scheme
+static const float full_scale[ADC_ATTEN_DB_12 + 1] = { 1100, 1500, 2200, 3900 };
+
+struct adc_oneshot_unit_ctx_t
+{
+    adc_atten_t attens[SOC_ADC_MAX_CHANNEL_NUM];
+};
+
+// dispatched through scheme with integer coefficients as esp_adc line fitting
+struct adc_cali_scheme_t
+{
+    esp_err_t (*raw_to_voltage)(void* ctx, int raw, int* voltage);
+    void* ctx;
+    uint32_t coeff_a;
+    uint32_t coeff_b;
+};
+
+struct adc_continuous_ctx_t
+{
+    uint32_t frame_size;
+    uint32_t pool_frames;
+    adc_digi_pattern_config_t pattern[MAX_PATTERNS];
+    uint32_t pattern_num;
+    uint32_t sample_freq;
+    adc_continuous_evt_cbs_t cbs;
+    void* user_data;
+    esp_timer_handle_t timer;
+    int64_t start_time;
+    uint64_t frames_done;
+    uint64_t frames_read;
+};
+
+static sim_adc_source_t source = NULL;
+
+static void* source_arg = NULL;
+
+static float noise = 0;
+
+static uint64_t rng_state = 0x853c49e6748fea9bULL;
+
+void sim_adc_set_source(sim_adc_source_t _source, void* arg)
+{
+    source = _source;
+    source_arg = arg;
+}
+
+void sim_adc_set_noise(float lsb)
+{
+    noise = lsb;
+}
+
+float sim_adc_get_full_scale(adc_atten_t atten)
+{
+    return full_scale[atten];
+}
+
+// deterministic, runs are reproducible
+static double get_random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double get_gauss(void)
+{
+    return sqrt(-2 * log(get_random())) * cos(2 * M_PI * get_random());
+}
+
+static int convert(adc_channel_t channel, adc_atten_t atten, int64_t time)
+{
+    float voltage = source ? source(channel, time, source_arg) : 0;
+    double raw = voltage / full_scale[atten] * (RAW_MAX + 1);
+
+    if (noise > 0) {
+        raw += get_gauss() * noise;
+    }
+
+    return raw < 0 ? 0 : (raw > RAW_MAX ? RAW_MAX : (int)lround(raw));
+}
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t* init_config, adc_oneshot_unit_handle_t* ret_unit)
+{
+    struct adc_oneshot_unit_ctx_t* unit = calloc(1, sizeof(struct adc_oneshot_unit_ctx_t));
+
+    for (int i = 0; i < SOC_ADC_MAX_CHANNEL_NUM; i++) {
+        unit->attens[i] = ADC_ATTEN_DB_12;
+    }
+    *ret_unit = unit;
+
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t handle, adc_channel_t channel, const adc_oneshot_chan_cfg_t* config)
+{
+    if (channel >= SOC_ADC_MAX_CHANNEL_NUM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->attens[channel] = config->atten;
+
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t handle, adc_channel_t channel, int* out_raw)
+{
+    if (channel >= SOC_ADC_MAX_CHANNEL_NUM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_raw = convert(channel, handle->attens[channel], esp_timer_get_time());
+
+    return ESP_OK;
+}
+
+static esp_err_t line_fitting_raw_to_voltage(void* ctx, int raw, int* voltage)
+{
+    const struct adc_cali_scheme_t* scheme = ctx;
+
+    *voltage = ((uint32_t)raw * scheme->coeff_a + LIN_COEFF_A_SCALE / 2) / LIN_COEFF_A_SCALE + scheme->coeff_b;
+
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_create_scheme_line_fitting(const adc_cali_line_fitting_config_t* config, adc_cali_handle_t* ret_handle)
+{
+    struct adc_cali_scheme_t* scheme = calloc(1, sizeof(struct adc_cali_scheme_t));
+
+    scheme->raw_to_voltage = line_fitting_raw_to_voltage;
+    scheme->ctx = scheme;
+    scheme->coeff_a = lroundf(full_scale[config->atten] * LIN_COEFF_A_SCALE / (RAW_MAX + 1));
+    scheme->coeff_b = 0;
+    *ret_handle = scheme;
+
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int* voltage)
+{
+    if (handle == NULL || voltage == NULL || raw < 0 || raw > RAW_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return handle->raw_to_voltage(handle->ctx, raw, voltage);
+}
+
+static uint32_t get_frame_results(adc_continuous_handle_t handle)
+{
+    return handle->frame_size / SOC_ADC_DIGI_RESULT_BYTES;
+}
+
+static int64_t get_conversion_time(adc_continuous_handle_t handle, uint64_t index)
+{
+    return handle->start_time + (int64_t)(index * 1000000 / handle->sample_freq);
+}
+
+// conversion done interrupt after last conversion of each frame
+static void frame_timer_callback(void* arg)
+{
+    adc_continuous_handle_t handle = arg;
+    uint32_t results = get_frame_results(handle);
+
+    handle->frames_done++;
+    if (handle->frames_done - handle->frames_read > handle->pool_frames) {
+        // pool overflow, oldest frame is lost
+        handle->frames_read++;
+    }
+
+    if (handle->cbs.on_conv_done) {
+        adc_continuous_evt_data_t data = {
+            .size = handle->frame_size
+        };
+        handle->cbs.on_conv_done(handle, &data, handle->user_data);
+    }
+
+    int64_t next = get_conversion_time(handle, (handle->frames_done + 1) * results - 1);
+    esp_timer_start_once(handle->timer, next - esp_timer_get_time());
+}
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t* hdl_config, adc_continuous_handle_t* ret_handle)
+{
+    struct adc_continuous_ctx_t* handle = calloc(1, sizeof(struct adc_continuous_ctx_t));
+
+    handle->frame_size = hdl_config->conv_frame_size;
+    handle->pool_frames = hdl_config->max_store_buf_size / hdl_config->conv_frame_size;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = frame_timer_callback,
+        .arg = handle,
+        .name = "adc_frame"
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &handle->timer);
+    if (ret != ESP_OK) {
+        free(handle);
+        return ret;
+    }
+    *ret_handle = handle;
+
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t* config)
+{
+    if (config->pattern_num == 0 || config->pattern_num > MAX_PATTERNS || config->sample_freq_hz == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(handle->pattern, config->adc_pattern, config->pattern_num * sizeof(adc_digi_pattern_config_t));
+    handle->pattern_num = config->pattern_num;
+    handle->sample_freq = config->sample_freq_hz;
+
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_register_event_callbacks(adc_continuous_handle_t handle, const adc_continuous_evt_cbs_t* cbs, void* user_data)
+{
+    handle->cbs = *cbs;
+    handle->user_data = user_data;
+
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle)
+{
+    handle->start_time = esp_timer_get_time();
+    handle->frames_done = 0;
+    handle->frames_read = 0;
+
+    int64_t first = get_conversion_time(handle, get_frame_results(handle) - 1);
+    return esp_timer_start_once(handle->timer, first - handle->start_time);
+}
+
+// frame results are converted when read, each at its own conversion time
+esp_err_t adc_continuous_read(adc_continuous_handle_t handle, uint8_t* buf, uint32_t length_max, uint32_t* out_length, uint32_t timeout_ms)
+{
+    uint32_t results = get_frame_results(handle);
+
+    if (handle->frames_read == handle->frames_done || length_max < handle->frame_size) {
+        *out_length = 0;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    for (uint32_t i = 0; i < results; i++) {
+        uint64_t index = handle->frames_read * results + i;
+        const adc_digi_pattern_config_t* pattern = &handle->pattern[index % handle->pattern_num];
+        adc_digi_output_data_t data = { 0 };
+
+        data.type1.channel = pattern->channel;
+        data.type1.data = convert(pattern->channel, pattern->atten, get_conversion_time(handle, index)) >> CONTINUOUS_SHIFT;
+        memcpy(&buf[i * SOC_ADC_DIGI_RESULT_BYTES], &data, SOC_ADC_DIGI_RESULT_BYTES);
+    }
+    handle->frames_read++;
+    *out_length = handle->frame_size;
+
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t handle)
+{
+    esp_timer_stop(handle->timer);
+
+    return ESP_OK;
+}
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp_netif_sntp.h"
+
+static esp_log_level_t log_level = ESP_LOG_WARN;
+
+static const esp_app_desc_t app_desc = {
+    .version = "host",
+    .project_name = "esp32-evse",
+    .idf_ver = "host"
+};
+
+void esp_log_level_set(const char* tag, esp_log_level_t level)
+{
+    log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    va_list args;
+
+    if (level > log_level) {
+        return;
+    }
+
+    int64_t time = esp_timer_get_time();
+    printf("%c (%lld.%03lld) %s: ", letters[level], (long long)(time / 1000000), (long long)(time / 1000 % 1000), tag);
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
+
+const char* esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+        return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_NOT_FINISHED:
+        return "ESP_ERR_NOT_FINISHED";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+const esp_app_desc_t* esp_app_get_description(void)
+{
+    return &app_desc;
+}
+
+void esp_restart(void)
+{
+    fprintf(stderr, "sim: esp_restart called\n");
+    exit(EXIT_FAILURE);
+}
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t* config)
+{
+    return ESP_OK;
+}
+
+void esp_netif_sntp_deinit(void)
+{
+}
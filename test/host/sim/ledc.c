@@ -0,0 +1,82 @@
+#include <stdbool.h>
+#include "driver/ledc.h"
+
+#include "sim.h"
+
+#define TIMERS                  (LEDC_TIMER_3 + 1)
+
+static uint32_t timer_resolutions[TIMERS];
+
+// duty is applied on update as by hardware, stopped channel outputs idle level
+static struct sim_ledc_channel
+{
+    ledc_timer_t timer;
+    uint32_t duty;
+    uint32_t pending_duty;
+    bool running;
+    uint32_t idle_level;
+} channels[LEDC_CHANNEL_MAX];
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t* timer_conf)
+{
+    if (timer_conf->timer_num >= TIMERS || timer_conf->duty_resolution == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    timer_resolutions[timer_conf->timer_num] = timer_conf->duty_resolution;
+
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t* ledc_conf)
+{
+    if (ledc_conf->channel >= LEDC_CHANNEL_MAX || ledc_conf->timer_sel >= TIMERS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct sim_ledc_channel* channel = &channels[ledc_conf->channel];
+    channel->timer = ledc_conf->timer_sel;
+    channel->duty = channel->pending_duty = ledc_conf->duty;
+    channel->running = true;
+
+    return ESP_OK;
+}
+
+esp_err_t ledc_stop(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t idle_level)
+{
+    channels[channel].running = false;
+    channels[channel].idle_level = idle_level;
+
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty)
+{
+    channels[channel].pending_duty = duty;
+
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    channels[channel].duty = channels[channel].pending_duty;
+    channels[channel].running = true;
+
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+float sim_ledc_get_duty(uint8_t channel)
+{
+    const struct sim_ledc_channel* ch = &channels[channel];
+
+    if (!ch->running) {
+        return ch->idle_level ? 1 : 0;
+    }
+
+    return (float)ch->duty / (1UL << timer_resolutions[ch->timer]);
+}
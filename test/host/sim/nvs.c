@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+
+#include "sim.h"
+
+#define MAX_NAMESPACES          16
+#define MAX_ENTRIES             128
+#define NAME_SIZE               16
+
+enum entry_type_e {
+    ENTRY_TYPE_U8,
+    ENTRY_TYPE_U16,
+    ENTRY_TYPE_U32,
+    ENTRY_TYPE_U64,
+    ENTRY_TYPE_STR,
+    ENTRY_TYPE_BLOB
+};
+
+// values are kept in memory, commit has nothing to flush
+struct entry_s
+{
+    nvs_handle_t ns;
+    char key[NAME_SIZE];
+    enum entry_type_e type;
+    size_t length;
+    void* value;
+};
+
+static char namespaces[MAX_NAMESPACES][NAME_SIZE];
+
+static uint8_t namespace_count = 0;
+
+static struct entry_s entries[MAX_ENTRIES];
+
+static uint8_t entry_count = 0;
+
+static uint32_t write_count = 0;
+
+uint32_t sim_nvs_get_write_count(void)
+{
+    return write_count;
+}
+
+esp_err_t nvs_open(const char* namespace_name, nvs_open_mode_t open_mode, nvs_handle_t* handle)
+{
+    for (uint8_t i = 0; i < namespace_count; i++) {
+        if (strncmp(namespaces[i], namespace_name, NAME_SIZE) == 0) {
+            *handle = i;
+            return ESP_OK;
+        }
+    }
+
+    if (namespace_count == MAX_NAMESPACES) {
+        return ESP_ERR_NO_MEM;
+    }
+    strncpy(namespaces[namespace_count], namespace_name, NAME_SIZE - 1);
+    *handle = namespace_count++;
+
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+static struct entry_s* find_entry(nvs_handle_t handle, const char* key)
+{
+    for (uint8_t i = 0; i < entry_count; i++) {
+        if (entries[i].ns == handle && strncmp(entries[i].key, key, NAME_SIZE) == 0) {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+    struct entry_s* entry = find_entry(handle, key);
+
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    free(entry->value);
+    *entry = entries[--entry_count];
+    write_count++;
+
+    return ESP_OK;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char* key, enum entry_type_e type, const void* value, size_t length)
+{
+    struct entry_s* entry = find_entry(handle, key);
+
+    if (entry == NULL) {
+        if (entry_count == MAX_ENTRIES) {
+            return ESP_ERR_NO_MEM;
+        }
+        entry = &entries[entry_count++];
+        entry->ns = handle;
+        strncpy(entry->key, key, NAME_SIZE - 1);
+        entry->value = NULL;
+    }
+
+    free(entry->value);
+    entry->type = type;
+    entry->length = length;
+    entry->value = malloc(length > 0 ? length : 1);
+    memcpy(entry->value, value, length);
+    write_count++;
+
+    return ESP_OK;
+}
+
+static esp_err_t get_value(nvs_handle_t handle, const char* key, enum entry_type_e type, void* value, size_t* length)
+{
+    struct entry_s* entry = find_entry(handle, key);
+
+    if (entry == NULL || entry->type != type) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    // variable length, NULL value queries length
+    if (value == NULL) {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    memcpy(value, entry->value, entry->length);
+    *length = entry->length;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value)
+{
+    return set_value(handle, key, ENTRY_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char* key, uint16_t value)
+{
+    return set_value(handle, key, ENTRY_TYPE_U16, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value)
+{
+    return set_value(handle, key, ENTRY_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char* key, uint64_t value)
+{
+    return set_value(handle, key, ENTRY_TYPE_U64, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value)
+{
+    return set_value(handle, key, ENTRY_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+{
+    return set_value(handle, key, ENTRY_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value)
+{
+    size_t length = sizeof(*out_value);
+    return get_value(handle, key, ENTRY_TYPE_U8, out_value, &length);
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char* key, uint16_t* out_value)
+{
+    size_t length = sizeof(*out_value);
+    return get_value(handle, key, ENTRY_TYPE_U16, out_value, &length);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* out_value)
+{
+    size_t length = sizeof(*out_value);
+    return get_value(handle, key, ENTRY_TYPE_U32, out_value, &length);
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char* key, uint64_t* out_value)
+{
+    size_t length = sizeof(*out_value);
+    return get_value(handle, key, ENTRY_TYPE_U64, out_value, &length);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length)
+{
+    return get_value(handle, key, ENTRY_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length)
+{
+    return get_value(handle, key, ENTRY_TYPE_BLOB, out_value, length);
+}
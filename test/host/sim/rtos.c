@@ -0,0 +1,607 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "sim.h"
+
+#define TICK_US                 (1000000 / configTICK_RATE_HZ)
+#define MAX_TASKS               16
+#define MAX_TIMERS              16
+#define TASK_STACK_SIZE         (256 * 1024)    // host stack frames are bigger, stack depth of xTaskCreate is ignored
+
+struct sim_task
+{
+    ucontext_t context;
+    void* stack;
+    TaskFunction_t fn;
+    void* arg;
+    char name[16];
+    UBaseType_t priority;
+    bool deleted;
+    bool (*ready)(void* arg);   // blocked until ready or wake time
+    void* ready_arg;
+    int64_t wake_time;          // us, INT64_MAX without timeout
+    uint32_t run_seq;           // round robin of same priority
+    uint32_t notify_value;
+    bool notify_pending;
+};
+
+struct sim_queue
+{
+    uint8_t* items;
+    UBaseType_t item_size;
+    UBaseType_t length;
+    UBaseType_t count;
+    UBaseType_t head;
+};
+
+struct sim_event_group
+{
+    EventBits_t bits;
+};
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void* arg;
+    int64_t expiry;             // us, 0 when not armed
+    uint64_t period;            // us, 0 for once
+};
+
+static int64_t now = SIM_BOOT_TIME_US;
+
+static TickType_t tick_offset = 0;
+
+static struct sim_task* tasks[MAX_TASKS];
+
+static uint8_t task_count = 0;
+
+static struct sim_task* current = NULL;    // NULL in main context
+
+static ucontext_t scheduler_context;
+
+static uint32_t run_seq = 0;
+
+static struct esp_timer timers[MAX_TIMERS];
+
+static uint8_t timer_count = 0;
+
+void sim_init(TickType_t start_tick)
+{
+    now = SIM_BOOT_TIME_US;
+    tick_offset = start_tick - now / TICK_US;
+}
+
+int64_t sim_time(void)
+{
+    return now;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return tick_offset + now / TICK_US;
+}
+
+// tick based timeouts expire on tick boundary, as scheduler checks them in tick interrupt
+static int64_t get_tick_deadline(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? INT64_MAX : (now / TICK_US + ticks) * TICK_US;
+}
+
+static bool is_task_ready(struct sim_task* task)
+{
+    return !task->deleted && (now >= task->wake_time || (task->ready && task->ready(task->ready_arg)));
+}
+
+static struct sim_task* get_ready_task(void)
+{
+    struct sim_task* ready = NULL;
+
+    for (uint8_t i = 0; i < task_count; i++) {
+        struct sim_task* task = tasks[i];
+        if (is_task_ready(task)) {
+            if (ready == NULL || task->priority > ready->priority || (task->priority == ready->priority && task->run_seq < ready->run_seq)) {
+                ready = task;
+            }
+        }
+    }
+
+    return ready;
+}
+
+static void fire_timers(void)
+{
+    bool fired = true;
+
+    // callbacks in expiry order, callback may arm timers again
+    while (fired) {
+        struct esp_timer* next = NULL;
+        for (uint8_t i = 0; i < timer_count; i++) {
+            if (timers[i].expiry > 0 && timers[i].expiry <= now && (next == NULL || timers[i].expiry < next->expiry)) {
+                next = &timers[i];
+            }
+        }
+        fired = next != NULL;
+        if (fired) {
+            next->expiry = next->period > 0 ? next->expiry + next->period : 0;
+            next->callback(next->arg);
+        }
+    }
+}
+
+static void run_task(struct sim_task* task)
+{
+    task->run_seq = ++run_seq;
+    task->ready = NULL;
+    task->wake_time = INT64_MAX;
+
+    current = task;
+    swapcontext(&scheduler_context, &task->context);
+    current = NULL;
+
+    if (task->deleted && task->stack) {
+        free(task->stack);
+        task->stack = NULL;
+    }
+}
+
+// run one ready task, otherwise advance time to next event but not beyond limit
+static void step(int64_t limit)
+{
+    fire_timers();
+
+    struct sim_task* task = get_ready_task();
+    if (task) {
+        run_task(task);
+        return;
+    }
+
+    int64_t next = limit;
+    for (uint8_t i = 0; i < task_count; i++) {
+        if (!tasks[i]->deleted) {
+            next = MIN(next, tasks[i]->wake_time);
+        }
+    }
+    for (uint8_t i = 0; i < timer_count; i++) {
+        if (timers[i].expiry > 0) {
+            next = MIN(next, timers[i].expiry);
+        }
+    }
+
+    if (next == INT64_MAX) {
+        fprintf(stderr, "sim: deadlock, main context waits forever and no task or timer can run\n");
+        abort();
+    }
+    if (next > now) {
+        now = next;
+    }
+}
+
+// block until ready returns true or wake time, returns ready result
+static bool block(bool (*ready)(void* arg), void* arg, int64_t wake_time)
+{
+    if (ready && ready(arg)) {
+        return true;
+    }
+    if (wake_time <= now) {
+        return false;
+    }
+
+    if (current) {
+        struct sim_task* task = current;
+        task->ready = ready;
+        task->ready_arg = arg;
+        task->wake_time = wake_time;
+        swapcontext(&task->context, &scheduler_context);
+        return ready ? ready(arg) : false;
+    }
+
+    // main context has highest priority, tasks run only while it waits
+    while (!(ready && ready(arg))) {
+        if (now >= wake_time) {
+            return false;
+        }
+        step(wake_time);
+    }
+
+    return true;
+}
+
+void sim_run(uint32_t ms)
+{
+    block(NULL, NULL, now + ms * 1000LL);
+}
+
+static bool call_cond(void* arg)
+{
+    return ((bool (*)(void))arg)();
+}
+
+bool sim_run_until(bool (*cond)(void), uint32_t timeout_ms)
+{
+    return block(call_cond, cond, now + timeout_ms * 1000LL);
+}
+
+void sim_delay_us(int64_t us)
+{
+    block(NULL, NULL, now + us);
+}
+
+static void task_entry(void)
+{
+    current->fn(current->arg);
+
+    // task function must not return
+    fprintf(stderr, "sim: task %s returned\n", current->name);
+    abort();
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack_depth, void* arg, UBaseType_t priority, TaskHandle_t* handle)
+{
+    if (task_count == MAX_TASKS) {
+        return pdFAIL;
+    }
+
+    struct sim_task* task = calloc(1, sizeof(struct sim_task));
+    task->fn = fn;
+    task->arg = arg;
+    task->priority = priority;
+    task->wake_time = now;
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->stack = malloc(TASK_STACK_SIZE);
+
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack;
+    task->context.uc_stack.ss_size = TASK_STACK_SIZE;
+    task->context.uc_link = NULL;
+    makecontext(&task->context, task_entry, 0);
+
+    tasks[task_count++] = task;
+    if (handle) {
+        *handle = task;
+    }
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current) {
+        current->deleted = true;
+        swapcontext(&current->context, &scheduler_context);
+    } else {
+        task->deleted = true;
+        free(task->stack);
+        task->stack = NULL;
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    block(NULL, NULL, get_tick_deadline(ticks));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t* prev_wake_time, TickType_t increment)
+{
+    TickType_t wake_tick = *prev_wake_time + increment;
+    TickType_t now_tick = xTaskGetTickCount();
+    BaseType_t should_delay = (int32_t)(wake_tick - now_tick) > 0;
+
+    *prev_wake_time = wake_tick;
+    if (should_delay) {
+        block(NULL, NULL, get_tick_deadline(wake_tick - now_tick));
+    }
+
+    return should_delay;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    BaseType_t ret = pdPASS;
+
+    switch (action) {
+    case eSetBits:
+        task->notify_value |= value;
+        break;
+    case eIncrement:
+        task->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->notify_pending) {
+            ret = pdFAIL;
+        } else {
+            task->notify_value = value;
+        }
+        break;
+    default:
+        break;
+    }
+    task->notify_pending = true;
+
+    return ret;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* higher_task_woken)
+{
+    if (higher_task_woken) {
+        *higher_task_woken = pdTRUE;
+    }
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_task_woken)
+{
+    xTaskNotifyFromISR(task, 0, eIncrement, higher_task_woken);
+}
+
+static bool is_notify_pending(void* arg)
+{
+    return ((struct sim_task*)arg)->notify_pending;
+}
+
+static bool is_notify_value(void* arg)
+{
+    return ((struct sim_task*)arg)->notify_value != 0;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t timeout)
+{
+    struct sim_task* task = current;
+
+    if (!task->notify_pending) {
+        task->notify_value &= ~clear_on_entry;
+    }
+
+    bool notified = block(is_notify_pending, task, get_tick_deadline(timeout));
+    if (value) {
+        *value = task->notify_value;
+    }
+    if (notified) {
+        task->notify_value &= ~clear_on_exit;
+        task->notify_pending = false;
+    }
+
+    return notified ? pdTRUE : pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout)
+{
+    struct sim_task* task = current;
+
+    block(is_notify_value, task, get_tick_deadline(timeout));
+
+    uint32_t value = task->notify_value;
+    if (value) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    task->notify_pending = false;
+
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct sim_queue* queue = calloc(1, sizeof(struct sim_queue));
+
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->items = item_size > 0 ? calloc(length, item_size) : NULL;
+
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+static bool queue_has_item(void* arg)
+{
+    return ((struct sim_queue*)arg)->count > 0;
+}
+
+static bool queue_has_space(void* arg)
+{
+    struct sim_queue* queue = arg;
+    return queue->count < queue->length;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t timeout)
+{
+    if (!block(queue_has_space, queue, get_tick_deadline(timeout))) {
+        return pdFAIL;
+    }
+
+    if (queue->item_size > 0) {
+        memcpy(&queue->items[((queue->head + queue->count) % queue->length) * queue->item_size], item, queue->item_size);
+    }
+    queue->count++;
+
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t timeout)
+{
+    if (!block(queue_has_item, queue, get_tick_deadline(timeout))) {
+        return pdFAIL;
+    }
+
+    if (queue->item_size > 0) {
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+
+    return pdPASS;
+}
+
+// mutex is semaphore with count 1, priority inheritance is not simulated
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t semaphore = xQueueCreate(1, 0);
+    semaphore->count = 1;
+
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout)
+{
+    return xQueueReceive(semaphore, NULL, timeout);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return xQueueSend(semaphore, NULL, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_task_woken)
+{
+    if (higher_task_woken) {
+        *higher_task_woken = pdTRUE;
+    }
+    return xSemaphoreGive(semaphore);
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct sim_event_group));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    group->bits |= bits;
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t prev = group->bits;
+    group->bits &= ~bits;
+    return prev;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    return group->bits;
+}
+
+struct event_wait_s
+{
+    EventGroupHandle_t group;
+    EventBits_t bits;
+    bool all;
+};
+
+static bool is_event_set(void* arg)
+{
+    struct event_wait_s* wait = arg;
+    EventBits_t set = wait->group->bits & wait->bits;
+    return wait->all ? set == wait->bits : set != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t timeout)
+{
+    struct event_wait_s wait = {
+        .group = group,
+        .bits = bits,
+        .all = wait_for_all
+    };
+
+    bool set = block(is_event_set, &wait, get_tick_deadline(timeout));
+    EventBits_t value = group->bits;
+    if (set && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+
+    return value;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle)
+{
+    if (timer_count == MAX_TIMERS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    struct esp_timer* timer = &timers[timer_count++];
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    *handle = timer;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer->expiry > 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->expiry = now + timeout_us;
+    timer->period = 0;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    if (timer->expiry > 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->expiry = now + period_us;
+    timer->period = period_us;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer->expiry == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->expiry = 0;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    timer->expiry = 0;
+    timer->callback = NULL;
+
+    return ESP_OK;
+}
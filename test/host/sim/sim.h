@@ -0,0 +1,98 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "hal/adc_types.h"
+
+#define SIM_BOOT_TIME_US        500000  // esp_timer time when simulation starts, firmware treats 0 as not set
+
+/**
+ * @brief Reset virtual clock, must be called before any firmware init
+ *
+ * @param start_tick tick count at start, near UINT32_MAX to exercise tick count wrap
+ */
+void sim_init(TickType_t start_tick);
+
+/**
+ * @brief Get virtual time
+ *
+ * @return int64_t us, same as esp_timer_get_time
+ */
+int64_t sim_time(void);
+
+/**
+ * @brief Run created tasks and timers, called from main context
+ * Tasks are run cooperatively: highest priority ready task runs until it blocks, virtual time advances only while all tasks are blocked
+ *
+ * @param ms virtual time to run
+ */
+void sim_run(uint32_t ms);
+
+/**
+ * @brief Run created tasks and timers until condition, called from main context
+ *
+ * @param cond checked whenever a task blocked
+ * @param timeout_ms virtual time
+ * @return true condition met
+ * @return false timeout
+ */
+bool sim_run_until(bool (*cond)(void), uint32_t timeout_ms);
+
+/**
+ * @brief Block calling task for virtual time, from main context run other tasks meanwhile
+ *
+ * @param us
+ */
+void sim_delay_us(int64_t us);
+
+/**
+ * @brief Source of simulated ADC input
+ *
+ * @param channel
+ * @param time of conversion in us
+ * @param arg
+ * @return float voltage on pin in mV
+ */
+typedef float (*sim_adc_source_t)(adc_channel_t channel, int64_t time, void* arg);
+
+/**
+ * @brief Set source of simulated ADC input, default is 0mV on all channels
+ *
+ * @param source
+ * @param arg
+ */
+void sim_adc_set_source(sim_adc_source_t source, void* arg);
+
+/**
+ * @brief Set gaussian noise added to conversions
+ *
+ * @param lsb standard deviation in raw units
+ */
+void sim_adc_set_noise(float lsb);
+
+/**
+ * @brief Get ADC full scale of attenuation, raw value 4096 would be at this voltage
+ *
+ * @param atten
+ * @return float mV
+ */
+float sim_adc_get_full_scale(adc_atten_t atten);
+
+/**
+ * @brief Get output of LEDC channel as pwm duty, stopped channel is at its idle level
+ *
+ * @param channel
+ * @return float fraction of period at high level, 0 to 1
+ */
+float sim_ledc_get_duty(uint8_t channel);
+
+/**
+ * @brief Get number of NVS writes since start, set and erase calls
+ *
+ * @return uint32_t
+ */
+uint32_t sim_nvs_get_write_count(void);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,46 @@
+#include "driver/uart.h"
+
+#include "sim.h"
+
+// nothing attached to bus, written bytes are dropped and reads time out
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t* uart_config)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t* uart_queue, int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t uart_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_set_mode(uart_port_t uart_num, uart_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num)
+{
+    return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const void* src, size_t size)
+{
+    return size;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait)
+{
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, void* buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    vTaskDelay(ticks_to_wait);
+
+    return 0;
+}